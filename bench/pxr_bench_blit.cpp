@@ -0,0 +1,168 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "pxr_blit.h"
+#include "pxr_color.h"
+#include "pxr_vec.h"
+
+//
+// Measures the row blit kernels against the per-pixel loop drawSprite used before them by
+// drawing the same sequence of sprites (alternating mirror modes, partly off screen) with each.
+// Every variant must produce identical screen pixels; the run fails otherwise.
+//
+// usage: pxr_bench_blit [draws]
+//
+
+using namespace pxr;
+using namespace pxr::gfx;
+
+static constexpr Vector2i screenSize {640, 480};
+static constexpr Vector2i spriteSize {61, 15};
+static constexpr int defaultDrawCount {400000};
+
+struct SpriteDraw
+{
+	Vector2i _position;
+	bool _mirrorX;
+	bool _mirrorY;
+};
+
+//
+// A sprite with a transparent border and scattered transparent pixels, as typical sprites are.
+//
+static std::vector<Color4u> makeSprite()
+{
+	std::vector<Color4u> pixels(spriteSize._x * spriteSize._y);
+	uint32_t seed {12345};
+	for(int row = 0; row < spriteSize._y; ++row){
+		for(int col = 0; col < spriteSize._x; ++col){
+			seed = (seed * 1664525u) + 1013904223u;
+			bool isBorder = (col < 4 || col >= spriteSize._x - 4);
+			bool isKeyed = isBorder || ((seed >> 24) < 48);
+			uint8_t a = isKeyed ? ALPHA_KEY : 255;
+			pixels[col + (row * spriteSize._x)] = Color4u{uint8_t(seed >> 8), uint8_t(seed >> 16), uint8_t(col), a};
+		}
+	}
+	return pixels;
+}
+
+static std::vector<SpriteDraw> makeDraws(int count)
+{
+	std::vector<SpriteDraw> draws(count);
+	uint32_t seed {54321};
+	for(int i = 0; i < count; ++i){
+		seed = (seed * 1664525u) + 1013904223u;
+		int x = static_cast<int>((seed >> 8) % (screenSize._x + spriteSize._x)) - spriteSize._x / 2;
+		seed = (seed * 1664525u) + 1013904223u;
+		int y = static_cast<int>((seed >> 8) % (screenSize._y + spriteSize._y)) - spriteSize._y / 2;
+		draws[i] = SpriteDraw{Vector2i{x, y}, (i & 1) != 0, (i & 2) != 0};
+	}
+	return draws;
+}
+
+//
+// The loop drawSprite used before the kernels; bounds, mirror and alpha tests per pixel.
+//
+static void drawSpriteLoop(Color4u* screen, const Color4u* sprite, const SpriteDraw& draw)
+{
+	int spriteRowMax = spriteSize._y - 1;
+	int spriteColMax = spriteSize._x - 1;
+	for(int spriteRow = 0; spriteRow <= spriteRowMax; ++spriteRow){
+		int screenRow = draw._position._y + spriteRow;
+		if(screenRow < 0) continue;
+		if(screenRow >= screenSize._y) break;
+		int screenRowOffset = screenRow * screenSize._x;
+		int spriteRowOffset = (draw._mirrorY ? spriteRowMax - spriteRow : spriteRow) * spriteSize._x;
+		for(int spriteCol = 0; spriteCol <= spriteColMax; ++spriteCol){
+			int screenCol = draw._position._x + spriteCol;
+			if(screenCol < 0) continue;
+			if(screenCol >= screenSize._x) break;
+			int spriteColOffset = draw._mirrorX ? spriteColMax - spriteCol : spriteCol;
+			const Color4u& color = sprite[spriteRowOffset + spriteColOffset];
+			if(color._a == ALPHA_KEY) continue;
+			screen[screenCol + screenRowOffset] = color;
+		}
+	}
+}
+
+//
+// The kernel path of drawSprite; clip once then blit row by row.
+//
+static void drawSpriteKernel(Color4u* screen, const Color4u* sprite, const SpriteDraw& draw)
+{
+	int colmin = std::max(0, -draw._position._x);
+	int colmax = std::min(spriteSize._x, screenSize._x - draw._position._x);
+	int rowmin = std::max(0, -draw._position._y);
+	int rowmax = std::min(spriteSize._y, screenSize._y - draw._position._y);
+	int count = colmax - colmin;
+	if(count <= 0 || rowmax <= rowmin)
+		return;
+	for(int row = rowmin; row < rowmax; ++row){
+		int srcRow = draw._mirrorY ? spriteSize._y - 1 - row : row;
+		Color4u* dst = screen + draw._position._x + colmin + ((draw._position._y + row) * screenSize._x);
+		const Color4u* src = sprite + (srcRow * spriteSize._x);
+		if(draw._mirrorX)
+			blitRowKeyedReversed(dst, src + (spriteSize._x - colmax), count);
+		else
+			blitRowKeyed(dst, src + colmin, count);
+	}
+}
+
+template<typename F>
+static double timeDraws(std::vector<Color4u>& screen, const std::vector<SpriteDraw>& draws, F draw)
+{
+	std::fill(screen.begin(), screen.end(), Color4u{0, 0, 0, 0});
+	auto start = std::chrono::steady_clock::now();
+	for(const SpriteDraw& d : draws)
+		draw(d);
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static bool isSamePixels(const std::vector<Color4u>& a, const std::vector<Color4u>& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), [](const Color4u& p, const Color4u& q){
+		return p._r == q._r && p._g == q._g && p._b == q._b && p._a == q._a;
+	});
+}
+
+int main(int argc, char** argv)
+{
+	int drawCount = (argc > 1) ? std::max(1, atoi(argv[1])) : defaultDrawCount;
+
+	std::vector<Color4u> sprite = makeSprite();
+	std::vector<SpriteDraw> draws = makeDraws(drawCount);
+	std::vector<Color4u> expected(screenSize._x * screenSize._y);
+	std::vector<Color4u> screen(screenSize._x * screenSize._y);
+
+	printf("%d draws of a %dx%d sprite to a %dx%d screen\n", drawCount, spriteSize._x, spriteSize._y,
+	       screenSize._x, screenSize._y);
+
+	double loopMs = timeDraws(expected, draws, [&](const SpriteDraw& d){
+		drawSpriteLoop(expected.data(), sprite.data(), d);
+	});
+	printf("%-8s %9.2fms\n", "loop", loopMs);
+
+	bool isIdentical {true};
+	BlitKernel best = getBlitKernel();
+	for(BlitKernel kernel : {BlitKernel::SCALAR, BlitKernel::SSE2, BlitKernel::AVX2}){
+		if(!setBlitKernel(kernel)){
+			printf("%-8s unsupported\n", getBlitKernelName(kernel));
+			continue;
+		}
+		double ms = timeDraws(screen, draws, [&](const SpriteDraw& d){
+			drawSpriteKernel(screen.data(), sprite.data(), d);
+		});
+		bool isSame = isSamePixels(screen, expected);
+		isIdentical &= isSame;
+		printf("%-8s %9.2fms  x%.2f%s\n", getBlitKernelName(kernel), ms, loopMs / ms,
+		       isSame ? "" : "  MISMATCH");
+	}
+	setBlitKernel(best);
+
+	return isIdentical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
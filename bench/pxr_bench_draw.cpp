@@ -0,0 +1,343 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include "pxr_gfx.h"
+#include "pxr_blit.h"
+#include "pxr_bmp.h"
+#include "pxr_log.h"
+
+//
+// Measures whole frames of draw calls through the gfx module on the headless backend. Each
+// scene is drawn in immediate mode and then deferred with 1 to N raster threads; every run must
+// leave the screen pixel identical to the immediate run, else the bench fails. Shape scenes are
+// also drawn as the equivalent drawPoint loops (in immediate mode), which must draw the same 
+// pixels as the shapes.
+//
+// usage: pxr_bench_draw [maxThreads] [frames]
+//
+// maxThreads defaults to the num hardware threads.
+//
+
+using namespace pxr;
+using namespace pxr::gfx;
+
+static constexpr Vector2i screenSize {640, 480};
+static constexpr int spriteCount {5000};
+static constexpr Vector2i spriteSize {16, 16};
+static constexpr int spritesPerSheet {4};
+static constexpr int shapeCount {300};
+static constexpr int maxShapeRadius {40};
+static constexpr int maxPolygonVertices {8};
+static constexpr int defaultFrameCount {60};
+static constexpr Color4u fillColor {200, 80, 40, 255};
+static constexpr Color4u borderColor {250, 230, 120, 255};
+
+static ResourceKey_t sheetKey {0};
+
+static uint32_t nextRandom(uint32_t& seed)
+{
+	seed = (seed * 1664525u) + 1013904223u;
+	return seed >> 8;
+}
+
+//
+// A sheet of spritesPerSheet sprites in a row, each a colored disc on a transparent square.
+//
+static ResourceKey_t makeSpritesheet()
+{
+	io::Bmp image {};
+	image.create(Vector2i{spriteSize._x * spritesPerSheet, spriteSize._y}, Color4u{0, 0, 0, 0});
+	std::vector<Sprite> sprites(spritesPerSheet);
+	for(int i = 0; i < spritesPerSheet; ++i){
+		for(int row = 0; row < spriteSize._y; ++row){
+			for(int col = 0; col < spriteSize._x; ++col){
+				int dx = (2 * col) - spriteSize._x + 1;
+				int dy = (2 * row) - spriteSize._y + 1;
+				if((dx * dx) + (dy * dy) > spriteSize._x * spriteSize._x)
+					continue;
+				Color4u color {uint8_t(60 * i), uint8_t(col * 15), uint8_t(row * 15), 255};
+				image.getRow(row)[col + (i * spriteSize._x)] = color;
+			}
+		}
+		sprites[i]._position = Vector2i{i * spriteSize._x, 0};
+		sprites[i]._size = spriteSize;
+		sprites[i]._origin = Vector2i{0, 0};
+	}
+	return registerSpritesheet("bench_sprites", std::move(image), std::move(sprites));
+}
+
+static void drawSprites(ScreenID_t screenid, int frame)
+{
+	uint32_t seed = 1000 + frame;
+	clearScreenColor(Color4u{20, 20, 40, 255}, screenid);
+	for(int i = 0; i < spriteCount; ++i){
+		int x = static_cast<int>(nextRandom(seed) % (screenSize._x + spriteSize._x)) - spriteSize._x;
+		int y = static_cast<int>(nextRandom(seed) % (screenSize._y + spriteSize._y)) - spriteSize._y;
+		drawSprite(Vector2i{x, y}, sheetKey, i % spritesPerSheet, screenid, (i & 1) != 0, (i & 2) != 0);
+	}
+}
+
+static Vector2i randomCenter(uint32_t& seed)
+{
+	int x = static_cast<int>(nextRandom(seed) % (screenSize._x + maxShapeRadius)) - (maxShapeRadius / 2);
+	int y = static_cast<int>(nextRandom(seed) % (screenSize._y + maxShapeRadius)) - (maxShapeRadius / 2);
+	return Vector2i{x, y};
+}
+
+static std::vector<Ellipse> makeEllipses(int frame, bool isCircles)
+{
+	uint32_t seed = 2000 + frame;
+	std::vector<Ellipse> ellipses(shapeCount);
+	for(Ellipse& ellipse : ellipses){
+		ellipse._center = randomCenter(seed);
+		ellipse._radii._x = static_cast<int>(nextRandom(seed) % maxShapeRadius);
+		ellipse._radii._y = isCircles ? ellipse._radii._x : static_cast<int>(nextRandom(seed) % maxShapeRadius);
+	}
+	return ellipses;
+}
+
+//
+// Polygons of 3 to maxPolygonVertices vertices spaced evenly about a center, as of explosion
+// debris.
+//
+static void makePolygons(int frame, std::vector<Vector2i>& vertices, std::vector<int>& counts)
+{
+	uint32_t seed = 3000 + frame;
+	vertices.clear();
+	counts.resize(shapeCount);
+	for(int& count : counts){
+		Vector2i center = randomCenter(seed);
+		int radius = 1 + static_cast<int>(nextRandom(seed) % maxShapeRadius);
+		float phase = static_cast<float>(nextRandom(seed) % 360) * (3.14159265f / 180.f);
+		count = 3 + static_cast<int>(nextRandom(seed) % (maxPolygonVertices - 2));
+		for(int i = 0; i < count; ++i){
+			float angle = phase + (static_cast<float>(i) * 2.f * 3.14159265f / static_cast<float>(count));
+			vertices.push_back(Vector2i{
+				center._x + static_cast<int>(std::lround(radius * std::cos(angle))),
+				center._y + static_cast<int>(std::lround(radius * std::sin(angle)))
+			});
+		}
+	}
+}
+
+//
+// True if the center of pixel [dx, dy] (w.r.t the center) lies within the ellipse of radii 
+// (rx + 1/2, ry + 1/2); the test the shape draw calls use (see Circle).
+//
+static bool isInEllipse(Vector2i radii, int dx, int dy)
+{
+	int64_t w = (int64_t{2} * radii._x) + 1;
+	int64_t h = (int64_t{2} * radii._y) + 1;
+	return (int64_t{4} * dx * dx * h * h) + (int64_t{4} * dy * dy * w * w) <= w * w * h * h;
+}
+
+static void drawEllipsePoints(const Ellipse& ellipse, bool isFilled, Color4u color, ScreenID_t screenid)
+{
+	Vector2i r = ellipse._radii;
+	for(int dy = -r._y; dy <= r._y; ++dy){
+		for(int dx = -r._x; dx <= r._x; ++dx){
+			if(!isInEllipse(r, dx, dy))
+				continue;
+			bool isEdge = !isInEllipse(r, dx - 1, dy) || !isInEllipse(r, dx + 1, dy) ||
+			              !isInEllipse(r, dx, dy - 1) || !isInEllipse(r, dx, dy + 1);
+			if(isFilled || isEdge)
+				drawPoint(Vector2i{ellipse._center._x + dx, ellipse._center._y + dy}, color, screenid);
+		}
+	}
+}
+
+static void drawEllipseScene(ScreenID_t screenid, int frame, bool isCircles)
+{
+	std::vector<Ellipse> ellipses = makeEllipses(frame, isCircles);
+	clearScreenColor(Color4u{20, 20, 40, 255}, screenid);
+	if(isCircles){
+		std::vector<Circle> circles(ellipses.size());
+		for(size_t i = 0; i < ellipses.size(); ++i)
+			circles[i] = Circle{ellipses[i]._center, ellipses[i]._radii._x};
+		drawFillCircles(circles.data(), shapeCount, fillColor, screenid);
+		drawBorderCircles(circles.data(), shapeCount, borderColor, screenid);
+	}
+	else{
+		drawFillEllipses(ellipses.data(), shapeCount, fillColor, screenid);
+		drawBorderEllipses(ellipses.data(), shapeCount, borderColor, screenid);
+	}
+}
+
+static void drawEllipseSceneAsPoints(ScreenID_t screenid, int frame, bool isCircles)
+{
+	std::vector<Ellipse> ellipses = makeEllipses(frame, isCircles);
+	clearScreenColor(Color4u{20, 20, 40, 255}, screenid);
+	for(const Ellipse& ellipse : ellipses)
+		drawEllipsePoints(ellipse, true, fillColor, screenid);
+	for(const Ellipse& ellipse : ellipses)
+		drawEllipsePoints(ellipse, false, borderColor, screenid);
+}
+
+static void drawCircles(ScreenID_t screenid, int frame)
+{
+	drawEllipseScene(screenid, frame, true);
+}
+
+static void drawCirclesAsPoints(ScreenID_t screenid, int frame)
+{
+	drawEllipseSceneAsPoints(screenid, frame, true);
+}
+
+static void drawEllipses(ScreenID_t screenid, int frame)
+{
+	drawEllipseScene(screenid, frame, false);
+}
+
+static void drawEllipsesAsPoints(ScreenID_t screenid, int frame)
+{
+	drawEllipseSceneAsPoints(screenid, frame, false);
+}
+
+static void drawPolygons(ScreenID_t screenid, int frame)
+{
+	std::vector<Vector2i> vertices;
+	std::vector<int> counts;
+	makePolygons(frame, vertices, counts);
+	clearScreenColor(Color4u{20, 20, 40, 255}, screenid);
+	drawFillPolygons(vertices.data(), counts.data(), shapeCount, fillColor, screenid);
+}
+
+//
+// Each row drawn point by point from the leftmost to the rightmost crossing of the row by the
+// edges, the crossings found as the polygon draw calls find them.
+//
+static void drawPolygonsAsPoints(ScreenID_t screenid, int frame)
+{
+	std::vector<Vector2i> vertices;
+	std::vector<int> counts;
+	makePolygons(frame, vertices, counts);
+	clearScreenColor(Color4u{20, 20, 40, 255}, screenid);
+	const Vector2i* polygon = vertices.data();
+	for(int count : counts){
+		int ymin {polygon[0]._y}, ymax {polygon[0]._y};
+		for(int i = 1; i < count; ++i){
+			ymin = std::min(ymin, polygon[i]._y);
+			ymax = std::max(ymax, polygon[i]._y);
+		}
+		for(int y = ymin; y <= ymax; ++y){
+			int xmin {std::numeric_limits<int>::max()};
+			int xmax {std::numeric_limits<int>::min()};
+			for(int i = 0; i < count; ++i){
+				Vector2i a = polygon[i];
+				Vector2i b = polygon[(i + 1) % count];
+				if(y < std::min(a._y, b._y) || y > std::max(a._y, b._y))
+					continue;
+				if(a._y == b._y){
+					xmin = std::min({xmin, a._x, b._x});
+					xmax = std::max({xmax, a._x, b._x});
+					continue;
+				}
+				if(a._y > b._y)
+					std::swap(a, b);
+				double x = a._x + (static_cast<double>(b._x - a._x) * (y - a._y) / (b._y - a._y));
+				int rounded = static_cast<int>(std::floor(x + 0.5));
+				xmin = std::min(xmin, rounded);
+				xmax = std::max(xmax, rounded);
+			}
+			for(int x = xmin; x <= xmax; ++x)
+				drawPoint(Vector2i{x, y}, fillColor, screenid);
+		}
+		polygon += count;
+	}
+}
+
+struct Scene
+{
+	const char* _name;
+	void (*_draw)(ScreenID_t screenid, int frame);
+	void (*_drawAsPoints)(ScreenID_t screenid, int frame);   // the equivalent drawPoint loops, if any.
+};
+
+static const Scene scenes[] {
+	{"sprites", drawSprites, nullptr},
+	{"circles", drawCircles, drawCirclesAsPoints},
+	{"ellipses", drawEllipses, drawEllipsesAsPoints},
+	{"polygons", drawPolygons, drawPolygonsAsPoints}
+};
+
+//
+// Draws and presents 'frames' frames of a scene and returns the mean milliseconds per frame.
+//
+static double timeScene(void (*draw)(ScreenID_t, int), ScreenID_t screenid, int frames)
+{
+	auto start = std::chrono::steady_clock::now();
+	for(int frame = 0; frame < frames; ++frame){
+		draw(screenid, frame);
+		present();
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / frames;
+}
+
+int main(int argc, char** argv)
+{
+	int maxThreads = (argc > 1) ? atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+	int frames = (argc > 2) ? atoi(argv[2]) : defaultFrameCount;
+	maxThreads = std::max(1, maxThreads);
+	frames = std::max(1, frames);
+
+	log::initialize();
+	BackendConfig backend {};
+	backend._type = BackendType::HEADLESS;
+	if(!initialize("pxr_bench_draw", screenSize, false, backend)){
+		fprintf(stderr, "failed to initialize gfx\n");
+		return EXIT_FAILURE;
+	}
+
+	sheetKey = makeSpritesheet();
+	ScreenID_t screenid = createScreen(screenSize);
+
+	printf("%dx%d screen, %d frames per run, %s kernels, %u hardware threads\n", screenSize._x,
+	       screenSize._y, frames, getBlitKernelName(getBlitKernel()), std::thread::hardware_concurrency());
+
+	bool isIdentical {true};
+	for(const Scene& scene : scenes){
+		io::Bmp expected {}, actual {};
+
+		setDrawMode(DrawMode::IMMEDIATE);
+		setRasterThreadCount(1);
+		double immediateMs = timeScene(scene._draw, screenid, frames);
+		captureScreen(screenid, expected);
+		printf("%-10s immediate    %8.3fms/frame\n", scene._name, immediateMs);
+
+		if(scene._drawAsPoints != nullptr){
+			double pointsMs = timeScene(scene._drawAsPoints, screenid, frames);
+			captureScreen(screenid, actual);
+			bool isSame = (io::compareBmps(actual, expected)._diffPixels == 0);
+			isIdentical &= isSame;
+			printf("%-10s drawPoint    %8.3fms/frame  x%.2f%s\n", scene._name, pointsMs,
+			       pointsMs / immediateMs, isSame ? "" : "  MISMATCH");
+		}
+
+		setDrawMode(DrawMode::DEFERRED);
+		double oneThreadMs {0.0};
+		for(int threads = 1; threads <= maxThreads; ++threads){
+			setRasterThreadCount(threads);
+			double ms = timeScene(scene._draw, screenid, frames);
+			if(threads == 1)
+				oneThreadMs = ms;
+			captureScreen(screenid, actual);
+			bool isSame = (io::compareBmps(actual, expected)._diffPixels == 0);
+			isIdentical &= isSame;
+			printf("%-10s deferred x%-3d%8.3fms/frame  x%.2f%s\n", scene._name, threads, ms,
+			       oneThreadMs / ms, isSame ? "" : "  MISMATCH");
+		}
+	}
+
+	shutdown();
+	log::shutdown();
+	return isIdentical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
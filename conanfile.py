@@ -16,7 +16,7 @@ class PixiRetroConan(ConanFile):
 	user = "ianmurfinxyz"
 	channel = "stable"
 	generators = "cmake"
-	exports_sources = ["CMakeLists.txt", "src/*", "include/*"]
+	exports_sources = ["CMakeLists.txt", "src/*", "include/*", "tests/*", "bench/*"]
 
 	def config_options(self):
 		if self.settings.os == "Windows":
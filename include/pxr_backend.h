@@ -0,0 +1,89 @@
+#ifndef _PIXIRETRO_GFX_BACKEND_H_
+#define _PIXIRETRO_GFX_BACKEND_H_
+
+#include <string>
+#include <memory>
+#include "pxr_gfx.h"
+#include "pxr_vec.h"
+#include "pxr_rect.h"
+#include "pxr_color.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+//
+// The device the gfx module presents screens on; owns the window (if any) and whatever
+// resources mirror the screens on the device. Internal to the gfx module, which selects the
+// backend from the BackendConfig passed to gfx::initialize.
+//
+// The gfx module keeps all screen pixels and dirty regions in memory; a backend only receives
+// the dirty rects to mirror each frame and the order to draw the screens in. Screens are drawn
+// at their _position scaled by their _pxSize, bottom to top in the order of the draw calls,
+// where pixels with alpha == 0 are transparent. Screens are drawn as views of their pixels 
+// offset by their _scroll and wrapped around (see Screen); the dirty rects are w.r.t the pixels,
+// not the view.
+//
+class RenderBackend
+{
+public:
+	virtual ~RenderBackend() = default;
+
+	//
+	// Creates the window. Returns false on fatal error.
+	//
+	virtual bool initialize(const std::string& windowTitle, Vector2i windowSize, bool fullscreen) = 0;
+	virtual void shutdown() = 0;
+
+	virtual const char* getName() const = 0;
+
+	//
+	// The size of the window in real pixels, which may differ from the size requested on high
+	// dpi displays.
+	//
+	virtual Vector2i getWindowSize() const = 0;
+	virtual int getMaxPixelSize() const = 0;
+	virtual int getMaxScreenSize() const = 0;
+
+	virtual void setViewport(iRect viewport) = 0;
+
+	//
+	// Creates/frees the device resources of a screen; called once the screen's resolution and
+	// pixels are set.
+	//
+	virtual void createScreenResources(Screen& screen) = 0;
+	virtual void freeScreenResources(Screen& screen) = 0;
+
+	//
+	// Mirrors the pixels within the dirty rects of the screen on the device. The caller clears
+	// the dirty region after.
+	//
+	virtual void uploadScreen(Screen& screen) = 0;
+
+	virtual void clearWindow(Color4f color) = 0;
+	virtual void drawScreen(const Screen& screen) = 0;
+
+	//
+	// Called at the end of present once all screens are drawn; i.e. swaps the window buffers.
+	//
+	virtual void endFrame() = 0;
+};
+
+//
+// Presents with fixed-function opengl to an SDL window; see the gfx module for the details.
+//
+std::unique_ptr<RenderBackend> createOpenGLBackend();
+
+//
+// Presents to nothing; no window is created and no opengl calls are made, thus it runs without
+// a display (e.g. under SDL's dummy video driver). If the config has a capture path the frames
+// are composed in memory and every _captureInterval'th is written to the bmp file
+// <capturePath><frameNumber>.bmp, where frame numbers count presents from 0 and are 6 digits.
+//
+std::unique_ptr<RenderBackend> createHeadlessBackend(const BackendConfig& config);
+
+} // namespace gfx
+} // namespace pxr
+
+#endif
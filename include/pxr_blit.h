@@ -0,0 +1,119 @@
+#ifndef _PIXIRETRO_GFX_BLIT_H_
+#define _PIXIRETRO_GFX_BLIT_H_
+
+#include "pxr_color.h"
+#include "pxr_vec.h"
+#include "pxr_rect.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+//
+// Row blitting kernels used by the gfx module to copy rows of pixels from gfx resources to
+// virtual screens.
+//
+// All keyed kernels treat source pixels with alpha == ALPHA_KEY as transparent and do not write them
+// to the destination. The kernels do not clip; callers must clip rows to the bounds of both
+// source and destination prior to calling.
+//
+// Each kernel has SSE2 and AVX2 implementations as well as a scalar fallback. The fastest
+// implementation supported by the CPU is selected at program startup.
+//
+
+//
+// The instruction set used by the selected kernels.
+//
+enum class BlitKernel
+{
+	SCALAR,
+	SSE2,
+	AVX2
+};
+
+//
+// Copies 'count' pixels from 'src' to 'dst', i.e. dst[i] = src[i].
+//
+void blitRowKeyed(Color4u* dst, const Color4u* src, int count);
+
+//
+// Copies 'count' pixels from 'src' to 'dst' in reverse order, i.e. dst[i] = src[count - 1 - i].
+// Used to draw rows mirrored in the x-axis.
+//
+void blitRowKeyedReversed(Color4u* dst, const Color4u* src, int count);
+
+//
+// Copies 'count' pixels from 'src' to 'dst' in reverse order without testing for transparent
+// pixels. Used to draw runs of opaque pixels mirrored in the x-axis; unmirrored runs can be
+// copied with a plain memcpy.
+//
+void copyRowReversed(Color4u* dst, const Color4u* src, int count);
+
+//
+// Copies each of the 'count' pixels of 'src' to 'dst' where the 'dst' pixel is transparent, i.e.
+// draws 'src' under 'dst'. Returns true if any 'dst' pixel is still transparent afterwards.
+//
+bool underlayRowKeyed(Color4u* dst, const Color4u* src, int count);
+
+//
+// Returns true if any of the 'count' pixels is transparent.
+//
+bool isRowKeyed(const Color4u* px, int count);
+
+//
+// Expands 'count' palette indices from 'src' to colors in 'dst', i.e. dst[i] = palette[src[i]].
+// The palette must have 256 entries. Used to present indexed screens. Only has an AVX2 (gather)
+// implementation; SSE2 has no gather so uses the scalar kernel.
+//
+void expandRowIndexed(Color4u* dst, const uint8_t* src, const Color4u* palette, int count);
+
+//
+// Writes 'color' to each of the 'count' pixels of 'dst' whose bit is set in the bit mask 'mask',
+// where pixel i is bit (bit + i) of the mask and bit b of the mask is bit (b % 64) of word 
+// (b / 64). Used to draw text from glyph masks. The mask words are expanded to lane masks and 
+// the color is blended in 4 (SSE2) or 8 (AVX2) pixels at a time.
+//
+void fillRowMasked(Color4u* dst, const uint64_t* mask, int bit, int count, Color4u color);
+
+//
+// Writes 'color' to each of the 'count' pixels of 'dst' with 16 (SSE2) or 32 (AVX2) byte stores.
+// Used to fill runs of screen pixels (fills and clears).
+//
+void fillRow(Color4u* dst, Color4u color, int count);
+
+//
+// Writes the repeating 4 pixel pattern 'pattern' to the 'count' pixels of 'dst' starting from
+// pattern pixel 'phase', i.e. dst[i] = pattern[(phase + i) % 4]. Used to draw ordered dither.
+//
+void fillRowPattern(Color4u* dst, const Color4u* pattern, int phase, int count);
+
+//
+// Writes the index of each of the 'count' points which lie within 'clip' to 'survivors', in 
+// order, and returns the num written; 'survivors' must have room for 'count' indices. Used to
+// clip batches of points. The points are compared 2 (SSE2) or 4 (AVX2) at a time and the
+// survivors compacted without branches.
+//
+int clipPoints(const Vector2i* points, int count, const iRect& clip, int* survivors);
+
+//
+// Returns the instruction set used by the selected kernels.
+//
+BlitKernel getBlitKernel();
+
+//
+// Forces the use of the kernels of a specific instruction set. Primarily intended for comparing
+// the performance of the implementations. If the CPU does not support the instruction set
+// requested the selection is not changed and false is returned.
+//
+bool setBlitKernel(BlitKernel kernel);
+
+//
+// Returns a printable name for a blit kernel, e.g. for logging.
+//
+const char* getBlitKernelName(BlitKernel kernel);
+
+} // namespace gfx
+} // namespace pxr
+
+#endif
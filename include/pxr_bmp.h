@@ -4,40 +4,79 @@
 #include <fstream>
 #include "pxr_color.h"
 #include "pxr_vec.h"
+#include "pxr_rect.h"
 
 namespace pxr
 {
 namespace io
 {
 
+//
+// A non-owning view of a rectangular region of pixels stored in rows 'stride' pixels apart. Row 0
+// is the bottom row of the region. Views are invalidated if the image they view is reloaded,
+// recreated or destroyed.
+//
+struct BmpView
+{
+	const gfx::Color4u* _pixels;   // the bottom-left pixel of the region.
+	int _stride;                   // num pixels from the start of one row to the next.
+	Vector2i _size;
+
+	const gfx::Color4u* getRow(int row) const {return _pixels + (row * _stride);}
+	const gfx::Color4u& getPixel(int row, int col) const {return _pixels[(row * _stride) + col];}
+};
+
 //
 // Represents a bitmap (.bmp) image file.
 //
+// The pixels are stored in a single contiguous buffer with the origin in the bottom-left, i.e. 
+// row 0 is the bottom row of the image. Every row starts on a ROW_ALIGNMENT byte boundary, thus 
+// rows are padded up to a stride which may exceed the width of the image. Always use the stride 
+// to step between rows.
+//
+// Bmps are move-only to guarantee pixels are never deep-copied by accident; e.g. when storing
+// them in resource containers.
+//
 class Bmp
 {
 public:
 	static constexpr const char* FILE_EXTENSION {".bmp"};
+	static constexpr int ROW_ALIGNMENT {64};
 
 public:
 	Bmp();
 	~Bmp();
 
-	Bmp(const Bmp& other);
-	Bmp(Bmp&& other);
-	Bmp& operator=(const Bmp& other);
-	Bmp& operator=(Bmp&& other);
+	Bmp(const Bmp& other) = delete;
+	Bmp(Bmp&& other) noexcept;
+	Bmp& operator=(const Bmp& other) = delete;
+	Bmp& operator=(Bmp&& other) noexcept;
 
 	bool load(std::string filepath);
 	void create(Vector2i size, gfx::Color4u fill);
 
+	//
+	// Writes the image to a 32-bit bmp file (with alpha) which load reads back unchanged.
+	//
+	bool write(std::string filepath) const;
+
 	void clear(gfx::Color4u color);
 
-	const gfx::Color4u getPixel(int row, int col);
-	const gfx::Color4u* getRow(int row);
-	const gfx::Color4u* const* getPixels() const {return _pixels;}
+	const gfx::Color4u getPixel(int row, int col) const;
+	const gfx::Color4u* getRow(int row) const;
+	gfx::Color4u* getRow(int row);
+	const gfx::Color4u* getPixels() const {return _pixels;}
+
+	//
+	// Returns a view of the entire image or of the sub-region of size 'size' with its bottom-left
+	// pixel at 'position' (which must lie within the image).
+	//
+	BmpView getView() const;
+	BmpView getView(Vector2i position, Vector2i size) const;
 
 	int getWidth() const {return _size._x;}
 	int getHeight() const {return _size._y;}
+	int getStride() const {return _stride;}
 	Vector2i getSize() const {return _size;}
 
 private:
@@ -110,10 +149,15 @@ private:
 
 private:
 	//
-	// Raw pixel data accessed by [row][col], i.e. _pixels is a pointer to an array of pixel
-	// rows.
+	// Raw pixel data accessed by [(row * _stride) + col]. The buffer is ROW_ALIGNMENT aligned.
 	//
-	gfx::Color4u** _pixels;
+	gfx::Color4u* _pixels;
+
+	//
+	// Num pixels from the start of one row to the next; the width padded up to a multiple of
+	// ROW_ALIGNMENT bytes.
+	//
+	int _stride;
 
 	//
 	// Size/dimensions of the bmp image: x=width (num cols) and y=height (num rows).
@@ -121,6 +165,24 @@ private:
 	Vector2i _size;
 };
 
+//
+// The result of comparing two images pixel by pixel.
+//
+struct BmpDiff
+{
+	bool _isSizeMismatch;   // the images differ in size thus no pixels were compared.
+	int _diffPixels;        // num pixels which differ in any channel.
+	int _maxChannelDelta;   // the largest absolute difference of any channel of any pixel.
+	iRect _bounds;          // the smallest rect containing all differing pixels.
+};
+
+//
+// Compares the pixels of two images. If 'diffImage' is not null it is recreated as an image of
+// the differences: pixels which differ are red and pixels which match are the pixels of 'b' 
+// darkened, such that the differences stand out.
+//
+BmpDiff compareBmps(const Bmp& a, const Bmp& b, Bmp* diffImage = nullptr);
+
 } // namespace io
 } // namespace pxr
 
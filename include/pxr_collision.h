@@ -115,6 +115,16 @@ struct CollisionSubject
 	gfx::SpriteID_t _spriteid;
 };
 
+//
+// Tile map collision results. The cells are those of the map which hold a tile and overlap the
+// tested AABB; x,y = col,row of the cell in the map.
+//
+struct TileCollisionResult
+{
+	bool _isCollision;
+	std::vector<Vector2i> _cells;
+};
+
 //
 // Basic AABB intersection test.
 //
@@ -130,6 +140,20 @@ const CollisionResult& isPixelIntersection(const CollisionSubject& a,
 																					 const CollisionSubject& b,
 																					 bool pixelLists = false);
 
+//
+// Tile map collision test. Tests an AABB against the cells of a tile map drawn with the 
+// bottom-left of cell [0, 0] at 'mapPosition' (both w.r.t the common space); any cell holding a 
+// tile (not gfx::EMPTY_TILE) which the AABB overlaps is colliding. The test reads the tile grid
+// only, thus costs one lookup per overlapped cell regardless of the pixels of the tiles.
+//
+// As for the pixel test the result is stored internally and persists only until the next call.
+// If a cell list is not required the test returns upon the first colliding cell.
+//
+const TileCollisionResult& isTileMapIntersection(const AABB& box, 
+                                                 Vector2i mapPosition, 
+                                                 gfx::ResourceKey_t mapKey,
+                                                 bool cellList = false);
+
 } // namespace pxr
 
 #endif
@@ -9,6 +9,12 @@ namespace pxr
 namespace gfx
 {
 
+//
+// The alpha value which marks a pixel as fully transparent. The gfx module skips drawing any
+// pixel with this alpha value.
+//
+constexpr uint8_t ALPHA_KEY = 0;
+
 //
 // A 4-channel color (RGBA) where each channel is an unsigned 8-bit integer.
 //
@@ -5,6 +5,8 @@
 
 #include <memory>
 #include <chrono>
+#include <string>
+#include <vector>
 
 #include "pxr_rc.h"
 #include "pxr_game.h"
@@ -40,6 +42,26 @@ public:
 	//
 	// Runs the game loop.
 	//
+	// If the environment variable PXR_GOLDEN_TICKS is set the game is instead driven through a 
+	// golden run; a regression test of the game's screens. The splash is skipped, the rand 
+	// generator is seeded with its default seed and the game is run for exactly the given number
+	// of update ticks, each followed by a draw tick, with a fixed tick period and game clock 
+	// independent of real time. After the draw of each selected tick the pixels of every screen 
+	// are either written to, or compared against, golden images stored as bmp files:
+	//
+	//     PXR_GOLDEN_TICKS=<num ticks to run>
+	//     PXR_GOLDEN_FRAMES=<comma separated ticks to check; default only the last>
+	//     PXR_GOLDEN_PATH=<path prefix of golden images; default "golden/">
+	//     PXR_GOLDEN_RECORD=1 to (re)write the golden images rather than compare
+	//
+	// Golden images are named <path>t<tick>_s<screenid>.bmp. Per-pixel differences are logged
+	// and an image of the differences is written beside the golden image (<name>_diff.bmp). If
+	// any screen differs, shutdown exits with EXIT_FAILURE.
+	//
+	// Input is replayed from PXR_REPLAY=<replay file> if set (see input::startReplay); record 
+	// replay files of normal runs with PXR_RECORD=<replay file>. Run headless (PXR_BACKEND) to
+	// run golden runs without a display.
+	//
 	void run();
 
 private:
@@ -67,6 +89,24 @@ private:
 	//
 	static constexpr gfx::ResourceName_t engineFontName {"dogica8"};
 
+	//
+	// Environment variables which override the gfx backend set in the engine rc file.
+	//
+	static constexpr const char* backendEnvVar {"PXR_BACKEND"};
+	static constexpr const char* capturePathEnvVar {"PXR_CAPTURE_PATH"};
+	static constexpr const char* captureIntervalEnvVar {"PXR_CAPTURE_INTERVAL"};
+
+	//
+	// Environment variables which configure golden runs and input replays; see run().
+	//
+	static constexpr const char* goldenTicksEnvVar {"PXR_GOLDEN_TICKS"};
+	static constexpr const char* goldenFramesEnvVar {"PXR_GOLDEN_FRAMES"};
+	static constexpr const char* goldenPathEnvVar {"PXR_GOLDEN_PATH"};
+	static constexpr const char* goldenRecordEnvVar {"PXR_GOLDEN_RECORD"};
+	static constexpr const char* replayEnvVar {"PXR_REPLAY"};
+	static constexpr const char* recordEnvVar {"PXR_RECORD"};
+	static constexpr const char* defaultGoldenPath {"golden/"};
+
 	//
 	// Keys used by the engine for user controlled engine features. If these keys
 	// clash with your game controls they can be changed here.
@@ -199,6 +239,24 @@ private:
 		bool _isNewTickFrequencySample;
 	};
 
+	//
+	// The configuration and results of a golden run; see run().
+	//
+	struct GoldenRun
+	{
+		int _ticks;                  // num ticks to run; 0 if not a golden run.
+		std::vector<int> _frames;    // the ticks after which to check the screens.
+		std::string _path;           // path prefix of the golden images.
+		bool _isRecording;           // write golden images rather than compare against them.
+		int _checkedImages;
+		int _failedImages;
+	};
+
+	//
+	// The engine settings read from the rc file 'engine'. Drawing is immediate unless deferredDraw
+	// is set (see gfx::DrawMode); rasterThreads only applies to deferred drawing, thus has no 
+	// effect without it.
+	//
 	class EngineRC final : public io::RC
 	{
 	public:
@@ -212,7 +270,11 @@ private:
 			KEY_CLEAR_RED,
 			KEY_CLEAR_GREEN,
 			KEY_CLEAR_BLUE,
-			KEY_FPS_LOCK
+			KEY_FPS_LOCK,
+			KEY_DEFERRED_DRAW,
+			KEY_RASTER_THREADS,
+			KEY_COMPOSITOR,
+			KEY_HEADLESS
 		};
 
 		EngineRC() : RC({
@@ -223,7 +285,11 @@ private:
 			{KEY_CLEAR_RED,     "clearRed",     {10},    {0},     {255}},
 			{KEY_CLEAR_GREEN,   "clearGreen",   {10},    {0},     {255}},
 			{KEY_CLEAR_BLUE,    "clearBlue",    {10},    {0},     {255}},
-			{KEY_FPS_LOCK,      "fpsLock",      {60},    {24},    {1000}}
+			{KEY_FPS_LOCK,      "fpsLock",      {60},    {24},    {1000}},
+			{KEY_DEFERRED_DRAW, "deferredDraw", {false}, {false}, {true}},
+			{KEY_RASTER_THREADS, "rasterThreads", {1},   {1},     {64}},
+			{KEY_COMPOSITOR,    "compositor",   {false}, {false}, {true}},
+			{KEY_HEADLESS,      "headless",     {false}, {false}, {true}}
 		}){}
 	};
 
@@ -234,6 +300,10 @@ private:
 	void onUpdateTick(float tickPeriodSeconds);
 	void onDrawTick(float tickPeriodSeconds);
 
+	void readGoldenRun();
+	void goldenLoop();
+	void checkGoldenImages(int tick);
+
 	void splashLoop();
 	void onSplashUpdateTick(float tickPeriodSeconds);
 	void onSplashDrawTick(float tickPeriodSeconds);
@@ -276,6 +346,8 @@ private:
 
 	std::unique_ptr<Game> _game;
 
+	GoldenRun _golden;
+
 	bool _isDrawingEngineStats;
 	bool _needRedrawEngineStats;
 	bool _isDone;
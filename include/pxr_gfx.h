@@ -5,6 +5,7 @@
 #include <vector>
 #include <array>
 #include <cmath>
+#include <memory>
 
 #include "pxr_color.h"
 #include "pxr_vec.h"
@@ -61,20 +62,40 @@ struct Glyph
 	int _xoffset;
 	int _yoffset;
 	int _xadvance;
+	int _maskOffset;   // index of the first word of the glyph's mask in Font::_masks.
 };
 
+//
+// The num pixels of a row of a glyph mask packed into each mask word.
+//
+constexpr int GLYPH_MASK_WORD_BITS = 64;
+
 // 
-// An ASCII bitmap font.
+// An ASCII bitmap font. 
+//
+// Glyphs are monochrome; only the alpha of the font image is used as text is drawn in the color
+// of the draw call. Thus fonts do not keep their image but pack it at load into a 1-bit mask per 
+// glyph. Each row of a glyph mask is (width + 63) / 64 words and bit i of word j of a row is set
+// if col (j * 64) + i of the glyph row is opaque.
 //
 struct Font
 {
 	std::array<Glyph, ASCII_CHAR_COUNT> _glyphs;
-	io::Bmp _image;
+	std::vector<uint64_t> _masks;
 	int _lineHeight;
 	int _baseLine;
 	int _glyphSpace;
 };
 
+//
+// A horizontal run of opaque pixels within a row of a sprite.
+//
+struct SpriteSpan
+{
+	int _col;      // first col of the span w.r.t sprite space.
+	int _count;    // number of pixels in the span.
+};
+
 //
 // A sprite is a sub-region of a spritesheet specified w.r.t a cartesian coordinate space local 
 // to the spritesheet. The spritesheet space is the same as that of the bmp image where the
@@ -107,11 +128,22 @@ struct Font
 // Thus if the origin is in the center of the sprite then the sprite will be drawn centered on the
 // position argument.
 //
+// Sprites also carry a run-length encoding of their opaque pixels which is precomputed when the
+// spritesheet is loaded. Each row of a sprite is encoded as a list of spans of opaque pixels 
+// (pixels with alpha != ALPHA_KEY), ordered by ascending column, such that draw calls and 
+// collision tests can skip transparent runs without testing every pixel. The spans of row 'r' 
+// are the spans in the range [_spans[_rowSpans[r]], _spans[_rowSpans[r + 1]]). The mirrored
+// spans are the same spans w.r.t the sprite mirrored in the x-axis and share the row ranges.
+//
 struct Sprite
 {
 	Vector2i _position;
 	Vector2i _size;
 	Vector2i _origin;
+	std::vector<SpriteSpan> _spans;
+	std::vector<SpriteSpan> _mirroredSpans;
+	std::vector<int> _rowSpans;
+	bool _isSpanBlit;                      // false if the spans are too short to beat the keyed blit.
 };
 
 //
@@ -119,13 +151,60 @@ struct Sprite
 //
 using SpriteID_t = int;
 
+//
+// The width and height (in tiles) of the chunks tile maps are cached and drawn in.
+//
+constexpr int TILE_CHUNK_SIZE = 16;
+
+//
+// The sprite id of tile map cells holding no tile.
+//
+constexpr SpriteID_t EMPTY_TILE = -1;
+
+//
+// The number of colors in the palette of an indexed screen.
+//
+constexpr int PALETTE_SIZE = 256;
+
+//
+// The palette of an indexed screen; the color of index i is entry i. Entry 0 is always the 
+// transparent key {0, 0, 0, 0}.
+//
+using Palette_t = std::array<Color4u, PALETTE_SIZE>;
+
 //
 // A spritesheet organises a bitmap image into sprites.
 //
+// Spritesheets drawn to indexed screens also hold their image quantized to palette indices, 
+// accessed [col + (row * image width)]; transparent pixels are index 0. The indices are empty
+// until the sheet is quantized (see quantizeSpritesheet).
+//
 struct Spritesheet
 {
 	io::Bmp _image;
 	std::vector<Sprite> _sprites;
+	std::vector<uint8_t> _indices;
+};
+
+//
+// The color mode sets the format of the pixels of a screen.
+//
+// The modes apply as follows:
+//
+//      FULL_RGB - the default. Pixels are stored as full rgba colors.
+//
+//      INDEXED  - pixels are stored as 8-bit indices into a palette of PALETTE_SIZE colors owned
+//                 by the screen. Index 0 is transparent. Draw calls write a quarter of the bytes
+//                 and present expands the dirty regions through the palette, thus changes to 
+//                 the palette (e.g. palette cycling) recolor the whole screen without redrawing
+//                 it. Colors passed to draw calls are mapped to the nearest palette color and 
+//                 spritesheets are quantized to the palette the first time they are drawn to an
+//                 indexed screen. Pixel shaders are not supported; PixelMode is ignored.
+//
+enum class ColorMode
+{
+	FULL_RGB,
+	INDEXED
 };
 
 //
@@ -147,8 +226,8 @@ enum class PixelMode
 
 //
 // The size mode controls the size of the pixels of a screen. Minimum pixel size is 1, the
-// maximum size is determined by the opengl implementation used (max is printed to the log
-// upon gfx initialization for convenience).
+// maximum size is determined by the opengl implementation's max viewport size (max is printed 
+// to the log upon gfx initialization for convenience).
 //
 // The modes apply as follows:
 //
@@ -197,6 +276,34 @@ enum class PositionMode
 	BOTTOM_RIGHT
 };
 
+//
+// The draw mode controls when draw calls are rasterized into the screens.
+//
+// The modes apply as follows:
+//
+//      IMMEDIATE - the default. Draw calls rasterize into the screen before returning.
+//
+//      DEFERRED  - draw calls (including screen clears) are recorded into a command buffer which
+//                  is executed by the next call to present (or flushDrawCommands). Prior to 
+//                  execution the commands are grouped by screen, commands overwritten by a later
+//                  clear or fill rectangle are dropped and runs of sprites are grouped by 
+//                  spritesheet where doing so cannot change the result. The result is pixel
+//                  identical to immediate mode.
+//
+//                  With more than one raster thread (see setRasterThreadCount) each screen is
+//                  split into tiles of RASTER_TILE_SIZE pixels square, the commands are binned
+//                  by the tiles their bounds touch and the tiles are rasterized in parallel; 
+//                  each tile executes its commands in recorded order, clipped to the tile.
+//
+// note: in deferred mode unloading a spritesheet, destroying a tile map or setting a tile of a 
+// map drawn by recorded commands flushes the recorded commands first, as they may draw it.
+//
+enum class DrawMode
+{
+	IMMEDIATE,
+	DEFERRED
+};
+
 //
 // The signiture of pixel shader functions to be set by the user if using PixelMode::SHADER.
 //
@@ -214,8 +321,102 @@ enum class PositionMode
 // The shader returns a color value it has calculated. The returned color value will replace
 // the input color for the pixel being drawn to the screen at position [pxx, pxy].
 //
+// note: in DrawMode::DEFERRED with more than one raster thread, shaders are called concurrently
+// from multiple threads and in no particular pixel order thus must not modify shared state.
+//
 using PXShader_t = Color4u (*)(Color4u inColor, int pxx, int pxy);
 
+//
+// Shaders are applied to rows of pixels in place; after a draw call writes a run of count pixels
+// in a row, the row shader of the screen is called once for the run with the (unshaded) colors
+// of the run, the first of which is at position [pxx, pxy] w.r.t the virtual screen. The row
+// shader must replace each color with its shaded color.
+//
+// 'shader' is the shader callable (function pointer, functor or lambda) which the row shader was 
+// instantiated for; see shadeRow (pixel shaders) and shadeSpan (span shaders). Runs are as long
+// as the primitive allows; whole clipped rows for fills and horizontal lines, opaque spans for
+// sprites and glyphs and single pixels for vertical lines and points.
+//
+using PXRowShader_t = void (*)(const void* shader, Color4u* pxColors, int count, int pxx, int pxy);
+
+//
+// The row shader of a shader callable with the signature Color4u(Color4u inColor, int pxx, 
+// int pxy) (as PXShader_t). The callable is called directly thus can be inlined into the loop.
+// It is copied to a local for the loop as otherwise it may alias the pixels, so should be cheap
+// to copy.
+//
+template<typename Shader>
+void shadeRow(const void* shader, Color4u* pxColors, int count, int pxx, int pxy)
+{
+	const Shader s = *static_cast<const Shader*>(shader);
+	for(int i = 0; i < count; ++i)
+		pxColors[i] = s(pxColors[i], pxx + i, pxy);
+}
+
+//
+// The signiture of span shader functions. Span shaders are called once per run of pixels rather
+// than once per pixel, thus avoid a call per pixel and can shade runs with SIMD. The arguments are
+// as for the row shader; the count colors [pxColors, pxColors + count) are to be shaded in place,
+// the first of which is at [pxx, pxy]. See pxr_shaders.h for built-in span shaders.
+//
+using PXSpanShader_t = void (*)(Color4u* pxColors, int count, int pxx, int pxy);
+
+//
+// The row shader of a span shader callable; a span shader function or a functor or lambda with
+// the signature of PXSpanShader_t.
+//
+template<typename SpanShader>
+void shadeSpan(const void* shader, Color4u* pxColors, int count, int pxx, int pxy)
+{
+	(*static_cast<const SpanShader*>(shader))(pxColors, count, pxx, pxy);
+}
+
+//
+// The number of opengl pixel buffers each screen cycles through to upload its pixels. With 
+// two or more buffers the upload of one frame can still be in flight while the next frame
+// is drawn.
+//
+constexpr int SCREEN_PIXEL_BUFFER_COUNT = 2;
+
+//
+// The width and height (in pixels) of the screen tiles rasterized in parallel.
+//
+constexpr int RASTER_TILE_SIZE = 64;
+
+//
+// The width and height (in pixels) of the screen tiles lazy clears are tracked in.
+//
+constexpr int SCREEN_CLEAR_TILE_SIZE = 32;
+
+//
+// The max number of rects used to track the dirty region of a screen. Beyond this count, new 
+// dirty rects are merged into existing rects.
+//
+constexpr int SCREEN_MAX_DIRTY_RECTS = 8;
+
+//
+// The region of a screen modified by draw calls since the screen was last uploaded.
+// Rects are w.r.t the screen's coordinate space and never overlap one another. Screens with an 
+// empty dirty region are not uploaded when presenting.
+//
+struct DirtyRegion
+{
+	std::array<iRect, SCREEN_MAX_DIRTY_RECTS> _rects;
+	int _rectCount;
+	bool _isFullScreen;
+};
+
+//
+// The lazy clear state of a tile of a screen; see setScreenLazyClear. A tile is stale if its
+// generation is not that of the screen, i.e. the screen was cleared since the tile was last 
+// brought up to date.
+//
+struct ClearTile
+{
+	uint32_t _generation;          // the clear generation of the screen the tile is up to date with.
+	bool     _isTouched;           // drawn to since the tile was last cleared.
+};
+
 //
 // A virtual screen of virtual pixels used to create a layer of abstraction from the display
 // allowing extra properties to be added to the screen such as a fixed resolution independent
@@ -242,21 +443,65 @@ using PXShader_t = Color4u (*)(Color4u inColor, int pxx, int pxy);
 // transparent pixels in a screen will allow the corresponding pixel of any screens lower in the 
 // stacking order to show through.
 //
+// Screens have a scroll offset, like the scroll registers of old tile hardware; the screen is
+// presented as a view of its pixels starting at the offset and wrapping around at the edges, 
+// i.e. the pixel presented at [x, y] is pixel [(x + scroll x) mod width, (y + scroll y) mod
+// height]. Draw calls write pixels w.r.t the screen (unscrolled) coordinate space; the view space
+// only applies when presenting (and composing and capturing). Scrolling thus never redraws; only
+// the strips exposed by a scroll must be redrawn (see scrollScreen).
+//
+// Offscreen screens (surfaces) are never presented; they are drawn to as any other screen and
+// read back by region blits or by registering them as spritesheets (see createSurface).
+//
 struct Screen
 {
-	PXShader_t   _pxShader;
+	PXRowShader_t _rowShader;      // applies _shader to rows of pixels; nullptr if no shader set.
+	std::shared_ptr<const void> _shader; // the shader callable.
 	PositionMode _pmode;
 	SizeMode     _smode;
 	PixelMode    _xmode;
+	ColorMode    _cmode;
 	Vector2i     _position;        // position w.r.t window space.
 	Vector2i     _manualPosition;  // position w.r.t window space when in manual position mode.
 	Vector2i     _resolution;      // size/dimensions of the virtual screen.
+	Vector2i     _scroll;          // offset of the presented view; in [0, _resolution).
+	iRect        _clip;            // draw calls write only pixels within; see setScreenClip.
+	bool         _isClipped;       // false if _clip is the whole screen.
 	int          _pxSize;          // size of virtual pixels (unit: real pixels).
 	int          _pxManualSize;    // size of virtual pixels when in manual size mode.
 	int          _pxCount;         // total number of virtual pixels on the screen.
-	Color4u*     _pxColors;        // accessed [col + (row * width)]
-	Vector2i*    _pxPositions;     // accessed [col + (row * width)]
+	Color4u*     _pxColors;        // accessed [col + (row * width)]; the expanded indices if INDEXED.
+	uint8_t*     _pxIndices;       // accessed as _pxColors; nullptr unless INDEXED.
+	Palette_t    _palette;         // INDEXED only.
+	unsigned int _texture;         // opengl texture the pixels are uploaded to (opengl backend).
+	unsigned int _pixelBuffers[SCREEN_PIXEL_BUFFER_COUNT]; // opengl pixel unpack buffers.
+	int          _nextPixelBuffer; // index of the pixel buffer to use for the next upload.
+	DirtyRegion  _dirty;           // pixels drawn since the last upload.
 	bool         _isEnabled;       // enable/disable drawing this screen to the window.
+	bool         _isOffscreen;     // a surface; never enabled and has no backend resources.
+	bool         _isLocked;        // the pixels are accessed direct; see lockScreen.
+	bool         _isLazyClear;     // clears are deferred per tile; see setScreenLazyClear.
+	Color4u      _clearColor;      // the color of the last lazy clear.
+	uint8_t      _clearIndex;      // the palette index of _clearColor; INDEXED only.
+	uint32_t     _clearGeneration; // num lazy clears.
+	Vector2i     _clearTileCount;  // num cols and rows of _clearTiles.
+	std::vector<ClearTile> _clearTiles; // accessed [col + (row * cols)]; empty unless _isLazyClear.
+};
+
+//
+// Performance statistics of the last call to present. Intended for display in the engine's
+// stats screen.
+//
+struct PresentStats
+{
+	double _uploadMilliseconds;    // cpu time spent handing screen pixels to the backend.
+	int    _dirtyPixels;           // total virtual pixels within the dirty regions uploaded.
+	int    _dirtyRects;            // total rects within the dirty regions of all screens.
+	int    _skippedScreens;        // enabled screens not uploaded as nothing was drawn to them.
+	int    _executedCommands;      // deferred draw commands executed since the last present.
+	int    _culledCommands;        // deferred draw commands culled since the last present.
+	int    _composedScreens;       // enabled screens merged by the compositor.
+	int    _composedPixels;        // total virtual pixels recomposed by the compositor.
 };
 
 //
@@ -264,10 +509,47 @@ struct Screen
 //
 using ScreenID_t = int;
 
+//
+// The backends screens can be presented with.
+//
+//    OPENGL   - screens are uploaded to opengl textures and drawn to an SDL window.
+//
+//    HEADLESS - no window is created and no opengl calls are made; screens are drawn only to 
+//               memory, and only when frames are captured. Intended for benchmarks and 
+//               regression tests run without a display, e.g. with SDL_VIDEODRIVER=dummy.
+//
+// Both backends draw the same screens in the same order; draw calls and screen pixels are 
+// identical under each.
+//
+enum class BackendType
+{
+	OPENGL,
+	HEADLESS
+};
+
+struct BackendConfig
+{
+	BackendType _type {BackendType::OPENGL};
+
+	//
+	// HEADLESS only: if not empty every _captureInterval'th presented frame (starting from the 
+	// first) is written to the bmp file <_capturePath><frame number>.bmp; e.g. a path of 
+	// "capture/frame_" writes capture/frame_000000.bmp, ... Frames are the size of the window.
+	//
+	std::string _capturePath {};
+	int _captureInterval {1};
+};
+
 //
 // Initializes the gfx subsystem. Returns true if success and false if fatal error.
 //
-bool initialize(std::string windowTitle, Vector2i windowSize, bool fullscreen);
+bool initialize(std::string windowTitle, Vector2i windowSize, bool fullscreen, 
+                const BackendConfig& backend = BackendConfig{});
+
+//
+// Returns the type of the backend the module was initialized with.
+//
+BackendType getBackendType();
 
 //
 // Call to shutdown the module upon app termination.
@@ -288,6 +570,48 @@ void shutdown();
 //
 ScreenID_t createScreen(Vector2i resolution);
 
+//
+// Creates a new virtual screen in ColorMode::INDEXED with the palette 'palette' (entry 0 is 
+// replaced with the transparent key). Otherwise as createScreen.
+//
+ScreenID_t createIndexedScreen(Vector2i resolution, const Palette_t& palette);
+
+//
+// Replace the palette, or a single color of the palette, of an indexed screen. Takes effect for 
+// the whole screen at the next present; the screen is not redrawn. Entry 0 cannot be changed.
+//
+// note: colors passed to draw calls are mapped to palette indices when the call is made, thus 
+// draw with the palette the colors are meant for.
+//
+void setScreenPalette(const Palette_t& palette, ScreenID_t screenid);
+void setScreenPaletteColor(int index, Color4u color, ScreenID_t screenid);
+
+//
+// Rotates the colors [first, first + count) of the palette of an indexed screen by 'shift'
+// places; the color at index i moves to index first + ((i - first + shift) mod count). For 
+// palette cycling effects (water, flashing, etc). The range is clamped to [1, PALETTE_SIZE).
+//
+void rotateScreenPalette(int first, int count, int shift, ScreenID_t screenid);
+
+//
+// Creates an offscreen screen, a surface, in ColorMode::FULL_RGB. Surfaces accept all draw 
+// calls as any screen (shaders, clip rects, deferred commands, etc) but are never presented and
+// so have no backend resources and no size limit beyond memory. Intended for composites built 
+// once and drawn many times; blit them with blitScreenRegion or register them as a spritesheet 
+// with registerSurfaceSpritesheet. Surfaces share the screen ids of screens.
+//
+ScreenID_t createSurface(Vector2i resolution);
+
+bool isSurface(ScreenID_t screenid);
+
+const Palette_t& getScreenPalette(ScreenID_t screenid);
+
+//
+// Returns the index of the palette color nearest to 'color' (by squared distance in rgb). Colors
+// with alpha == ALPHA_KEY map to index 0; other colors never map to index 0.
+//
+int findPaletteIndex(const Palette_t& palette, Color4u color);
+
 //
 // Must be called whenever the window resizes to update the screens.
 //
@@ -318,6 +642,27 @@ ResourceKey_t loadSpritesheet(ResourceName_t name);
 //
 void unloadSpritesheet(ResourceKey_t sheetKey);
 
+//
+// Registers a spritesheet made at runtime rather than loaded from file; the image is moved in
+// and the sprites are validated against it as those of loaded spritesheets. Returns the key of 
+// the spritesheet (or of the error spritesheet if any sprite is invalid), which is unloaded with 
+// unloadSpritesheet as loaded spritesheets.
+//
+// Registering a name already in use replaces the image and sprites of that spritesheet in place;
+// the key and the reference count are unchanged. Thus a composite can be rebuilt and registered 
+// again without its users having to fetch a new key. Pending deferred draw commands are flushed
+// before the replacement.
+//
+ResourceKey_t registerSpritesheet(ResourceName_t name, io::Bmp image, std::vector<Sprite> sprites);
+
+//
+// Registers the pixels of a screen (typically a surface) as a spritesheet of a single sprite
+// spanning the whole screen with its origin at 'origin'; see registerSpritesheet. The pixels are
+// copied as by captureScreen, thus later draws to the screen do not change the sprite until it
+// is registered again.
+//
+ResourceKey_t registerSurfaceSpritesheet(ResourceName_t name, ScreenID_t screenid, Vector2i origin = Vector2i{0, 0});
+
 //
 // Loads a font from RESOURCE_PATH_FONTS directory in the file system.
 //
@@ -347,6 +692,47 @@ void unloadFont(ResourceKey_t fontKey);
 //
 const Font* getFont(ResourceKey_t fontKey);
 
+//
+// Quantizes the image of a spritesheet to the palette such that it can be drawn to indexed
+// screens. A spritesheet holds a single set of indices, thus indexed screens sharing spritesheets
+// should order their palettes alike (e.g. a palette and its cycled variants). Spritesheets not
+// yet quantized when first drawn to an indexed screen are quantized to that screen's palette; 
+// call this at load time to avoid the cost mid-game. Pending deferred draw commands are flushed
+// first, as they may draw the sheet.
+//
+void quantizeSpritesheet(ResourceKey_t sheetKey, const Palette_t& palette);
+
+//
+// Creates a tile map; a grid of 'mapSize' cells (cols x rows) of 'tileSize' pixels, each holding
+// the id of a sprite of the spritesheet (a tile) or EMPTY_TILE. All cells start empty. Cell 
+// [0, 0] is the bottom-left cell. Returns the key of the map for use with the tile map calls.
+//
+// Tile maps are drawn from a cache; the map is split into chunks of TILE_CHUNK_SIZE cells 
+// square, each of which is pre-rasterized into a block of pixels the first time it is drawn and
+// then only rebuilt after one of its cells changes. A map thus draws as a handful of block blits
+// regardless of its tile count. Tiles are drawn with their bottom-left pixel at the bottom-left 
+// of their cell (sprite origins are ignored) and are clipped to their cell.
+//
+// The spritesheet must remain loaded while the map is in use.
+//
+ResourceKey_t createTileMap(ResourceKey_t sheetKey, Vector2i tileSize, Vector2i mapSize);
+
+void destroyTileMap(ResourceKey_t mapKey);
+
+//
+// Sets the tile of a cell; only the chunk containing the cell is rebuilt (when next drawn).
+// Cells outside the map are ignored.
+//
+void setTile(Vector2i cell, SpriteID_t spriteid, ResourceKey_t mapKey);
+
+//
+// Returns the tile of a cell, or EMPTY_TILE if the cell is outside the map.
+//
+SpriteID_t getTile(Vector2i cell, ResourceKey_t mapKey);
+
+Vector2i getTileMapSize(ResourceKey_t mapKey);
+Vector2i getTileMapTileSize(ResourceKey_t mapKey);
+
 //
 // Provides access to the sprite count of a spritesheet.
 //
@@ -372,13 +758,22 @@ void clearScreenTransparent(ScreenID_t screenid);
 void clearScreenShade(int shade, ScreenID_t screenid);
 
 //
-// Clears a screen with a solid color. 
-//
-// note: this is a slow operation to be used only if you really need a specific color. For 
-// simple clearing ops use 'fillScreenShade'. 
+// Clears a screen with a solid color. Any color clears as fast as a shade; rows are filled
+// with wide stores.
 //
 void clearScreenColor(Color4u color, ScreenID_t screenid);
 
+//
+// Enables (disables) lazy clears of a screen. Clears of a lazy screen (unless clipped) only 
+// record the clear color; the pixels of each SCREEN_CLEAR_TILE_SIZE square tile are cleared 
+// when the tile is first drawn to, or when the screen is presented or read (blitted from or
+// captured), and tiles not drawn to since they were last cleared to the same color are not
+// cleared again. Thus a large mostly empty screen cleared every frame costs only the tiles
+// drawn to. Pending draws to a screen are dropped when it is lazily cleared as the clear 
+// overwrites them.
+//
+void setScreenLazyClear(bool isLazy, ScreenID_t screenid);
+
 //
 // Draw a sprite of a spritesheet.
 //
@@ -392,7 +787,9 @@ void drawSprite(Vector2i position, ResourceKey_t sheetKey, SpriteID_t spriteid,
 void drawSpriteColumn(Vector2i position, ResourceKey_t sheetKey, SpriteID_t spriteid, int colid, ScreenID_t screenid);
 
 // 
-// Draw a text string.
+// Draw a text string. Strings are drawn from a bounded cache of runs pre-rasterized per font and
+// string (in any color), thus strings drawn every frame (scores, timers, menus) are only 
+// rasterized when first drawn.
 //
 void drawText(Vector2i position, const std::string& text, ResourceKey_t fontKey, Color4u color, ScreenID_t screenid);
 
@@ -408,17 +805,170 @@ void drawBorderRectangle(iRect rect, Color4u color, ScreenID_t screenid);
 void drawFillRectangle(iRect rect, Color4u color, ScreenID_t screenid);
 
 //
-// Draw a line.
+// The axis a gradient varies along.
+//
+enum class GradientDirection
+{
+	HORIZONTAL,
+	VERTICAL
+};
+
+//
+// Draw a rectangle filled with a linear gradient from 'from' at its left (bottom) column (row)
+// to 'to' at its right (top) column (row); all channels, alpha included, are interpolated. 
+// Unlike drawFillRectangle the rectangle is clipped, not clamped, to the screen. On indexed 
+// screens each color of the gradient is drawn as its nearest palette color.
+//
+void drawGradientRectangle(iRect rect, Color4u from, Color4u to, GradientDirection direction, 
+                           ScreenID_t screenid);
+
+//
+// Draw a rectangle filled with an ordered (4x4 Bayer) dither of two colors; 'density' in
+// [0, 16] is the num of each 16 pixels drawn in color1, the rest being drawn in color0. The 
+// dither pattern is anchored to the screen so adjacent dithered rectangles join seamlessly. The
+// rectangle is clipped, not clamped, to the screen.
+//
+void drawDitherRectangle(iRect rect, Color4u color0, Color4u color1, int density, ScreenID_t screenid);
+
+//
+// Draw a line from p0 to p1, both inclusive. Lines are clipped, not clamped, to the screen; a
+// line partly off screen draws exactly those of its pixels which are on screen.
 //
 void drawLine(Vector2i p0, Vector2i p1, Color4u color, ScreenID_t screenid);
 
+//
+// Draw a batch of lines as a single draw call; the lines joining points[0] to points[1], 
+// points[2] to points[3] and so on (a trailing odd point is ignored). Cheaper than a drawLine per
+// line as the screen lookup, bounds and shader dispatch are paid once per batch. The points are
+// copied, the array need not outlive the call.
+//
+void drawLines(const Vector2i* points, int count, Color4u color, ScreenID_t screenid);
+
+//
+// Draw the lines joining each point to the next as a single draw call (see drawLines); if 
+// closed also the line joining the last point to the first.
+//
+void drawPolyline(const Vector2i* points, int count, Color4u color, ScreenID_t screenid, bool isClosed = false);
+
+//
+// Shapes drawn by the shape draw calls. A shape covers the pixels whose centers lie within it;
+// a circle of radius r (an ellipse of radii rx, ry) spans 2r + 1 (2rx + 1, 2ry + 1) pixels, thus
+// a radius of 0 draws a single pixel. Shapes with a negative radius are not drawn and radii 
+// are clamped to MAX_SHAPE_RADIUS.
+//
+constexpr int MAX_SHAPE_RADIUS = 1 << 14;
+
+struct Circle
+{
+	Vector2i _center;
+	int _radius;
+};
+
+struct Ellipse
+{
+	Vector2i _center;
+	Vector2i _radii;               // the x-axis and y-axis radii.
+};
+
+//
+// Draw filled (outlined) circles and ellipses. Shapes are drawn as the runs of pixels they
+// cover on each row, filled as rectangles are and clipped per run; the outline of a shape is
+// the pixels of its fill with a pixel beside, above or below them outside the fill.
+//
+void drawFillCircle(Vector2i center, int radius, Color4u color, ScreenID_t screenid);
+void drawBorderCircle(Vector2i center, int radius, Color4u color, ScreenID_t screenid);
+void drawFillEllipse(Vector2i center, Vector2i radii, Color4u color, ScreenID_t screenid);
+void drawBorderEllipse(Vector2i center, Vector2i radii, Color4u color, ScreenID_t screenid);
+
+//
+// Draw a batch of shapes as a single draw call; cheaper than a draw call per shape as the
+// screen lookup and shader dispatch are paid once per batch. The shapes are copied, the arrays
+// need not outlive the call.
+//
+void drawFillCircles(const Circle* circles, int count, Color4u color, ScreenID_t screenid);
+void drawBorderCircles(const Circle* circles, int count, Color4u color, ScreenID_t screenid);
+void drawFillEllipses(const Ellipse* ellipses, int count, Color4u color, ScreenID_t screenid);
+void drawBorderEllipses(const Ellipse* ellipses, int count, Color4u color, ScreenID_t screenid);
+
+//
+// Draw a convex polygon filled; the run of each row spans from the leftmost to the rightmost
+// crossing of the row by the polygon's edges (vertices inclusive), thus a concave polygon is 
+// drawn with its concavities along rows filled. The outline is drawn as the closed polyline 
+// of the vertices.
+//
+void drawFillPolygon(const Vector2i* vertices, int count, Color4u color, ScreenID_t screenid);
+void drawBorderPolygon(const Vector2i* vertices, int count, Color4u color, ScreenID_t screenid);
+
+//
+// Draw a batch of filled convex polygons as a single draw call; polygon i has the next 
+// counts[i] vertices of the array of vertices.
+//
+void drawFillPolygons(const Vector2i* vertices, const int* counts, int polygonCount, Color4u color, 
+                      ScreenID_t screenid);
+
 //
 // Draws a single pixel to a screen.
 //
 void drawPoint(Vector2i position, Color4u color, ScreenID_t screenid);
 
 //
-// Issues opengl calls to render results of (software) draw calls and then swaps the buffers.
+// Draw a batch of points as a single draw call, either all in one color or each in the color
+// at the same index of colors. The batch is clipped to the screen (with SIMD compares) as it is
+// drawn and only the points on screen are kept, thus drawing large batches (e.g. particles) 
+// costs a single screen lookup and dispatch rather than one per point. Float points are 
+// truncated as drawPoint truncates them. The arrays are copied, they need not outlive the call.
+//
+void drawPoints(const Vector2i* points, int count, Color4u color, ScreenID_t screenid);
+void drawPoints(const Vector2f* points, int count, Color4u color, ScreenID_t screenid);
+void drawPoints(const Vector2i* points, const Color4u* colors, int count, ScreenID_t screenid);
+void drawPoints(const Vector2f* points, const Color4u* colors, int count, ScreenID_t screenid);
+
+//
+// Draws a tile map with the bottom-left of cell [0, 0] at position; scroll a map by moving its
+// position. Only the chunks of the map which lie (at least partially) on screen are drawn.
+//
+void drawTileMap(Vector2i position, ResourceKey_t mapKey, ScreenID_t screenid);
+
+//
+// Blits the pixels of the rect 'region' of screen 'srcid' (w.r.t its screen space, clipped to 
+// it) to screen 'screenid' with the bottom-left of the region at position. Transparent pixels
+// are skipped as when drawing sprites. Both screens must have the same color mode and, if they
+// are the same screen, the region must not overlap its destination; such blits are skipped.
+//
+// The source is read as it is once all draw calls made to it before the blit have executed; in
+// DrawMode::DEFERRED draw calls to a screen pending as the source of a blit flush the blit first.
+//
+void blitScreenRegion(iRect region, ScreenID_t srcid, Vector2i position, ScreenID_t screenid);
+
+//
+// Sets the draw mode for all future draw calls. Switching to DrawMode::IMMEDIATE flushes any 
+// recorded draw commands.
+//
+void setDrawMode(DrawMode mode);
+
+DrawMode getDrawMode();
+
+//
+// Executes all draw commands recorded in DrawMode::DEFERRED. Only required if the screen pixels
+// are needed prior to the next present, which flushes automatically.
+//
+void flushDrawCommands();
+
+//
+// Sets the number of threads (including the calling thread) which execute deferred draw 
+// commands. A count of 1 (the default) executes all commands on the calling thread; counts are
+// clamped to [1, WorkerPool::MAX_THREADS]. Immediate mode draw calls are unaffected.
+//
+void setRasterThreadCount(int count);
+
+int getRasterThreadCount();
+
+//
+// Hands the results of (software) draw calls to the backend to render and then swaps the 
+// buffers.
+//
+// With the opengl backend each enabled screen is uploaded to its texture and drawn as a single
+// quad scaled by the screen's pixel size.
 //
 void present();
 
@@ -454,7 +1004,79 @@ void setScreenManualPixelSize(int pxSize, ScreenID_t screenid);
 void setPixelShader(PXShader_t shader, ScreenID_t screenid);
 
 //
-// Enables a screen so it will be rendered to the window.
+// Sets a shader callable and the row shader which applies it; the callable is shared with any
+// recorded draw commands which use it.
+//
+void setPixelShader(PXRowShader_t rowShader, std::shared_ptr<const void> shader, ScreenID_t screenid);
+
+//
+// Sets a functor or lambda with the signature Color4u(Color4u inColor, int pxx, int pxy) as the
+// pixel shader of a screen. The callable is copied. Unlike a PXShader_t, which is called through
+// a pointer for every pixel, the callable is inlined into the loop shading each row.
+//
+template<typename Shader>
+void setPixelShader(Shader shader, ScreenID_t screenid)
+{
+	setPixelShader(&shadeRow<Shader>, std::make_shared<const Shader>(std::move(shader)), screenid);
+}
+
+//
+// Sets a span shader function to use for a particular screen. As for pixel shaders, the shader 
+// is only used if the screen is in PixelMode::SHADER; it replaces any pixel shader.
+//
+void setSpanShader(PXSpanShader_t shader, ScreenID_t screenid);
+
+//
+// Sets a span shader functor or lambda (e.g. one of the built-in shaders) for a screen. The 
+// callable is copied.
+//
+template<typename SpanShader>
+void setSpanShader(SpanShader shader, ScreenID_t screenid)
+{
+	setPixelShader(&shadeSpan<SpanShader>, std::make_shared<const SpanShader>(std::move(shader)), screenid);
+}
+
+//
+// The rects of a screen exposed by a scroll; the pixels which scrolled into view and must be
+// redrawn. Each rect is w.r.t the screen space and is contiguous in the view (never wraps), and
+// its offset is the position of the rect w.r.t the screen minus its position w.r.t the view. 
+// Thus drawing content w.r.t the view at position + offset (with the rect set as the screen's 
+// clip) draws exactly the exposed pixels.
+//
+struct ScrollExposure
+{
+	static constexpr int MAX_RECTS {8};
+
+	std::array<iRect, MAX_RECTS> _rects;
+	std::array<Vector2i, MAX_RECTS> _offsets;
+	int _rectCount;
+};
+
+//
+// Sets the scroll offset of a screen; it is wrapped into [0, resolution). Has no effect on the 
+// pixels of the screen, thus no draw calls are needed, but the whole screen is presented anew.
+//
+void setScreenScroll(Vector2i scroll, ScreenID_t screenid);
+
+Vector2i getScreenScroll(ScreenID_t screenid);
+
+//
+// Adds 'delta' to the scroll offset of a screen and returns the rects exposed by the scroll; a
+// strip as wide as delta x along the edge of the view scrolled into and a strip as tall as 
+// delta y. If a delta exceeds the screen's size the whole screen is exposed. The returned rects 
+// persist only until the next call.
+//
+const ScrollExposure& scrollScreen(Vector2i delta, ScreenID_t screenid);
+
+//
+// Restricts all future draw calls on a screen to the pixels within 'clip' (clipped to the 
+// screen), e.g. to the rects exposed by a scroll. Clears are clipped as any other call.
+//
+void setScreenClip(iRect clip, ScreenID_t screenid);
+void resetScreenClip(ScreenID_t screenid);
+
+//
+// Enables a screen so it will be rendered to the window. Surfaces cannot be enabled.
 //
 void enableScreen(ScreenID_t screenid);
 
@@ -463,9 +1085,26 @@ void enableScreen(ScreenID_t screenid);
 //
 void disableScreen(ScreenID_t screenid);
 
+//
+// The compositor merges stacked screens into a single screen on the cpu so that each group of
+// merged screens is uploaded and drawn as one texture rather than one per screen.
+//
+// Groups are runs of consecutive (in stacking order) enabled screens with equal resolutions,
+// positions and pixel sizes. The merged pixel is that of the topmost screen in which the pixel
+// is not transparent, as when drawing the screens individually. Only the union of the dirty 
+// regions of the screens in a group is recomposed, and lower screens are not read for rows in
+// which the screens above are already opaque.
+//
+// The compositor is disabled by default.
+//
+void enableCompositor();
+void disableCompositor();
+bool isCompositorEnabled();
+
 //
 // Utility function for calculating the dimensions of the smallest possible bounding box of 
-// a text string for a given font. Dimensions are in units of virtual pixels.
+// a text string for a given font. Dimensions are in units of virtual pixels. Uses (and fills) 
+// the cache of drawText.
 //
 Vector2i calculateTextSize(const std::string& text, ResourceKey_t fontKey);
 
@@ -490,6 +1129,51 @@ Vector2i getSpriteSize(ResourceKey_t sheetKey, SpriteID_t spriteid);
 //
 const Spritesheet& getSpritesheet(ResourceKey_t sheetKey);
 
+//
+// Provides read only access to the performance statistics of the last call to present.
+//
+const PresentStats& getPresentStats();
+
+//
+// Returns the number of screens created; screen ids are [0, count).
+//
+int getScreenCount();
+
+//
+// Copies the pixels of a screen, as presented (i.e. the scrolled view), into 'bmp', which is 
+// recreated with the screen's resolution. Pending deferred draw commands are flushed first.
+// Intended for tests which compare screens against stored images; see Engine golden runs.
+//
+void captureScreen(ScreenID_t screenid, io::Bmp& bmp);
+
+//
+// A view of the pixels of a locked screen; see lockScreen. Rows are bottom up, as the screen
+// coordinate space, and _stride pixels apart, thus pixel [x, y] is [x + (y * _stride)]. An 
+// INDEXED screen is viewed as its palette indices (which present expands), else as its colors.
+//
+struct ScreenPixels
+{
+	Color4u*  _colors;             // nullptr if INDEXED.
+	uint8_t*  _indices;            // nullptr unless INDEXED.
+	Vector2i  _size;               // the screen's resolution.
+	int       _stride;             // unit: pixels.
+};
+
+//
+// Locks a screen for direct access to its pixels, e.g. to run fire, plasma or terrain effects
+// over the whole buffer rather than draw them pixel by pixel. Pending deferred draw commands 
+// (to all screens) are flushed and any lazy clear of the screen resolved first, thus the view
+// holds the pixels as drawn. The view is valid until the screen is unlocked.
+//
+// Writes to the pixels are not presented until the screen is unlocked with the region written
+// to; unlocking without a region marks the whole screen. Clips, shaders and the alpha color key
+// do not apply to the writes. No draw calls may be made to a locked screen, and it must be 
+// unlocked before present.
+//
+ScreenPixels lockScreen(ScreenID_t screenid);
+void unlockScreen(iRect touched, ScreenID_t screenid);
+void unlockScreen(ScreenID_t screenid);
+
 } // namespace gfx
 } // namespace pxr
 
@@ -2,6 +2,7 @@
 #define _PIXIRETRO_INPUT_H_
 
 #include <vector>
+#include <string>
 
 union SDL_Event;
 
@@ -39,6 +40,22 @@ void onKeyEvent(const SDL_Event& event);
 //
 void onUpdate();
 
+//
+// Key events can be recorded to and replayed from replay files. Events are stored with the 
+// number of the update tick they precede, thus a replay reproduces the input of every tick 
+// exactly regardless of frame timing, provided the ticks themselves are replayed in the same 
+// order (e.g. by a golden run of the engine). Replay files are text with one event per line:
+//
+//     <tick> <key string> <down|up>
+//
+// e.g. "120 KEY_LEFT down". Recorded events are written to the file when recording stops. While
+// replaying, key events from SDL are ignored.
+//
+bool startRecording(const std::string& filepath);
+void stopRecording();
+bool startReplay(const std::string& filepath);
+bool isReplaying();
+
 //
 // Accessors for key state for each key. For use by applications to get user input.
 //
@@ -25,6 +25,13 @@ LOGSTR msg_eng_fail_sdl_init = "failed to initialize SDL";
 LOGSTR msg_eng_locking_fps = "locking fps to";
 LOGSTR msg_eng_fail_load_splash = "failed to splash sprite : skipping splash screen";
 LOGSTR msg_eng_fail_init_game = "failed to initialize the game";
+LOGSTR msg_eng_golden_run = "starting golden run : ticks";
+LOGSTR msg_eng_golden_recorded = "recorded golden image";
+LOGSTR msg_eng_golden_missing = "missing golden image";
+LOGSTR msg_eng_golden_size_mismatch = "screen size differs from golden image";
+LOGSTR msg_eng_golden_mismatch = "screen differs from golden image";
+LOGSTR msg_eng_golden_passed = "golden run passed : checked images";
+LOGSTR msg_eng_golden_failed = "golden run failed : mismatched images";
 
 //
 // gfx log strings.
@@ -41,10 +48,13 @@ LOGSTR msg_gfx_fail_set_opengl_attribute = "failed to set opengl attribute";
 LOGSTR msg_gfx_opengl_version = "using opengl version";
 LOGSTR msg_gfx_opengl_renderer = "using opengl renderer";
 LOGSTR msg_gfx_opengl_vendor = "using opengl vendor";
+LOGSTR msg_gfx_no_pixel_buffers = "opengl pixel buffers unavailable : uploading screens from client memory";
 LOGSTR msg_gfx_loading_spritesheets = "starting spritesheet loading";
 LOGSTR msg_gfx_loading_spritesheet = "loading spritesheet";
 LOGSTR msg_gfx_spritesheet_already_loaded = "spritesheet already loaded";
 LOGSTR msg_gfx_loading_spritesheet_success = "successfully loaded spritesheet";
+LOGSTR msg_gfx_registered_spritesheet = "registered runtime spritesheet";
+LOGSTR msg_gfx_replaced_spritesheet = "replaced runtime spritesheet";
 LOGSTR msg_gfx_loading_font = "loading font";
 LOGSTR msg_gfx_loading_font_success = "successfully loaded font";
 LOGSTR msg_gfx_fail_load_asset_bmp = "failed to load the bitmap image of asset";
@@ -52,15 +62,32 @@ LOGSTR msg_gfx_using_error_spritesheet = "substituting unloaded spritesheet with
 LOGSTR msg_gfx_using_error_font = "substituting unloaded font with error font";
 LOGSTR msg_gfx_loading_fonts = "starting font loading";
 LOGSTR msg_gfx_pixel_size_range = "range of valid pixel sizes";
+LOGSTR msg_gfx_backend = "using render backend";
+LOGSTR msg_gfx_blit_kernel = "using blit kernels";
+LOGSTR msg_gfx_raster_threads = "using raster threads";
+LOGSTR msg_gfx_capturing_frames = "capturing frames to";
 LOGSTR msg_gfx_created_vscreen = "created vscreen";
+LOGSTR msg_gfx_created_tilemap = "created tile map";
+LOGSTR msg_gfx_overlapping_blit = "skipping blit of a screen region overlapping its destination";
 LOGSTR msg_gfx_missing_ascii_glyphs = "loaded font does not contain glyphs for all 95 printable ascii chars";
 LOGSTR msg_gfx_font_fail_checksum = "loaded font failed the checksum test; may be duplicate ascii chars";
 LOGSTR msg_gfx_spritesheet_invalid_xml_bmp_mismatch = "invalid spritesheet : xml data implies a different bitmap size";
+LOGSTR msg_gfx_spritesheet_invalid_sprites = "invalid spritesheet : sprites extend the image bounds";
 LOGSTR msg_gfx_font_invalid_xml_bmp_mismatch = "invalid font : char xml meta extends font bmp bounds";
 LOGSTR msg_gfx_unloading_nonexistent_resource = "trying to unload nonexistent resource";
 LOGSTR msg_gfx_unload_spritesheet_success = "successfully unloaded spritesheet";
 LOGSTR msg_gfx_unload_font_success = "successfully unloaded font";
 
+//
+// input log strings.
+//
+
+LOGSTR msg_inp_recording = "recording input to replay file";
+LOGSTR msg_inp_fail_write_replay = "failed to write replay file";
+LOGSTR msg_inp_replaying = "replaying input from replay file";
+LOGSTR msg_inp_fail_open_replay = "failed to open replay file";
+LOGSTR msg_inp_invalid_replay_event = "skipping invalid replay file line";
+
 //
 // sfx log strings.
 //
@@ -116,6 +143,7 @@ LOGSTR msg_bmp_corrupted = "expected a bitmap image file; file corrupted or wron
 LOGSTR msg_bmp_unsupported_colorspace = "loaded bitmap image using unsupported non-sRGB color space";
 LOGSTR msg_bmp_unsupported_compression = "loaded bitmap image using unsupported compression mode";
 LOGSTR msg_bmp_unsupported_size = "loaded bitmap image has unsupported size";
+LOGSTR msg_bmp_fail_write = "failed to write bitmap image file";
 
 //
 // wav file log strings.
@@ -2,6 +2,7 @@
 #define _PIXIRETRO_PARTICLE_ENGINE_H_
 
 #include <array>
+#include <vector>
 #include "pxr_vec.h"
 #include "pxr_rand.h"
 #include "pxr_color.h"
@@ -131,6 +132,11 @@ private:
 	//
 	Particle* _particles;
 	int _numParticles;
+
+	//
+	// The positions of the live particles gathered to draw them as a single batch.
+	//
+	std::vector<Vector2f> _drawPositions;
 };
 
 } // namespace pxr 
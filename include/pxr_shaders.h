@@ -0,0 +1,102 @@
+#ifndef _PIXIRETRO_GFX_SHADERS_H_
+#define _PIXIRETRO_GFX_SHADERS_H_
+
+#include <vector>
+#include <array>
+#include "pxr_color.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+//
+// Built-in span shaders; see PXSpanShader_t and setSpanShader in pxr_gfx.h. Use as e.g.
+//
+//    gfx::setSpanShader(gfx::ScanlineShader{160}, screenid);
+//    gfx::setScreenPixelMode(gfx::PixelMode::SHADER, screenid);
+//
+// Where shaders scale channels they use 8-bit factors in which 255 leaves a channel unchanged
+// and 0 zeroes it. Scaled channels are computed as (channel * (factor + 1)) >> 8 which the SSE2
+// kernels compute 4 pixels at a time. Shaders leave alpha unchanged unless stated otherwise.
+//
+
+//
+// Scales each channel (including alpha) by the corresponding channel of a factor color.
+//
+class MultiplyShader
+{
+public:
+	explicit MultiplyShader(Color4u factors) : _factors{factors} {}
+
+	void operator()(Color4u* pxColors, int count, int pxx, int pxy) const;
+
+private:
+	Color4u _factors;
+};
+
+//
+// Darkens every 'period'th row of the screen, starting from row 'phase', by scaling the color
+// channels by 'shade'. Approximates the scanlines of a CRT.
+//
+class ScanlineShader
+{
+public:
+	explicit ScanlineShader(uint8_t shade, int period = 2, int phase = 0);
+
+	void operator()(Color4u* pxColors, int count, int pxx, int pxy) const;
+
+private:
+	Color4u _factors;
+	int _period;
+	int _phase;
+};
+
+//
+// Scales the color channels by factors which vary linearly along the x-axis from 'left' at
+// pxx == 0 to 'right' at pxx == width - 1. The factors of each col are tabulated on construction
+// thus the width should be that of the screen the shader is used with; cols beyond the width use
+// the factors of the nearest col.
+//
+class GradientShader
+{
+public:
+	GradientShader(Color4u left, Color4u right, int width);
+
+	void operator()(Color4u* pxColors, int count, int pxx, int pxy) const;
+
+private:
+	std::vector<Color4u> _factors;
+};
+
+//
+// Replaces each color with the nearest color (by squared distance in rgb) of a palette, keeping
+// the alpha of the input. Colors are looked up in a table of 32x32x32 entries (the top 5 bits
+// of each channel) built on construction, thus the table is 128KiB and building it is not cheap;
+// create palette shaders up front not per frame.
+//
+class PaletteShader
+{
+public:
+	explicit PaletteShader(const std::vector<Color4u>& palette);
+
+	void operator()(Color4u* pxColors, int count, int pxx, int pxy) const;
+
+private:
+	static constexpr int CHANNEL_BITS {5};
+	static constexpr int LUT_SIZE {1 << (CHANNEL_BITS * 3)};
+
+	std::vector<Color4u> _lut;
+};
+
+//
+// Scales 'count' colors by the factors of a single color or of an array of colors with one per
+// pixel. Used to implement the built-in shaders; exposed for use in user span shaders.
+//
+void multiplyRow(Color4u* pxColors, int count, Color4u factors);
+void multiplyRow(Color4u* pxColors, int count, const Color4u* factors);
+
+} // namespace gfx
+} // namespace pxr
+
+#endif
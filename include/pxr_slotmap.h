@@ -0,0 +1,157 @@
+#ifndef _PIXIRETRO_SLOTMAP_H_
+#define _PIXIRETRO_SLOTMAP_H_
+
+#include <vector>
+#include <cinttypes>
+#include <cassert>
+#include <utility>
+
+namespace pxr
+{
+
+//
+// A slot map stores values in a dense array of slots and hands out keys (handles) which index
+// directly into the array; a lookup is thus an index and a compare rather than a tree or hash
+// search. Slots freed by erasing values are recycled via a free list.
+//
+// Each slot has a generation which is incremented every time its value is erased. Keys encode
+// both the slot index and the generation of the slot at insertion, thus keys to erased values
+// (stale keys) are detected cheaply; looking up a stale key returns nullptr even if the slot has
+// since been reused.
+//
+// Keys are non-negative 32-bit integers so they can be used wherever resource keys are expected;
+// the low INDEX_BITS bits hold the slot index and the remaining bits (except the sign bit) hold
+// the generation. A key of NULL_KEY (-1) never refers to a value.
+//
+// note: inserting may reallocate the slot array thus pointers to values are invalidated by 
+// insertion; hold keys not pointers.
+//
+template<typename T>
+class SlotMap
+{
+public:
+	using Key_t = int32_t;
+
+	static constexpr Key_t NULL_KEY {-1};
+	static constexpr int INDEX_BITS {16};
+	static constexpr int MAX_SLOTS {1 << INDEX_BITS};
+
+public:
+	SlotMap() : _slots{}, _freeHead{NULL_SLOT}, _size{0} {}
+
+	//
+	// Moves a value into a free slot and returns its key. Asserts if all MAX_SLOTS are in use.
+	//
+	Key_t insert(T&& value)
+	{
+		int index {0};
+		if(_freeHead != NULL_SLOT){
+			index = _freeHead;
+			_freeHead = _slots[index]._nextFree;
+		}
+		else{
+			assert(static_cast<int>(_slots.size()) < MAX_SLOTS);
+			index = static_cast<int>(_slots.size());
+			_slots.emplace_back();
+		}
+		Slot& slot = _slots[index];
+		slot._value = std::move(value);
+		slot._isOccupied = true;
+		slot._nextFree = NULL_SLOT;
+		++_size;
+		return makeKey(index, slot._generation);
+	}
+
+	//
+	// Destroys the value referred to by key (by assigning it a default constructed value) and frees
+	// its slot. Returns false if the key is stale or invalid.
+	//
+	bool erase(Key_t key)
+	{
+		Slot* slot = findSlot(key);
+		if(slot == nullptr)
+			return false;
+		slot->_value = T{};
+		slot->_isOccupied = false;
+		slot->_generation = (slot->_generation + 1) & GENERATION_MASK;
+		slot->_nextFree = _freeHead;
+		_freeHead = getIndex(key);
+		--_size;
+		return true;
+	}
+
+	//
+	// Returns the value referred to by key or nullptr if the key is stale or invalid.
+	//
+	T* find(Key_t key)
+	{
+		Slot* slot = findSlot(key);
+		return slot == nullptr ? nullptr : &slot->_value;
+	}
+
+	const T* find(Key_t key) const
+	{
+		return const_cast<SlotMap*>(this)->find(key);
+	}
+
+	bool contains(Key_t key) const {return find(key) != nullptr;}
+
+	//
+	// Calls f(key, value) for every value in the map in slot order.
+	//
+	template<typename F>
+	void forEach(F f)
+	{
+		for(int index = 0; index < static_cast<int>(_slots.size()); ++index)
+			if(_slots[index]._isOccupied)
+				f(makeKey(index, _slots[index]._generation), _slots[index]._value);
+	}
+
+	void clear()
+	{
+		_slots.clear();
+		_freeHead = NULL_SLOT;
+		_size = 0;
+	}
+
+	int size() const {return _size;}
+
+private:
+	static constexpr int NULL_SLOT {-1};
+	static constexpr Key_t INDEX_MASK {MAX_SLOTS - 1};
+	static constexpr Key_t GENERATION_MASK {(1 << (31 - INDEX_BITS)) - 1};
+
+	struct Slot
+	{
+		T _value {};
+		Key_t _generation {0};
+		int _nextFree {NULL_SLOT};
+		bool _isOccupied {false};
+	};
+
+	static Key_t makeKey(int index, Key_t generation) {return (generation << INDEX_BITS) | index;}
+	static int getIndex(Key_t key) {return key & INDEX_MASK;}
+	static Key_t getGeneration(Key_t key) {return key >> INDEX_BITS;}
+
+	Slot* findSlot(Key_t key)
+	{
+		if(key < 0)
+			return nullptr;
+		int index = getIndex(key);
+		if(index >= static_cast<int>(_slots.size()))
+			return nullptr;
+		Slot& slot = _slots[index];
+		if(!slot._isOccupied || slot._generation != getGeneration(key))
+			return nullptr;
+		return &slot;
+	}
+
+private:
+	std::vector<Slot> _slots;
+	int _freeHead;
+	int _size;
+};
+
+} // namespace pxr
+
+#endif
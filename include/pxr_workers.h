@@ -0,0 +1,77 @@
+#ifndef _PIXIRETRO_WORKERS_H_
+#define _PIXIRETRO_WORKERS_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace pxr
+{
+
+//
+// A fixed pool of threads which execute batches of independent jobs.
+//
+// A batch is run by the calling thread together with the worker threads; every thread claims
+// jobs from a shared atomic counter until none remain, thus no locks are taken while jobs run.
+// The pool's mutex is only used to wake the workers at the start of a batch and to wait for
+// them at the end.
+//
+// A pool of N threads starts N - 1 workers; a pool of 1 thread runs every batch on the calling
+// thread.
+//
+class WorkerPool
+{
+public:
+	using Job_t = std::function<void(int jobid)>;
+
+	static constexpr int MAX_THREADS {64};
+
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	//
+	// Stops any running workers then starts threadCount - 1 new ones. The count is clamped to
+	// [1, MAX_THREADS].
+	//
+	void start(int threadCount);
+
+	//
+	// Joins all workers. The pool then runs batches on the calling thread until restarted.
+	//
+	void stop();
+
+	//
+	// Calls job(jobid) for every jobid in [0, jobCount) and returns once all calls have returned.
+	// Jobs may execute concurrently and in any order, thus must not depend on one another.
+	//
+	void run(int jobCount, const Job_t& job);
+
+	int getThreadCount() const {return static_cast<int>(_threads.size()) + 1;}
+
+private:
+	void workerMain(int batchid);
+	void executeJobs();
+
+private:
+	std::vector<std::thread> _threads;
+	std::mutex _mutex;
+	std::condition_variable _batchStarted;
+	std::condition_variable _batchFinished;
+	const Job_t* _job;
+	int _jobCount;
+	std::atomic<int> _nextJob;
+	int _batchid;
+	int _busyWorkers;
+	bool _isStopping;
+};
+
+} // namespace pxr
+
+#endif
@@ -0,0 +1,338 @@
+#include <SDL.h>
+#include <SDL_opengl.h>
+#include <string>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+
+#include "pxr_backend.h"
+#include "pxr_log.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+class OpenGLBackend final : public RenderBackend
+{
+public:
+	static constexpr int MIN_OPENGL_VERSION_MAJOR = 2;
+	static constexpr int MIN_OPENGL_VERSION_MINOR = 1;
+	static constexpr int DEF_OPENGL_VERSION_MAJOR = 3;
+	static constexpr int DEF_OPENGL_VERSION_MINOR = 0;
+
+public:
+	OpenGLBackend();
+
+	bool initialize(const std::string& windowTitle, Vector2i windowSize, bool fullscreen) override;
+	void shutdown() override;
+
+	const char* getName() const override {return "opengl";}
+
+	Vector2i getWindowSize() const override {return _windowSize;}
+	int getMaxPixelSize() const override {return _maxPixelSize;}
+	int getMaxScreenSize() const override {return _maxTextureSize;}
+
+	void setViewport(iRect viewport) override;
+
+	void createScreenResources(Screen& screen) override;
+	void freeScreenResources(Screen& screen) override;
+	void uploadScreen(Screen& screen) override;
+
+	void clearWindow(Color4f color) override;
+	void drawScreen(const Screen& screen) override;
+	void endFrame() override;
+
+private:
+	bool loadPixelBufferFunctions();
+
+private:
+	SDL_Window* _window;
+	SDL_GLContext _glContext;
+	Vector2i _windowSize;
+	int _maxPixelSize;
+	int _maxTextureSize;
+
+	//
+	// The buffer object functions are GL 1.5 thus not exported by every GL library (e.g.
+	// opengl32 on windows); they are loaded at runtime. If any is missing screens are uploaded
+	// from client memory.
+	//
+	bool _hasPixelBuffers;
+	PFNGLGENBUFFERSPROC _glGenBuffers;
+	PFNGLDELETEBUFFERSPROC _glDeleteBuffers;
+	PFNGLBINDBUFFERPROC _glBindBuffer;
+	PFNGLBUFFERDATAPROC _glBufferData;
+	PFNGLMAPBUFFERPROC _glMapBuffer;
+	PFNGLUNMAPBUFFERPROC _glUnmapBuffer;
+};
+
+OpenGLBackend::OpenGLBackend() :
+	_window{nullptr},
+	_glContext{nullptr},
+	_windowSize{0, 0},
+	_maxPixelSize{1},
+	_maxTextureSize{0},
+	_hasPixelBuffers{false},
+	_glGenBuffers{nullptr},
+	_glDeleteBuffers{nullptr},
+	_glBindBuffer{nullptr},
+	_glBufferData{nullptr},
+	_glMapBuffer{nullptr},
+	_glUnmapBuffer{nullptr}
+{}
+
+bool OpenGLBackend::initialize(const std::string& windowTitle, Vector2i windowSize, bool fullscreen)
+{
+	uint32_t flags = SDL_WINDOW_OPENGL;
+	if(fullscreen){
+		flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
+		log::log(log::LVL_INFO, log::msg_gfx_fullscreen);
+	}
+
+	std::stringstream ss {};
+	ss << "{w:" << windowSize._x << ",h:" << windowSize._y << "}";
+	log::log(log::LVL_INFO, log::msg_gfx_creating_window, std::string{ss.str()});
+
+	_window = SDL_CreateWindow(
+			windowTitle.c_str(),
+			SDL_WINDOWPOS_UNDEFINED,
+			SDL_WINDOWPOS_UNDEFINED,
+			windowSize._x,
+			windowSize._y,
+			flags
+	);
+
+	if(_window == nullptr){
+		log::log(log::LVL_FATAL, log::msg_gfx_fail_create_window, std::string{SDL_GetError()});
+		return false;
+	}
+
+	SDL_GL_GetDrawableSize(_window, &_windowSize._x, &_windowSize._y);
+	std::stringstream().swap(ss);
+	ss << "{w:" << _windowSize._x << ",h:" << _windowSize._y << "}";
+	log::log(log::LVL_INFO, log::msg_gfx_created_window, std::string{ss.str()});
+
+	_glContext = SDL_GL_CreateContext(_window);
+	if(_glContext == nullptr){
+		log::log(log::LVL_FATAL, log::msg_gfx_fail_create_opengl_context, std::string{SDL_GetError()});
+		return false;
+	}
+
+	if(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, DEF_OPENGL_VERSION_MAJOR) < 0){
+		log::log(log::LVL_FATAL, log::msg_gfx_fail_set_opengl_attribute, std::string{SDL_GetError()});
+		return false;
+	}
+
+	if(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, DEF_OPENGL_VERSION_MINOR) < 0){
+		log::log(log::LVL_FATAL, log::msg_gfx_fail_set_opengl_attribute, std::string{SDL_GetError()});
+		return false;
+	}
+
+	std::string glVersion {reinterpret_cast<const char*>(glGetString(GL_VERSION))};
+	log::log(log::LVL_INFO, log::msg_gfx_opengl_version, glVersion);
+
+	// TODO: extract version from string and check it meets min requirement.
+
+	const char* glRenderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+	log::log(log::LVL_INFO, log::msg_gfx_opengl_renderer, glRenderer);
+
+	const char* glVendor {reinterpret_cast<const char*>(glGetString(GL_VENDOR))};
+	log::log(log::LVL_INFO, log::msg_gfx_opengl_vendor, glVendor);
+
+	//
+	// Screens are drawn as textured quads thus a pixel can be as large as the viewport allows.
+	//
+	GLint params[2];
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, params);
+	_maxPixelSize = std::min(params[0], params[1]);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &_maxTextureSize);
+
+	glEnable(GL_TEXTURE_2D);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glEnable(GL_ALPHA_TEST);
+	glAlphaFunc(GL_GREATER, 0.f);
+
+	_hasPixelBuffers = loadPixelBufferFunctions();
+	if(!_hasPixelBuffers)
+		log::log(log::LVL_WARN, log::msg_gfx_no_pixel_buffers);
+
+	return true;
+}
+
+//
+// Must be called with the context current; returns false if any of the functions is missing.
+//
+bool OpenGLBackend::loadPixelBufferFunctions()
+{
+	_glGenBuffers = reinterpret_cast<PFNGLGENBUFFERSPROC>(SDL_GL_GetProcAddress("glGenBuffers"));
+	_glDeleteBuffers = reinterpret_cast<PFNGLDELETEBUFFERSPROC>(SDL_GL_GetProcAddress("glDeleteBuffers"));
+	_glBindBuffer = reinterpret_cast<PFNGLBINDBUFFERPROC>(SDL_GL_GetProcAddress("glBindBuffer"));
+	_glBufferData = reinterpret_cast<PFNGLBUFFERDATAPROC>(SDL_GL_GetProcAddress("glBufferData"));
+	_glMapBuffer = reinterpret_cast<PFNGLMAPBUFFERPROC>(SDL_GL_GetProcAddress("glMapBuffer"));
+	_glUnmapBuffer = reinterpret_cast<PFNGLUNMAPBUFFERPROC>(SDL_GL_GetProcAddress("glUnmapBuffer"));
+	return _glGenBuffers != nullptr && _glDeleteBuffers != nullptr && _glBindBuffer != nullptr &&
+	       _glBufferData != nullptr && _glMapBuffer != nullptr && _glUnmapBuffer != nullptr;
+}
+
+void OpenGLBackend::shutdown()
+{
+	SDL_GL_DeleteContext(_glContext);
+	SDL_DestroyWindow(_window);
+	_glContext = nullptr;
+	_window = nullptr;
+}
+
+void OpenGLBackend::setViewport(iRect viewport)
+{
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0, viewport._w, 0.0, viewport._h, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glViewport(viewport._x, viewport._y, viewport._w, viewport._h);
+}
+
+//
+// Creates the texture the screen's pixels are uploaded to when presenting. Nearest filtering
+// keeps virtual pixels sharp when the screen quad is scaled up by the pixel size. The texture
+// repeats so scrolled screens are drawn by offsetting the texture coordinates.
+//
+void OpenGLBackend::createScreenResources(Screen& screen)
+{
+	glGenTextures(1, &screen._texture);
+	glBindTexture(GL_TEXTURE_2D, screen._texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, screen._resolution._x, screen._resolution._y, 0,
+	             GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	screen._nextPixelBuffer = 0;
+	if(!_hasPixelBuffers){
+		std::fill_n(screen._pixelBuffers, SCREEN_PIXEL_BUFFER_COUNT, 0u);
+		return;
+	}
+	_glGenBuffers(SCREEN_PIXEL_BUFFER_COUNT, screen._pixelBuffers);
+	for(int i = 0; i < SCREEN_PIXEL_BUFFER_COUNT; ++i){
+		_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, screen._pixelBuffers[i]);
+		_glBufferData(GL_PIXEL_UNPACK_BUFFER, screen._pxCount * sizeof(Color4u), nullptr, GL_STREAM_DRAW);
+	}
+	_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void OpenGLBackend::freeScreenResources(Screen& screen)
+{
+	glDeleteTextures(1, &screen._texture);
+	if(_hasPixelBuffers)
+		_glDeleteBuffers(SCREEN_PIXEL_BUFFER_COUNT, screen._pixelBuffers);
+	screen._texture = 0;
+}
+
+//
+// Uploads the dirty regions of the screen's pixels to its texture via the next pixel buffer
+// in its ping-pong sequence.
+//
+// The buffer is orphaned before it is mapped so the driver can hand back fresh storage rather
+// than wait for any transfer still reading the buffer's old storage. The texture update then
+// sources from the buffer (an offset rather than a client pointer) so glTexSubImage2D returns
+// immediately and the transfer to the texture overlaps the drawing of the next frame.
+//
+// The pixels are copied into the mapped buffer rather than drawn into it directly because
+// orphaning discards the buffer contents; screens must retain their pixels between frames
+// (e.g. static background layers).
+//
+// The buffer has the same layout as the screen's pixels but only the rows of the dirty rects
+// are copied into it; the rest of the buffer is garbage never read by the texture updates.
+//
+// Without pixel buffers the upload is the synchronous upload from client memory.
+//
+void OpenGLBackend::uploadScreen(Screen& screen)
+{
+	const DirtyRegion& dirty = screen._dirty;
+
+	GLsizeiptr size = screen._pxCount * sizeof(Color4u);
+
+	Color4u* pxBuffer {nullptr};
+	if(_hasPixelBuffers){
+		_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, screen._pixelBuffers[screen._nextPixelBuffer]);
+		_glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		pxBuffer = static_cast<Color4u*>(_glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+	}
+	if(pxBuffer != nullptr){
+		for(int i = 0; i < dirty._rectCount; ++i){
+			const iRect& rect = dirty._rects[i];
+			for(int row = rect._y; row < rect._y + rect._h; ++row){
+				int offset = rect._x + (row * screen._resolution._x);
+				memcpy(pxBuffer + offset, screen._pxColors + offset, rect._w * sizeof(Color4u));
+			}
+		}
+		_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else if(_hasPixelBuffers){
+		//
+		// Failing to map the buffer is not fatal; fallback to a synchronous upload from client
+		// memory.
+		//
+		_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	const Color4u* source = (pxBuffer != nullptr) ? nullptr : screen._pxColors;
+
+	glBindTexture(GL_TEXTURE_2D, screen._texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, screen._resolution._x);
+	for(int i = 0; i < dirty._rectCount; ++i){
+		const iRect& rect = dirty._rects[i];
+		glTexSubImage2D(GL_TEXTURE_2D, 0, rect._x, rect._y, rect._w, rect._h, GL_RGBA, GL_UNSIGNED_BYTE,
+		                source + rect._x + (rect._y * screen._resolution._x));
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	if(pxBuffer != nullptr)
+		_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	screen._nextPixelBuffer = (screen._nextPixelBuffer + 1) % SCREEN_PIXEL_BUFFER_COUNT;
+}
+
+void OpenGLBackend::clearWindow(Color4f color)
+{
+	glClearColor(color._r, color._g, color._b, color._a);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void OpenGLBackend::drawScreen(const Screen& screen)
+{
+	glBindTexture(GL_TEXTURE_2D, screen._texture);
+
+	int x0 = screen._position._x;
+	int y0 = screen._position._y;
+	int x1 = x0 + (screen._resolution._x * screen._pxSize);
+	int y1 = y0 + (screen._resolution._y * screen._pxSize);
+
+	float s0 = static_cast<float>(screen._scroll._x) / screen._resolution._x;
+	float t0 = static_cast<float>(screen._scroll._y) / screen._resolution._y;
+	float s1 = s0 + 1.f;
+	float t1 = t0 + 1.f;
+
+	glBegin(GL_QUADS);
+		glTexCoord2f(s0, t0); glVertex2i(x0, y0);
+		glTexCoord2f(s1, t0); glVertex2i(x1, y0);
+		glTexCoord2f(s1, t1); glVertex2i(x1, y1);
+		glTexCoord2f(s0, t1); glVertex2i(x0, y1);
+	glEnd();
+}
+
+void OpenGLBackend::endFrame()
+{
+	SDL_GL_SwapWindow(_window);
+}
+
+std::unique_ptr<RenderBackend> createOpenGLBackend()
+{
+	return std::make_unique<OpenGLBackend>();
+}
+
+} // namespace gfx
+} // namespace pxr
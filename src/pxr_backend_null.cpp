@@ -0,0 +1,164 @@
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "pxr_backend.h"
+#include "pxr_bmp.h"
+#include "pxr_log.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+//
+// Draws screens to a frame in memory as the opengl backend draws them to the window: each
+// screen pixel covers a pxSize square of frame pixels and overwrites them unless its alpha is 0.
+// Frames are only drawn when they are to be captured, thus without a capture path the backend
+// does no work at all.
+//
+class HeadlessBackend final : public RenderBackend
+{
+public:
+	//
+	// Screens are only limited by memory, these merely keep sizes sane.
+	//
+	static constexpr int MAX_PIXEL_SIZE {1 << 12};
+	static constexpr int MAX_SCREEN_SIZE {1 << 14};
+
+public:
+	explicit HeadlessBackend(const BackendConfig& config);
+
+	bool initialize(const std::string& windowTitle, Vector2i windowSize, bool fullscreen) override;
+	void shutdown() override;
+
+	const char* getName() const override {return "headless";}
+
+	Vector2i getWindowSize() const override {return _windowSize;}
+	int getMaxPixelSize() const override {return MAX_PIXEL_SIZE;}
+	int getMaxScreenSize() const override {return MAX_SCREEN_SIZE;}
+
+	void setViewport(iRect viewport) override;
+
+	void createScreenResources(Screen& screen) override;
+	void freeScreenResources(Screen&) override {}
+	void uploadScreen(Screen&) override {}
+
+	void clearWindow(Color4f color) override;
+	void drawScreen(const Screen& screen) override;
+	void endFrame() override;
+
+private:
+	bool isCapturingFrame() const;
+
+private:
+	std::string _capturePath;
+	int _captureInterval;
+	int _frameNumber;
+	Vector2i _windowSize;
+	io::Bmp _frame;
+};
+
+HeadlessBackend::HeadlessBackend(const BackendConfig& config) :
+	_capturePath{config._capturePath},
+	_captureInterval{std::max(1, config._captureInterval)},
+	_frameNumber{0},
+	_windowSize{0, 0},
+	_frame{}
+{}
+
+bool HeadlessBackend::initialize(const std::string&, Vector2i windowSize, bool)
+{
+	_windowSize = windowSize;
+	if(!_capturePath.empty()){
+		_frame.create(_windowSize, Color4u{});
+		log::log(log::LVL_INFO, log::msg_gfx_capturing_frames, _capturePath);
+	}
+	return true;
+}
+
+void HeadlessBackend::shutdown()
+{
+	_frame = io::Bmp{};
+}
+
+void HeadlessBackend::setViewport(iRect viewport)
+{
+	Vector2i size {viewport._w, viewport._h};
+	if(size == _windowSize)
+		return;
+	_windowSize = size;
+	if(!_capturePath.empty())
+		_frame.create(_windowSize, Color4u{});
+}
+
+void HeadlessBackend::createScreenResources(Screen& screen)
+{
+	screen._texture = 0;
+	screen._nextPixelBuffer = 0;
+}
+
+bool HeadlessBackend::isCapturingFrame() const
+{
+	return !_capturePath.empty() && (_frameNumber % _captureInterval) == 0;
+}
+
+void HeadlessBackend::clearWindow(Color4f color)
+{
+	if(!isCapturingFrame())
+		return;
+
+	auto toByte = [](float channel){
+		return static_cast<uint8_t>(std::clamp(channel, 0.f, 1.f) * 255.f + 0.5f);
+	};
+	_frame.clear(Color4u{toByte(color._r), toByte(color._g), toByte(color._b), toByte(color._a)});
+}
+
+void HeadlessBackend::drawScreen(const Screen& screen)
+{
+	if(!isCapturingFrame())
+		return;
+
+	int pxSize = std::max(1, screen._pxSize);
+	int x0 = screen._position._x;
+	int y0 = screen._position._y;
+	int xmin = std::max(0, x0);
+	int ymin = std::max(0, y0);
+	int xmax = std::min(_windowSize._x, x0 + (screen._resolution._x * pxSize));
+	int ymax = std::min(_windowSize._y, y0 + (screen._resolution._y * pxSize));
+
+	//
+	// The view wraps around the screen's pixels from its scroll offset.
+	//
+	int scrollX = screen._scroll._x;
+	int scrollY = screen._scroll._y;
+	for(int y = ymin; y < ymax; ++y){
+		int pxRowIndex = (((y - y0) / pxSize) + scrollY) % screen._resolution._y;
+		const Color4u* pxRow = screen._pxColors + (pxRowIndex * screen._resolution._x);
+		Color4u* frameRow = _frame.getRow(y);
+		for(int x = xmin; x < xmax; ++x){
+			const Color4u& px = pxRow[(((x - x0) / pxSize) + scrollX) % screen._resolution._x];
+			if(px._a != ALPHA_KEY)
+				frameRow[x] = px;
+		}
+	}
+}
+
+void HeadlessBackend::endFrame()
+{
+	if(isCapturingFrame()){
+		std::stringstream ss {};
+		ss << _capturePath << std::setw(6) << std::setfill('0') << _frameNumber << io::Bmp::FILE_EXTENSION;
+		_frame.write(ss.str());
+	}
+	++_frameNumber;
+}
+
+std::unique_ptr<RenderBackend> createHeadlessBackend(const BackendConfig& config)
+{
+	return std::make_unique<HeadlessBackend>(config);
+}
+
+} // namespace gfx
+} // namespace pxr
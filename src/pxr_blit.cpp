@@ -0,0 +1,786 @@
+#include <SDL_cpuinfo.h>
+#include <cinttypes>
+#include <cstring>
+#include <algorithm>
+
+//
+// The SIMD kernels are compiled for their instruction sets per function, as the rest of the
+// engine is built for the baseline of the target; gcc and clang need the target attribute to
+// emit the instructions, msvc emits intrinsics for any instruction set. On other compilers or
+// targets only the scalar kernels are built.
+//
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PXR_BLIT_X86
+#define PXR_BLIT_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#define PXR_BLIT_X86
+#define PXR_BLIT_TARGET(isa)
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include "pxr_blit.h"
+#include "pxr_color.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MODULE DATA
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+using BlitRow_t = void (*)(Color4u* dst, const Color4u* src, int count);
+using UnderlayRow_t = bool (*)(Color4u* dst, const Color4u* src, int count);
+using TestRow_t = bool (*)(const Color4u* px, int count);
+using ExpandRow_t = void (*)(Color4u* dst, const uint8_t* src, const Color4u* palette, int count);
+using FillRowMasked_t = void (*)(Color4u* dst, const uint64_t* mask, int bit, int count, Color4u color);
+using FillRow_t = void (*)(Color4u* dst, Color4u color, int count);
+using FillRowPattern_t = void (*)(Color4u* dst, const Color4u* pattern, int phase, int count);
+using ClipPoints_t = int (*)(const Vector2i* points, int count, const iRect& clip, int* survivors);
+
+struct BlitKernels
+{
+	BlitKernel _kernel;
+	BlitRow_t _blitRowKeyed;
+	BlitRow_t _blitRowKeyedReversed;
+	BlitRow_t _copyRowReversed;
+	UnderlayRow_t _underlayRowKeyed;
+	TestRow_t _isRowKeyed;
+	ExpandRow_t _expandRowIndexed;
+	FillRowMasked_t _fillRowMasked;
+	FillRow_t _fillRow;
+	FillRowPattern_t _fillRowPattern;
+	ClipPoints_t _clipPoints;
+};
+
+//
+// The point kernels load points as pairs of 32-bit lanes.
+//
+static_assert(sizeof(Vector2i) == 2 * sizeof(int32_t));
+
+//
+// The color channels are stored r,g,b,a in memory thus when a pixel is loaded as a (little
+// endian) 32-bit integer the alpha channel is the most significant byte.
+//
+static constexpr uint32_t ALPHA_MASK {0xff000000};
+static constexpr uint32_t ALPHA_KEY_BITS {static_cast<uint32_t>(ALPHA_KEY) << 24};
+
+static constexpr int MASK_WORD_BITS {64};
+
+//
+// The masked kernels walk a mask in pieces which lie within a single word; the piece from bit
+// 'b' is at most 'count' bits long and is returned in the low bits of the word (the bits above
+// the piece are cleared).
+//
+static inline int getMaskPieceLength(int b, int count)
+{
+	return std::min(MASK_WORD_BITS - (b % MASK_WORD_BITS), count);
+}
+
+static inline uint64_t getMaskPiece(const uint64_t* mask, int b, int length)
+{
+	uint64_t bits = mask[b / MASK_WORD_BITS] >> (b % MASK_WORD_BITS);
+	return (length < MASK_WORD_BITS) ? bits & ((uint64_t{1} << length) - 1) : bits;
+}
+
+//
+// The index of the lowest set bit of a non-zero word.
+//
+static inline int countTrailingZeros(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(bits);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return static_cast<int>(index);
+#else
+	int index {0};
+	for(; (bits & 1) == 0; bits >>= 1)
+		++index;
+	return index;
+#endif
+}
+
+static inline uint32_t toBits(Color4u color)
+{
+	uint32_t bits;
+	memcpy(&bits, &color, sizeof(bits));
+	return bits;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SCALAR KERNELS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void blitRowKeyedScalar(Color4u* dst, const Color4u* src, int count)
+{
+	for(int i = 0; i < count; ++i)
+		if(src[i]._a != ALPHA_KEY)
+			dst[i] = src[i];
+}
+
+static void blitRowKeyedReversedScalar(Color4u* dst, const Color4u* src, int count)
+{
+	const Color4u* s = src + count - 1;
+	for(int i = 0; i < count; ++i, --s)
+		if(s->_a != ALPHA_KEY)
+			dst[i] = *s;
+}
+
+static void copyRowReversedScalar(Color4u* dst, const Color4u* src, int count)
+{
+	const Color4u* s = src + count - 1;
+	for(int i = 0; i < count; ++i, --s)
+		dst[i] = *s;
+}
+
+static bool underlayRowKeyedScalar(Color4u* dst, const Color4u* src, int count)
+{
+	bool isKeyed {false};
+	for(int i = 0; i < count; ++i){
+		if(dst[i]._a != ALPHA_KEY)
+			continue;
+		dst[i] = src[i];
+		isKeyed |= (src[i]._a == ALPHA_KEY);
+	}
+	return isKeyed;
+}
+
+static bool isRowKeyedScalar(const Color4u* px, int count)
+{
+	for(int i = 0; i < count; ++i)
+		if(px[i]._a == ALPHA_KEY)
+			return true;
+	return false;
+}
+
+static void expandRowIndexedScalar(Color4u* dst, const uint8_t* src, const Color4u* palette, int count)
+{
+	for(int i = 0; i < count; ++i)
+		dst[i] = palette[src[i]];
+}
+
+//
+// Writes color to the pixels of the set bits of a mask piece.
+//
+static inline void fillPieceScalar(Color4u* dst, uint64_t bits, Color4u color)
+{
+	while(bits != 0){
+		dst[countTrailingZeros(bits)] = color;
+		bits &= bits - 1;
+	}
+}
+
+static void fillRowMaskedScalar(Color4u* dst, const uint64_t* mask, int bit, int count, Color4u color)
+{
+	for(int i = 0; i < count;){
+		int length = getMaskPieceLength(bit + i, count - i);
+		fillPieceScalar(dst + i, getMaskPiece(mask, bit + i, length), color);
+		i += length;
+	}
+}
+
+static void fillRowScalar(Color4u* dst, Color4u color, int count)
+{
+	std::fill_n(dst, count, color);
+}
+
+static void fillRowPatternScalar(Color4u* dst, const Color4u* pattern, int phase, int count)
+{
+	for(int i = 0; i < count; ++i)
+		dst[i] = pattern[(phase + i) & 3];
+}
+
+//
+// Clips the points [i, count) appending the survivors to the n already found; returns the new n.
+//
+static inline int clipPointsFrom(const Vector2i* points, int i, int count, const iRect& clip, int* survivors, int n)
+{
+	for(; i < count; ++i){
+		const Vector2i& p = points[i];
+		survivors[n] = i;
+		n += (clip._x <= p._x && p._x < clip._x + clip._w && clip._y <= p._y && p._y < clip._y + clip._h);
+	}
+	return n;
+}
+
+static int clipPointsScalar(const Vector2i* points, int count, const iRect& clip, int* survivors)
+{
+	return clipPointsFrom(points, 0, count, clip, survivors, 0);
+}
+
+#ifdef PXR_BLIT_X86
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SSE2 KERNELS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// Selects the source pixel for every lane in which the source is not keyed and the destination
+// pixel otherwise. SSE2 has no cheap masked store so the destination is read and rewritten.
+//
+PXR_BLIT_TARGET("sse2")
+static inline void blendKeyedSSE2(Color4u* dst, __m128i s)
+{
+	const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m128i alphaKey = _mm_set1_epi32(static_cast<int>(ALPHA_KEY_BITS));
+
+	__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaKey);
+	int keyedBits = _mm_movemask_epi8(keyed);
+	if(keyedBits == 0xffff)
+		return;
+
+	__m128i* d = reinterpret_cast<__m128i*>(dst);
+	if(keyedBits == 0){
+		_mm_storeu_si128(d, s);
+		return;
+	}
+
+	__m128i old = _mm_loadu_si128(d);
+	_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(keyed, old), _mm_andnot_si128(keyed, s)));
+}
+
+PXR_BLIT_TARGET("sse2")
+static void blitRowKeyedSSE2(Color4u* dst, const Color4u* src, int count)
+{
+	int i {0};
+	for(; i + 4 <= count; i += 4)
+		blendKeyedSSE2(dst + i, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+	blitRowKeyedScalar(dst + i, src + i, count - i);
+}
+
+PXR_BLIT_TARGET("sse2")
+static void blitRowKeyedReversedSSE2(Color4u* dst, const Color4u* src, int count)
+{
+	int i {0};
+	for(; i + 4 <= count; i += 4){
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + count - i - 4));
+		blendKeyedSSE2(dst + i, _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 1, 2, 3)));
+	}
+	blitRowKeyedReversedScalar(dst + i, src, count - i);
+}
+
+PXR_BLIT_TARGET("sse2")
+static void copyRowReversedSSE2(Color4u* dst, const Color4u* src, int count)
+{
+	int i {0};
+	for(; i + 4 <= count; i += 4){
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + count - i - 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 1, 2, 3)));
+	}
+	copyRowReversedScalar(dst + i, src, count - i);
+}
+
+PXR_BLIT_TARGET("sse2")
+static bool underlayRowKeyedSSE2(Color4u* dst, const Color4u* src, int count)
+{
+	const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m128i alphaKey = _mm_set1_epi32(static_cast<int>(ALPHA_KEY_BITS));
+
+	__m128i stillKeyed = _mm_setzero_si128();
+	int i {0};
+	for(; i + 4 <= count; i += 4){
+		__m128i* d = reinterpret_cast<__m128i*>(dst + i);
+		__m128i dpx = _mm_loadu_si128(d);
+		__m128i dkeyed = _mm_cmpeq_epi32(_mm_and_si128(dpx, alphaMask), alphaKey);
+		if(_mm_movemask_epi8(dkeyed) == 0)
+			continue;
+		__m128i spx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i skeyed = _mm_cmpeq_epi32(_mm_and_si128(spx, alphaMask), alphaKey);
+		_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(dkeyed, spx), _mm_andnot_si128(dkeyed, dpx)));
+		stillKeyed = _mm_or_si128(stillKeyed, _mm_and_si128(dkeyed, skeyed));
+	}
+	bool isKeyed = _mm_movemask_epi8(stillKeyed) != 0;
+	return underlayRowKeyedScalar(dst + i, src + i, count - i) || isKeyed;
+}
+
+PXR_BLIT_TARGET("sse2")
+static bool isRowKeyedSSE2(const Color4u* px, int count)
+{
+	const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m128i alphaKey = _mm_set1_epi32(static_cast<int>(ALPHA_KEY_BITS));
+
+	int i {0};
+	for(; i + 4 <= count; i += 4){
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px + i));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(p, alphaMask), alphaKey)) != 0)
+			return true;
+	}
+	return isRowKeyedScalar(px + i, count - i);
+}
+
+//
+// Each nibble of a mask piece is broadcast and compared against the lane bits to make the lane 
+// mask of 4 pixels; all clear nibbles (the gaps between glyph strokes) are skipped and all set
+// nibbles are stored without reading the destination.
+//
+PXR_BLIT_TARGET("sse2")
+static void fillRowMaskedSSE2(Color4u* dst, const uint64_t* mask, int bit, int count, Color4u color)
+{
+	const __m128i fill = _mm_set1_epi32(static_cast<int>(toBits(color)));
+	const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+
+	for(int i = 0; i < count;){
+		int length = getMaskPieceLength(bit + i, count - i);
+		uint64_t bits = getMaskPiece(mask, bit + i, length);
+		int j {0};
+		for(; j + 4 <= length && (bits >> j) != 0; j += 4){
+			int nibble = static_cast<int>((bits >> j) & 0xf);
+			if(nibble == 0)
+				continue;
+			__m128i* d = reinterpret_cast<__m128i*>(dst + i + j);
+			if(nibble == 0xf){
+				_mm_storeu_si128(d, fill);
+				continue;
+			}
+			__m128i lanes = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(nibble), laneBits), laneBits);
+			__m128i old = _mm_loadu_si128(d);
+			_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(lanes, fill), _mm_andnot_si128(lanes, old)));
+		}
+		if(j < length)
+			fillPieceScalar(dst + i + j, bits >> j, color);
+		i += length;
+	}
+}
+
+//
+// Stores the lanes of 'p' repeatedly across the row, i.e. dst[i] = lane (i % 4) of 'p'; the
+// tail of the row is written from the lanes spilled to memory.
+//
+PXR_BLIT_TARGET("sse2")
+static inline void storeRowSSE2(Color4u* dst, __m128i p, int count)
+{
+	int i {0};
+	for(; i + 16 <= count; i += 16){
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), p);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), p);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), p);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 12), p);
+	}
+	for(; i + 4 <= count; i += 4)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), p);
+	if(i < count){
+		alignas(16) Color4u lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), p);
+		for(int lane = 0; i < count; ++i, ++lane)
+			dst[i] = lanes[lane];
+	}
+}
+
+PXR_BLIT_TARGET("sse2")
+static void fillRowSSE2(Color4u* dst, Color4u color, int count)
+{
+	storeRowSSE2(dst, _mm_set1_epi32(static_cast<int>(toBits(color))), count);
+}
+
+PXR_BLIT_TARGET("sse2")
+static void fillRowPatternSSE2(Color4u* dst, const Color4u* pattern, int phase, int count)
+{
+	__m128i p = _mm_setr_epi32(
+		static_cast<int>(toBits(pattern[phase & 3])), static_cast<int>(toBits(pattern[(phase + 1) & 3])),
+		static_cast<int>(toBits(pattern[(phase + 2) & 3])), static_cast<int>(toBits(pattern[(phase + 3) & 3]))
+	);
+	storeRowSSE2(dst, p, count);
+}
+
+//
+// Each point is tested as its x,y lanes against the lanes of the (exclusive) clip bounds; a 
+// point survives if both its lanes do, i.e. both bits of its pair in the lane mask are set.
+// Every index is written and the survivor count advanced by the test, thus no branches.
+//
+PXR_BLIT_TARGET("sse2")
+static int clipPointsSSE2(const Vector2i* points, int count, const iRect& clip, int* survivors)
+{
+	const __m128i lo = _mm_setr_epi32(clip._x - 1, clip._y - 1, clip._x - 1, clip._y - 1);
+	const __m128i hi = _mm_setr_epi32(clip._x + clip._w, clip._y + clip._h, clip._x + clip._w, clip._y + clip._h);
+
+	int n {0};
+	int i {0};
+	for(; i + 2 <= count; i += 2){
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + i));
+		__m128i inside = _mm_and_si128(_mm_cmpgt_epi32(p, lo), _mm_cmpgt_epi32(hi, p));
+		int lanes = _mm_movemask_ps(_mm_castsi128_ps(inside));
+		survivors[n] = i;
+		n += ((lanes & 0x3) == 0x3);
+		survivors[n] = i + 1;
+		n += ((lanes & 0xc) == 0xc);
+	}
+	return clipPointsFrom(points, i, count, clip, survivors, n);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// AVX2 KERNELS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// As blendKeyedSSE2 but 8 pixels wide. The blend is a read-modify-write rather than a masked
+// store (vpmaskmovd) as masked stores are microcoded and very slow on some CPUs.
+//
+// Note the AVX2 row kernels finish rows with the scalar kernels rather than the SSE2 kernels;
+// calling the non-VEX encoded SSE2 kernels with the upper ymm state dirty incurs an AVX-SSE
+// transition penalty which made the AVX2 kernels slower than the scalar ones.
+//
+PXR_BLIT_TARGET("avx2")
+static inline void blendKeyedAVX2(Color4u* dst, __m256i s)
+{
+	const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m256i alphaKey = _mm256_set1_epi32(static_cast<int>(ALPHA_KEY_BITS));
+	const __m256i ones = _mm256_set1_epi32(-1);
+
+	__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask), alphaKey);
+	if(_mm256_testc_si256(keyed, ones))
+		return;
+
+	__m256i* d = reinterpret_cast<__m256i*>(dst);
+	if(_mm256_testz_si256(keyed, keyed)){
+		_mm256_storeu_si256(d, s);
+		return;
+	}
+
+	_mm256_storeu_si256(d, _mm256_blendv_epi8(s, _mm256_loadu_si256(d), keyed));
+}
+
+PXR_BLIT_TARGET("avx2")
+static void blitRowKeyedAVX2(Color4u* dst, const Color4u* src, int count)
+{
+	int i {0};
+	for(; i + 8 <= count; i += 8)
+		blendKeyedAVX2(dst + i, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+	blitRowKeyedScalar(dst + i, src + i, count - i);
+}
+
+PXR_BLIT_TARGET("avx2")
+static void blitRowKeyedReversedAVX2(Color4u* dst, const Color4u* src, int count)
+{
+	const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	int i {0};
+	for(; i + 8 <= count; i += 8){
+		__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + count - i - 8));
+		blendKeyedAVX2(dst + i, _mm256_permutevar8x32_epi32(s, reverse));
+	}
+	blitRowKeyedReversedScalar(dst + i, src, count - i);
+}
+
+PXR_BLIT_TARGET("avx2")
+static void copyRowReversedAVX2(Color4u* dst, const Color4u* src, int count)
+{
+	const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	int i {0};
+	for(; i + 8 <= count; i += 8){
+		__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + count - i - 8));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permutevar8x32_epi32(s, reverse));
+	}
+	copyRowReversedScalar(dst + i, src, count - i);
+}
+
+PXR_BLIT_TARGET("avx2")
+static bool underlayRowKeyedAVX2(Color4u* dst, const Color4u* src, int count)
+{
+	const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m256i alphaKey = _mm256_set1_epi32(static_cast<int>(ALPHA_KEY_BITS));
+
+	__m256i stillKeyed = _mm256_setzero_si256();
+	int i {0};
+	for(; i + 8 <= count; i += 8){
+		__m256i* d = reinterpret_cast<__m256i*>(dst + i);
+		__m256i dpx = _mm256_loadu_si256(d);
+		__m256i dkeyed = _mm256_cmpeq_epi32(_mm256_and_si256(dpx, alphaMask), alphaKey);
+		if(_mm256_testz_si256(dkeyed, dkeyed))
+			continue;
+		__m256i spx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		__m256i skeyed = _mm256_cmpeq_epi32(_mm256_and_si256(spx, alphaMask), alphaKey);
+		_mm256_storeu_si256(d, _mm256_blendv_epi8(dpx, spx, dkeyed));
+		stillKeyed = _mm256_or_si256(stillKeyed, _mm256_and_si256(dkeyed, skeyed));
+	}
+	bool isKeyed = !_mm256_testz_si256(stillKeyed, stillKeyed);
+	return underlayRowKeyedScalar(dst + i, src + i, count - i) || isKeyed;
+}
+
+PXR_BLIT_TARGET("avx2")
+static bool isRowKeyedAVX2(const Color4u* px, int count)
+{
+	const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(ALPHA_MASK));
+	const __m256i alphaKey = _mm256_set1_epi32(static_cast<int>(ALPHA_KEY_BITS));
+
+	int i {0};
+	for(; i + 8 <= count; i += 8){
+		__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(px + i));
+		__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(p, alphaMask), alphaKey);
+		if(!_mm256_testz_si256(keyed, keyed))
+			return true;
+	}
+	return isRowKeyedScalar(px + i, count - i);
+}
+
+//
+// Gathers 8 palette entries at a time; the palette is only 1KiB so stays in L1 and the gathers
+// hit cache.
+//
+PXR_BLIT_TARGET("avx2")
+static void expandRowIndexedAVX2(Color4u* dst, const uint8_t* src, const Color4u* palette, int count)
+{
+	const int* table = reinterpret_cast<const int*>(palette);
+	int i {0};
+	for(; i + 8 <= count; i += 8){
+		__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+		__m256i colors = _mm256_i32gather_epi32(table, indices, sizeof(Color4u));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), colors);
+	}
+	expandRowIndexedScalar(dst + i, src + i, palette, count - i);
+}
+
+//
+// As fillRowMaskedSSE2 but a byte of the mask (8 pixels) at a time.
+//
+PXR_BLIT_TARGET("avx2")
+static void fillRowMaskedAVX2(Color4u* dst, const uint64_t* mask, int bit, int count, Color4u color)
+{
+	const __m256i fill = _mm256_set1_epi32(static_cast<int>(toBits(color)));
+	const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+	for(int i = 0; i < count;){
+		int length = getMaskPieceLength(bit + i, count - i);
+		uint64_t bits = getMaskPiece(mask, bit + i, length);
+		int j {0};
+		for(; j + 8 <= length && (bits >> j) != 0; j += 8){
+			int byte = static_cast<int>((bits >> j) & 0xff);
+			if(byte == 0)
+				continue;
+			__m256i* d = reinterpret_cast<__m256i*>(dst + i + j);
+			if(byte == 0xff){
+				_mm256_storeu_si256(d, fill);
+				continue;
+			}
+			__m256i lanes = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(byte), laneBits), laneBits);
+			_mm256_storeu_si256(d, _mm256_blendv_epi8(_mm256_loadu_si256(d), fill, lanes));
+		}
+		if(j < length)
+			fillPieceScalar(dst + i + j, bits >> j, color);
+		i += length;
+	}
+}
+
+//
+// As storeRowSSE2 but 8 lanes wide.
+//
+PXR_BLIT_TARGET("avx2")
+static inline void storeRowAVX2(Color4u* dst, __m256i p, int count)
+{
+	int i {0};
+	for(; i + 32 <= count; i += 32){
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), p);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), p);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 16), p);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 24), p);
+	}
+	for(; i + 8 <= count; i += 8)
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), p);
+	if(i < count){
+		alignas(32) Color4u lanes[8];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), p);
+		for(int lane = 0; i < count; ++i, ++lane)
+			dst[i] = lanes[lane];
+	}
+}
+
+PXR_BLIT_TARGET("avx2")
+static void fillRowAVX2(Color4u* dst, Color4u color, int count)
+{
+	storeRowAVX2(dst, _mm256_set1_epi32(static_cast<int>(toBits(color))), count);
+}
+
+PXR_BLIT_TARGET("avx2")
+static void fillRowPatternAVX2(Color4u* dst, const Color4u* pattern, int phase, int count)
+{
+	int p0 = static_cast<int>(toBits(pattern[phase & 3]));
+	int p1 = static_cast<int>(toBits(pattern[(phase + 1) & 3]));
+	int p2 = static_cast<int>(toBits(pattern[(phase + 2) & 3]));
+	int p3 = static_cast<int>(toBits(pattern[(phase + 3) & 3]));
+	storeRowAVX2(dst, _mm256_setr_epi32(p0, p1, p2, p3, p0, p1, p2, p3), count);
+}
+
+//
+// As clipPointsSSE2 but 4 points at a time; the pair bits of the lane mask are folded onto the
+// even bits so each point's test is a single bit.
+//
+PXR_BLIT_TARGET("avx2")
+static int clipPointsAVX2(const Vector2i* points, int count, const iRect& clip, int* survivors)
+{
+	const __m256i lo = _mm256_setr_epi32(
+		clip._x - 1, clip._y - 1, clip._x - 1, clip._y - 1, clip._x - 1, clip._y - 1, clip._x - 1, clip._y - 1
+	);
+	const __m256i hi = _mm256_setr_epi32(
+		clip._x + clip._w, clip._y + clip._h, clip._x + clip._w, clip._y + clip._h,
+		clip._x + clip._w, clip._y + clip._h, clip._x + clip._w, clip._y + clip._h
+	);
+
+	int n {0};
+	int i {0};
+	for(; i + 4 <= count; i += 4){
+		__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(points + i));
+		__m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(p, lo), _mm256_cmpgt_epi32(hi, p));
+		int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+		lanes &= lanes >> 1;
+		survivors[n] = i;
+		n += (lanes & 0x1);
+		survivors[n] = i + 1;
+		n += (lanes >> 2) & 0x1;
+		survivors[n] = i + 2;
+		n += (lanes >> 4) & 0x1;
+		survivors[n] = i + 3;
+		n += (lanes >> 6) & 0x1;
+	}
+	return clipPointsFrom(points, i, count, clip, survivors, n);
+}
+
+#endif // PXR_BLIT_X86
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MODULE FUNCTIONS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool isKernelSupported(BlitKernel kernel)
+{
+	switch(kernel)
+	{
+	case BlitKernel::SCALAR:
+		return true;
+#ifdef PXR_BLIT_X86
+	case BlitKernel::SSE2:
+		return SDL_HasSSE2();
+	case BlitKernel::AVX2:
+		return SDL_HasAVX2();
+#endif
+	default:
+		return false;
+	}
+}
+
+static BlitKernels makeKernels(BlitKernel kernel)
+{
+	switch(kernel)
+	{
+#ifdef PXR_BLIT_X86
+	case BlitKernel::AVX2:
+		return BlitKernels{
+			kernel, &blitRowKeyedAVX2, &blitRowKeyedReversedAVX2, &copyRowReversedAVX2,
+			&underlayRowKeyedAVX2, &isRowKeyedAVX2, &expandRowIndexedAVX2, &fillRowMaskedAVX2,
+			&fillRowAVX2, &fillRowPatternAVX2, &clipPointsAVX2
+		};
+	case BlitKernel::SSE2:
+		return BlitKernels{
+			kernel, &blitRowKeyedSSE2, &blitRowKeyedReversedSSE2, &copyRowReversedSSE2,
+			&underlayRowKeyedSSE2, &isRowKeyedSSE2, &expandRowIndexedScalar, &fillRowMaskedSSE2,
+			&fillRowSSE2, &fillRowPatternSSE2, &clipPointsSSE2
+		};
+#endif
+	default:
+		return BlitKernels{
+			BlitKernel::SCALAR, &blitRowKeyedScalar, &blitRowKeyedReversedScalar, &copyRowReversedScalar,
+			&underlayRowKeyedScalar, &isRowKeyedScalar, &expandRowIndexedScalar, &fillRowMaskedScalar,
+			&fillRowScalar, &fillRowPatternScalar, &clipPointsScalar
+		};
+	}
+}
+
+static BlitKernels selectBestKernels()
+{
+	if(isKernelSupported(BlitKernel::AVX2)) return makeKernels(BlitKernel::AVX2);
+	if(isKernelSupported(BlitKernel::SSE2)) return makeKernels(BlitKernel::SSE2);
+	return makeKernels(BlitKernel::SCALAR);
+}
+
+static BlitKernels kernels {selectBestKernels()};
+
+void blitRowKeyed(Color4u* dst, const Color4u* src, int count)
+{
+	kernels._blitRowKeyed(dst, src, count);
+}
+
+void blitRowKeyedReversed(Color4u* dst, const Color4u* src, int count)
+{
+	kernels._blitRowKeyedReversed(dst, src, count);
+}
+
+void copyRowReversed(Color4u* dst, const Color4u* src, int count)
+{
+	kernels._copyRowReversed(dst, src, count);
+}
+
+bool underlayRowKeyed(Color4u* dst, const Color4u* src, int count)
+{
+	return kernels._underlayRowKeyed(dst, src, count);
+}
+
+bool isRowKeyed(const Color4u* px, int count)
+{
+	return kernels._isRowKeyed(px, count);
+}
+
+void expandRowIndexed(Color4u* dst, const uint8_t* src, const Color4u* palette, int count)
+{
+	kernels._expandRowIndexed(dst, src, palette, count);
+}
+
+void fillRowMasked(Color4u* dst, const uint64_t* mask, int bit, int count, Color4u color)
+{
+	kernels._fillRowMasked(dst, mask, bit, count, color);
+}
+
+void fillRow(Color4u* dst, Color4u color, int count)
+{
+	kernels._fillRow(dst, color, count);
+}
+
+void fillRowPattern(Color4u* dst, const Color4u* pattern, int phase, int count)
+{
+	kernels._fillRowPattern(dst, pattern, phase, count);
+}
+
+int clipPoints(const Vector2i* points, int count, const iRect& clip, int* survivors)
+{
+	return kernels._clipPoints(points, count, clip, survivors);
+}
+
+BlitKernel getBlitKernel()
+{
+	return kernels._kernel;
+}
+
+bool setBlitKernel(BlitKernel kernel)
+{
+	if(!isKernelSupported(kernel))
+		return false;
+	kernels = makeKernels(kernel);
+	return true;
+}
+
+const char* getBlitKernelName(BlitKernel kernel)
+{
+	switch(kernel)
+	{
+	case BlitKernel::AVX2: return "avx2";
+	case BlitKernel::SSE2: return "sse2";
+	default: return "scalar";
+	}
+}
+
+} // namespace gfx
+} // namespace pxr
@@ -10,6 +10,9 @@
 #include <cstring>
 #include <cassert>
 #include <sstream>
+#include <new>
+#include <algorithm>
+#include <cstdlib>
 #include "pxr_color.h"
 #include "pxr_bmp.h"
 #include "pxr_log.h"
@@ -21,6 +24,7 @@ namespace io
 
 Bmp::Bmp() :
 	_pixels{nullptr},
+	_stride{0},
 	_size{0,0}
 {}
 
@@ -29,66 +33,60 @@ Bmp::~Bmp()
 	freePixels();
 }
 
-Bmp::Bmp(const Bmp& other) :
-	_pixels{nullptr},
-	_size{0, 0}
-{
-	_size = other._size;
-	_pixels = new gfx::Color4u*[_size._y];
-	for(int row = 0; row < _size._y; ++row){
-		_pixels[row] = new gfx::Color4u[_size._x];
-		memcpy(static_cast<void*>(_pixels[row]), static_cast<void*>(other._pixels[row]), _size._x * sizeof(gfx::Color4u));
-	}
-}
-
-Bmp::Bmp(Bmp&& other)
+Bmp::Bmp(Bmp&& other) noexcept :
+	_pixels{other._pixels},
+	_stride{other._stride},
+	_size{other._size}
 {
-	_pixels = other._pixels;
 	other._pixels = nullptr;
-	_size = other._size;
+	other._stride = 0;
 	other._size.zero();
 }
 
-Bmp& Bmp::operator=(const Bmp& other)
+Bmp& Bmp::operator=(Bmp&& other) noexcept
 {
-	if(_pixels != nullptr && _size == other._size){ 
-		for(int row = 0; row < _size._y; ++row){
-			memcpy(static_cast<void*>(_pixels[row]), static_cast<void*>(other._pixels[row]), _size._x * sizeof(gfx::Color4u));
-		}
+	if(this == &other)
 		return *this;
-	}
-
-	freePixels();
-	_size = other._size;
-	_pixels = new gfx::Color4u*[_size._y];
-	for(int row = 0; row < _size._y; ++row){
-		_pixels[row] = new gfx::Color4u[_size._x];
-		memcpy(static_cast<void*>(_pixels[row]), static_cast<void*>(other._pixels[row]), _size._x * sizeof(gfx::Color4u));
-	}
-	return *this;
-}
 
-Bmp& Bmp::operator=(Bmp&& other)
-{
 	freePixels();   
 	_pixels = other._pixels;
-	other._pixels = nullptr;
+	_stride = other._stride;
 	_size = other._size;
+	other._pixels = nullptr;
+	other._stride = 0;
 	other._size.zero();
 	return *this;
 }
 
-const gfx::Color4u Bmp::getPixel(int row, int col)
+const gfx::Color4u Bmp::getPixel(int row, int col) const
+{
+	assert(0 <= row && row < _size._y);
+	assert(0 <= col && col < _size._x);
+	return _pixels[(row * _stride) + col];
+}
+
+const gfx::Color4u* Bmp::getRow(int row) const
 {
 	assert(0 <= row && row < _size._y);
-	assert(0 <= col && col <= _size._x);
-	return _pixels[row][col];
+	return _pixels + (row * _stride);
 }
 
-const gfx::Color4u* Bmp::getRow(int row)
+gfx::Color4u* Bmp::getRow(int row)
 {
 	assert(0 <= row && row < _size._y);
-	return _pixels[row];
+	return _pixels + (row * _stride);
+}
+
+BmpView Bmp::getView() const
+{
+	return BmpView{_pixels, _stride, _size};
+}
+
+BmpView Bmp::getView(Vector2i position, Vector2i size) const
+{
+	assert(0 <= position._x && position._x + size._x <= _size._x);
+	assert(0 <= position._y && position._y + size._y <= _size._y);
+	return BmpView{_pixels + (position._y * _stride) + position._x, _stride, size};
 }
 
 bool Bmp::load(std::string filepath)
@@ -209,6 +207,85 @@ bool Bmp::load(std::string filepath)
 	return true;
 }
 
+//
+// Writes a V3 info header (which has an alpha mask) and 32-bit BI_BITFIELDS pixels with the
+// masks load assumes for 32-bit BI_RGB pixels, bottom row first. The rows are written without
+// their stride padding.
+//
+bool Bmp::write(std::string filepath) const
+{
+	std::ofstream file {filepath, std::ios_base::binary | std::ios_base::trunc};
+	if(!file){
+		log::log(log::LVL_ERROR, log::msg_bmp_fail_write, filepath);
+		return false;
+	}
+
+	static constexpr int pixelSize_bytes {4};
+	uint32_t imageSize_bytes = static_cast<uint32_t>(_size._x * _size._y * pixelSize_bytes);
+
+	FileHeader fileHead {};
+	fileHead._fileMagic = BMPMAGIC;
+	fileHead._pixelOffset_bytes = FILEHEADER_SIZE_BYTES + V3INFOHEADER_SIZE_BYTES;
+	fileHead._fileSize_bytes = fileHead._pixelOffset_bytes + imageSize_bytes;
+
+	InfoHeader infoHead {};
+	infoHead._headerSize_bytes = V3INFOHEADER_SIZE_BYTES;
+	infoHead._bmpWidth_px = _size._x;
+	infoHead._bmpHeight_px = _size._y;
+	infoHead._numColorPlanes = 1;
+	infoHead._bitsPerPixel = pixelSize_bytes * 8;
+	infoHead._compression = BI_BITFIELDS_;
+	infoHead._imageSize_bytes = imageSize_bytes;
+	infoHead._xResolution_pxPm = 2835;  // 72 dpi.
+	infoHead._yResolution_pxPm = 2835;
+	infoHead._redMask   = 0x00ff0000;
+	infoHead._greenMask = 0x0000ff00;
+	infoHead._blueMask  = 0x000000ff;
+	infoHead._alphaMask = 0xff000000;
+
+	file.write(reinterpret_cast<const char*>(&fileHead._fileMagic), sizeof(fileHead._fileMagic));
+	file.write(reinterpret_cast<const char*>(&fileHead._fileSize_bytes), sizeof(fileHead._fileSize_bytes));
+	file.write(reinterpret_cast<const char*>(&fileHead._reserved0), sizeof(fileHead._reserved0));
+	file.write(reinterpret_cast<const char*>(&fileHead._reserved1), sizeof(fileHead._reserved1));
+	file.write(reinterpret_cast<const char*>(&fileHead._pixelOffset_bytes), sizeof(fileHead._pixelOffset_bytes));
+
+	file.write(reinterpret_cast<const char*>(&infoHead._headerSize_bytes), sizeof(infoHead._headerSize_bytes));
+	file.write(reinterpret_cast<const char*>(&infoHead._bmpWidth_px), sizeof(infoHead._bmpWidth_px));
+	file.write(reinterpret_cast<const char*>(&infoHead._bmpHeight_px), sizeof(infoHead._bmpHeight_px));
+	file.write(reinterpret_cast<const char*>(&infoHead._numColorPlanes), sizeof(infoHead._numColorPlanes));
+	file.write(reinterpret_cast<const char*>(&infoHead._bitsPerPixel), sizeof(infoHead._bitsPerPixel));
+	file.write(reinterpret_cast<const char*>(&infoHead._compression), sizeof(infoHead._compression));
+	file.write(reinterpret_cast<const char*>(&infoHead._imageSize_bytes), sizeof(infoHead._imageSize_bytes));
+	file.write(reinterpret_cast<const char*>(&infoHead._xResolution_pxPm), sizeof(infoHead._xResolution_pxPm));
+	file.write(reinterpret_cast<const char*>(&infoHead._yResolution_pxPm), sizeof(infoHead._yResolution_pxPm));
+	file.write(reinterpret_cast<const char*>(&infoHead._numPaletteColors), sizeof(infoHead._numPaletteColors));
+	file.write(reinterpret_cast<const char*>(&infoHead._numImportantColors), sizeof(infoHead._numImportantColors));
+	file.write(reinterpret_cast<const char*>(&infoHead._redMask), sizeof(infoHead._redMask));
+	file.write(reinterpret_cast<const char*>(&infoHead._greenMask), sizeof(infoHead._greenMask));
+	file.write(reinterpret_cast<const char*>(&infoHead._blueMask), sizeof(infoHead._blueMask));
+	file.write(reinterpret_cast<const char*>(&infoHead._alphaMask), sizeof(infoHead._alphaMask));
+
+	std::vector<char> buffer(_size._x * pixelSize_bytes);
+	for(int row = 0; row < _size._y; ++row){
+		const gfx::Color4u* pixels = _pixels + (row * _stride);
+		for(int col = 0; col < _size._x; ++col){
+			// bytes in the order blue (0), green (1), red (2), alpha (3) to match the masks.
+			char* bytes = buffer.data() + (col * pixelSize_bytes);
+			bytes[0] = static_cast<char>(pixels[col]._b);
+			bytes[1] = static_cast<char>(pixels[col]._g);
+			bytes[2] = static_cast<char>(pixels[col]._r);
+			bytes[3] = static_cast<char>(pixels[col]._a);
+		}
+		file.write(buffer.data(), buffer.size());
+	}
+
+	if(!file){
+		log::log(log::LVL_ERROR, log::msg_bmp_fail_write, filepath);
+		return false;
+	}
+	return true;
+}
+
 void Bmp::create(Vector2i size, gfx::Color4u clearColor)
 {
 	_size = size;
@@ -221,27 +298,33 @@ void Bmp::clear(gfx::Color4u color)
 	if(_pixels == nullptr)
 		return;
 
-	for(int row = 0; row < _size._y; ++row)
+	for(int row = 0; row < _size._y; ++row){
+		gfx::Color4u* pixels = _pixels + (row * _stride);
 		for(int col = 0; col < _size._x; ++col)
-			_pixels[row][col] = color;
+			pixels[col] = color;
+	}
 }
 
 void Bmp::freePixels()
 {
-	if(_pixels != nullptr){
-		for(int row = 0; row < _size._y; ++row)
-			delete[] _pixels[row];
-		delete[] _pixels;
-	}
+	if(_pixels != nullptr)
+		::operator delete[](_pixels, std::align_val_t{ROW_ALIGNMENT});
 	_pixels = nullptr;
+	_stride = 0;
 }
 
+//
+// Allocates a zeroed (i.e. transparent) buffer for the current _size. The row padding is zeroed 
+// too so it is always safe to read.
+//
 void Bmp::reallocatePixels()
 {
 	freePixels();
-	_pixels = new gfx::Color4u*[_size._y];
-	for(int row = 0; row < _size._y; ++row)
-		_pixels[row] = new gfx::Color4u[_size._x];
+	static constexpr int pixelsPerAlignment = ROW_ALIGNMENT / sizeof(gfx::Color4u);
+	_stride = ((_size._x + pixelsPerAlignment - 1) / pixelsPerAlignment) * pixelsPerAlignment;
+	size_t bufferSize_bytes = static_cast<size_t>(_stride) * _size._y * sizeof(gfx::Color4u);
+	_pixels = static_cast<gfx::Color4u*>(::operator new[](bufferSize_bytes, std::align_val_t{ROW_ALIGNMENT}));
+	memset(static_cast<void*>(_pixels), 0, bufferSize_bytes);
 }
 
 void Bmp::extractIndexedPixels(std::ifstream& file, FileHeader& fileHead, InfoHeader& infoHead)
@@ -298,7 +381,7 @@ void Bmp::extractIndexedPixels(std::ifstream& file, FileHeader& fileHead, InfoHe
 			}
 			int shift = infoHead._bitsPerPixel * (numPixelsPerByte - 1 - bytePixelNo);
 			uint8_t index = (byte & (mask << shift)) >> shift;
-			_pixels[row][col] = palette[index];
+			_pixels[(row * _stride) + col] = palette[index];
 			++col;
 			++bytePixelNo;
 		}
@@ -376,12 +459,61 @@ void Bmp::extractPixels(std::ifstream& file, FileHeader& fileHead, InfoHeader& i
 			//uint8_t alpha = infoHead._alphaMask == 0 ? 
 			//  (rawPixelBytes & infoHead._alphaMask) >> alphaShift : 255;
 
-			_pixels[row][col] = gfx::Color4u{red, green, blue, alpha};
+			_pixels[(row * _stride) + col] = gfx::Color4u{red, green, blue, alpha};
 		}
 		seekPos += rowOffset_bytes;
 	}
 	delete[] buffer;
 }
 
+BmpDiff compareBmps(const Bmp& a, const Bmp& b, Bmp* diffImage)
+{
+	BmpDiff diff {};
+	if(!(a.getSize() == b.getSize())){
+		diff._isSizeMismatch = true;
+		return diff;
+	}
+
+	if(diffImage != nullptr)
+		diffImage->create(b.getSize(), gfx::Color4u{});
+
+	int xmin {b.getWidth()}, ymin {b.getHeight()}, xmax {-1}, ymax {-1};
+	for(int row = 0; row < b.getHeight(); ++row){
+		const gfx::Color4u* pxa = a.getRow(row);
+		const gfx::Color4u* pxb = b.getRow(row);
+		for(int col = 0; col < b.getWidth(); ++col){
+			int delta = std::max({
+				std::abs(pxa[col]._r - pxb[col]._r),
+				std::abs(pxa[col]._g - pxb[col]._g),
+				std::abs(pxa[col]._b - pxb[col]._b),
+				std::abs(pxa[col]._a - pxb[col]._a)
+			});
+			if(delta != 0){
+				++diff._diffPixels;
+				diff._maxChannelDelta = std::max(diff._maxChannelDelta, delta);
+				xmin = std::min(xmin, col);
+				ymin = std::min(ymin, row);
+				xmax = std::max(xmax, col);
+				ymax = std::max(ymax, row);
+			}
+			if(diffImage != nullptr){
+				diffImage->getRow(row)[col] = (delta != 0) ? 
+					gfx::Color4u{255, 0, 0, 255} : 
+					gfx::Color4u{
+						static_cast<uint8_t>(pxb[col]._r / 4), 
+						static_cast<uint8_t>(pxb[col]._g / 4), 
+						static_cast<uint8_t>(pxb[col]._b / 4), 
+						255
+					};
+			}
+		}
+	}
+
+	if(diff._diffPixels > 0)
+		diff._bounds = iRect{xmin, ymin, xmax - xmin + 1, ymax - ymin + 1};
+
+	return diff;
+}
+
 } // namespace io
 } // namespace pxr
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <algorithm>
 #include "pxr_collision.h"
 #include "pxr_bmp.h"
 
@@ -10,6 +11,7 @@ namespace pxr
 // every call to avoid repeated memory allocations.
 //
 static CollisionResult cr;
+static TileCollisionResult tcr;
 
 static void clearResults()
 {
@@ -90,30 +92,44 @@ static void findPixelIntersections(const AABB& aOverlap,
 	assert(0 <= aSheetOverlap._ymax && aSheetOverlap._ymax < aSheet._image.getHeight());
 	assert(0 <= bSheetOverlap._ymax && bSheetOverlap._ymax < bSheet._image.getHeight());
 
-	const gfx::Color4u* const* aPixels = aSheet._image.getPixels();
-	const gfx::Color4u* const* bPixels = bSheet._image.getPixels();
-
-	int overlapWidth = aSheetOverlap._xmax - aSheetOverlap._xmin;
-	int overlapHeight = aSheetOverlap._ymax - aSheetOverlap._ymin;
-
-	int aPxRow, bPxRow, aPxCol, bPxCol;
+	//
+	// Walk the opaque spans of the overlapping rows of both sprites in step; any overlap between
+	// a span of a and a span of b is a run of intersecting pixels. Span cols are converted to 
+	// cols w.r.t the overlap region.
+	//
+	int overlapWidth = aSheetOverlap._xmax - aSheetOverlap._xmin + 1;
+	int overlapHeight = aSheetOverlap._ymax - aSheetOverlap._ymin + 1;
 
 	for(int row = 0; row < overlapHeight; ++row){
-		for(int col = 0; col < overlapWidth; ++col){
-			aPxRow = aSheetOverlap._ymin + row;
-			aPxCol = aSheetOverlap._xmin + col;
-
-			bPxRow = bSheetOverlap._ymin + row;
-			bPxCol = bSheetOverlap._xmin + col;
-
-			if(aPixels[aPxRow][aPxCol]._a == 0 || bPixels[bPxRow][bPxCol]._a == 0)
-				continue;
-
-			cr._aPixels.push_back({aPxCol, aPxRow});
-			cr._bPixels.push_back({bPxCol, bPxRow});
-
-			if(!pixelLists)
-				break;
+		int aSpriteRow = aOverlap._ymin + row;
+		int bSpriteRow = bOverlap._ymin + row;
+
+		int aSpan = aSprite._rowSpans[aSpriteRow];
+		int bSpan = bSprite._rowSpans[bSpriteRow];
+		int aSpanEnd = aSprite._rowSpans[aSpriteRow + 1];
+		int bSpanEnd = bSprite._rowSpans[bSpriteRow + 1];
+
+		while(aSpan < aSpanEnd && bSpan < bSpanEnd){
+			int aColBegin = aSprite._spans[aSpan]._col - aOverlap._xmin;
+			int bColBegin = bSprite._spans[bSpan]._col - bOverlap._xmin;
+			int aColEnd = aColBegin + aSprite._spans[aSpan]._count;
+			int bColEnd = bColBegin + bSprite._spans[bSpan]._count;
+
+			int colBegin = std::max(std::max(aColBegin, bColBegin), 0);
+			int colEnd = std::min(std::min(aColEnd, bColEnd), overlapWidth);
+
+			for(int col = colBegin; col < colEnd; ++col){
+				cr._aPixels.push_back({aSheetOverlap._xmin + col, aSheetOverlap._ymin + row});
+				cr._bPixels.push_back({bSheetOverlap._xmin + col, bSheetOverlap._ymin + row});
+
+				if(!pixelLists)
+					return;
+			}
+
+			if(aColEnd < bColEnd) 
+				++aSpan;
+			else 
+				++bSpan;
 		}
 	}
 }
@@ -187,4 +203,45 @@ const CollisionResult& isPixelIntersection(const CollisionSubject& a,
 	return cr;
 }
 
+const TileCollisionResult& isTileMapIntersection(const AABB& box, 
+                                                 Vector2i mapPosition, 
+                                                 gfx::ResourceKey_t mapKey,
+                                                 bool cellList)
+{
+	tcr._isCollision = false;
+	tcr._cells.clear();
+
+	Vector2i mapSize = gfx::getTileMapSize(mapKey);
+	Vector2i tileSize = gfx::getTileMapTileSize(mapKey);
+
+	//
+	// The range of cells overlapped by the box, clamped to the map. Coordinates are offset to be
+	// w.r.t the map before dividing so that division truncates toward the bottom-left cell.
+	//
+	int xmin = box._xmin - mapPosition._x;
+	int ymin = box._ymin - mapPosition._y;
+	int xmax = box._xmax - mapPosition._x;
+	int ymax = box._ymax - mapPosition._y;
+	if(xmax < 0 || ymax < 0)
+		return tcr;
+
+	int colBegin = std::max(0, xmin) / tileSize._x;
+	int rowBegin = std::max(0, ymin) / tileSize._y;
+	int colEnd = std::min(mapSize._x - 1, xmax / tileSize._x);
+	int rowEnd = std::min(mapSize._y - 1, ymax / tileSize._y);
+
+	for(int row = rowBegin; row <= rowEnd; ++row){
+		for(int col = colBegin; col <= colEnd; ++col){
+			if(gfx::getTile({col, row}, mapKey) == gfx::EMPTY_TILE)
+				continue;
+			tcr._isCollision = true;
+			if(!cellList)
+				return tcr;
+			tcr._cells.push_back({col, row});
+		}
+	}
+
+	return tcr;
+}
+
 } // namespace pxr
@@ -3,6 +3,8 @@
 #include <sstream>
 #include <iomanip>
 #include <cassert>
+#include <cstdlib>
+#include <algorithm>
 #include "pxr_engine.h"
 #include "pxr_log.h"
 #include "pxr_game.h"
@@ -105,6 +107,8 @@ void Engine::initialize(std::unique_ptr<Game> game)
 	if(_rc.load(EngineRC::filename) < 0)
 		_rc.write(EngineRC::filename);    // generate a default rc file if one doesn't exist.
 
+	readGoldenRun();
+
 	if(SDL_Init(SDL_INIT_VIDEO) < 0){
 		log::log(log::LVL_FATAL, log::msg_eng_fail_sdl_init, std::string{SDL_GetError()});
 		exit(EXIT_FAILURE);
@@ -124,11 +128,18 @@ void Engine::initialize(std::unique_ptr<Game> game)
 	// std::seed_seq seq{1, 2, 3, 4, 5};
 	// randGenerator.seed(seq);
 	//
-	std::random_device rd{};
-	rand::xorwow::state_type seedstate {};
-	for(auto& seed : seedstate)
-		seed = rd();
-	rand::generator.seed(seedstate);
+	// Golden runs must be repeatable thus always use the default seed.
+	//
+	if(_golden._ticks > 0){
+		rand::generator.seed();
+	}
+	else{
+		std::random_device rd{};
+		rand::xorwow::state_type seedstate {};
+		for(auto& seed : seedstate)
+			seed = rd();
+		rand::generator.seed(seedstate);
+	}
 
 	_game = std::move(game);
 
@@ -143,11 +154,41 @@ void Engine::initialize(std::unique_ptr<Game> game)
 	windowSize._x = _rc.getIntValue(EngineRC::KEY_WINDOW_WIDTH);
 	windowSize._y = _rc.getIntValue(EngineRC::KEY_WINDOW_HEIGHT);
 	bool fullscreen = _rc.getBoolValue(EngineRC::KEY_FULLSCREEN);
-	if(!gfx::initialize(ss.str(), windowSize, fullscreen)){
+
+	//
+	// The environment overrides the rc file so CI can run games headless (e.g. along with 
+	// SDL_VIDEODRIVER=dummy and SDL_AUDIODRIVER=dummy) without changing the game's assets:
+	//
+	//     PXR_BACKEND=opengl|headless
+	//     PXR_CAPTURE_PATH=<path prefix of captured frames>  (headless only)
+	//     PXR_CAPTURE_INTERVAL=<capture every nth frame>      (headless only)
+	//
+	gfx::BackendConfig backend {};
+	if(_rc.getBoolValue(EngineRC::KEY_HEADLESS))
+		backend._type = gfx::BackendType::HEADLESS;
+	if(const char* value = std::getenv(backendEnvVar))
+		backend._type = (std::string{value} == "headless") ? gfx::BackendType::HEADLESS : gfx::BackendType::OPENGL;
+	if(const char* value = std::getenv(capturePathEnvVar))
+		backend._capturePath = value;
+	if(const char* value = std::getenv(captureIntervalEnvVar))
+		backend._captureInterval = std::max(1, std::atoi(value));
+
+	if(!gfx::initialize(ss.str(), windowSize, fullscreen, backend)){
 		log::log(log::LVL_FATAL, log::msg_gfx_fail_init);
 		exit(EXIT_FAILURE);
 	}
 
+	//
+	// Deferred drawing changes when resources may be freed (see gfx::DrawMode) thus games opt in
+	// explicitly; raster threads alone never switch the draw mode.
+	//
+	gfx::setRasterThreadCount(_rc.getIntValue(EngineRC::KEY_RASTER_THREADS));
+	if(_rc.getBoolValue(EngineRC::KEY_DEFERRED_DRAW))
+		gfx::setDrawMode(gfx::DrawMode::DEFERRED);
+
+	if(_rc.getBoolValue(EngineRC::KEY_COMPOSITOR))
+		gfx::enableCompositor();
+
 	_engineFontKey = gfx::loadFont(engineFontName);
   
 	if(!_game->onInit()){
@@ -202,18 +243,32 @@ void Engine::initialize(std::unique_ptr<Game> game)
 	_lastFrameMeasureNow = Duration_t::zero();
 	_isDrawingEngineStats = false;
 	_isDone = false;
+
+	if(const char* value = std::getenv(recordEnvVar))
+		input::startRecording(value);
+	if(const char* value = std::getenv(replayEnvVar))
+		input::startReplay(value);
 }
 
 void Engine::shutdown()
 {
+	input::stopRecording();
 	_game->onShutdown();
 	gfx::shutdown();
 	sfx::shutdown();
 	log::shutdown();
+
+	if(_golden._failedImages > 0)
+		exit(EXIT_FAILURE);
 }
 
 void Engine::run()
 {
+	if(_golden._ticks > 0){
+		goldenLoop();
+		return;
+	}
+
 	_realClock.reset();
 	while(!_isSplashDone) 
 		mainloop();
@@ -309,6 +364,120 @@ void Engine::mainloop()
 		std::this_thread::sleep_for(minFramePeriod - framePeriod); 
 }
 
+void Engine::readGoldenRun()
+{
+	_golden = GoldenRun{};
+	_golden._path = defaultGoldenPath;
+
+	const char* ticks = std::getenv(goldenTicksEnvVar);
+	if(ticks == nullptr)
+		return;
+	_golden._ticks = std::max(0, std::atoi(ticks));
+
+	if(const char* value = std::getenv(goldenFramesEnvVar)){
+		std::stringstream ss {value};
+		std::string frame;
+		while(std::getline(ss, frame, ','))
+			if(!frame.empty())
+				_golden._frames.push_back(std::atoi(frame.c_str()));
+	}
+	if(_golden._frames.empty())
+		_golden._frames.push_back(_golden._ticks - 1);
+
+	if(const char* value = std::getenv(goldenPathEnvVar))
+		_golden._path = value;
+
+	if(const char* value = std::getenv(goldenRecordEnvVar))
+		_golden._isRecording = (std::string{value} == "1");
+}
+
+void Engine::goldenLoop()
+{
+	log::log(log::LVL_INFO, log::msg_eng_golden_run, std::to_string(_golden._ticks));
+
+	if(!_isSplashDone)
+		onSplashExit();
+
+	_gameClock.reset();
+	Duration_t tickPeriod {static_cast<int64_t>(1.0e9 / static_cast<double>(_fpsLockHz))};
+	float tickPeriodSeconds {static_cast<float>(tickPeriod.count()) / oneSecond.count()};
+
+	for(int tick = 0; tick < _golden._ticks && !_isDone; ++tick){
+
+		//
+		// Input comes only from the replay (if any); events are drained only to allow quitting.
+		//
+		SDL_Event event;
+		while(SDL_PollEvent(&event) != 0)
+			if(event.type == SDL_QUIT)
+				_isDone = true;
+
+		_gameClock.update(tickPeriod);
+		onUpdateTick(tickPeriodSeconds);
+		onDrawTick(tickPeriodSeconds);
+		++_framesDone;
+
+		if(std::find(_golden._frames.begin(), _golden._frames.end(), tick) != _golden._frames.end())
+			checkGoldenImages(tick);
+	}
+
+	std::string result {std::to_string(_golden._failedImages) + "/" + std::to_string(_golden._checkedImages)};
+	if(_golden._failedImages > 0)
+		log::log(log::LVL_ERROR, log::msg_eng_golden_failed, result);
+	else
+		log::log(log::LVL_INFO, log::msg_eng_golden_passed, std::to_string(_golden._checkedImages));
+}
+
+void Engine::checkGoldenImages(int tick)
+{
+	io::Bmp screen {};
+	io::Bmp golden {};
+	io::Bmp diffImage {};
+	for(int screenid = 0; screenid < gfx::getScreenCount(); ++screenid){
+		std::stringstream ss {};
+		ss << _golden._path << "t" << std::setw(6) << std::setfill('0') << tick << "_s" << screenid;
+		std::string name {ss.str()};
+		std::string filepath {name + io::Bmp::FILE_EXTENSION};
+
+		gfx::captureScreen(screenid, screen);
+		++_golden._checkedImages;
+
+		if(_golden._isRecording){
+			if(screen.write(filepath))
+				log::log(log::LVL_INFO, log::msg_eng_golden_recorded, filepath);
+			else
+				++_golden._failedImages;
+			continue;
+		}
+
+		if(!golden.load(filepath)){
+			log::log(log::LVL_ERROR, log::msg_eng_golden_missing, filepath);
+			++_golden._failedImages;
+			continue;
+		}
+
+		io::BmpDiff diff = io::compareBmps(screen, golden, &diffImage);
+		if(diff._isSizeMismatch){
+			log::log(log::LVL_ERROR, log::msg_eng_golden_size_mismatch, filepath);
+			++_golden._failedImages;
+			continue;
+		}
+
+		if(diff._diffPixels == 0)
+			continue;
+
+		std::stringstream().swap(ss);
+		ss << filepath 
+		   << " pixels:" << diff._diffPixels 
+		   << " max channel delta:" << diff._maxChannelDelta
+		   << " bounds:{x:" << diff._bounds._x << ",y:" << diff._bounds._y 
+		   << ",w:" << diff._bounds._w << ",h:" << diff._bounds._h << "}";
+		log::log(log::LVL_ERROR, log::msg_eng_golden_mismatch, ss.str());
+		diffImage.write(name + "_diff" + io::Bmp::FILE_EXTENSION);
+		++_golden._failedImages;
+	}
+}
+
 void Engine::drawEngineStats()
 {
 	if(!_needRedrawEngineStats)
@@ -338,6 +507,17 @@ void Engine::drawEngineStats()
 								 << " -- real=" << realHours << ":" << realMins << ":" << realSecs;
 	gfx::drawText({10, 10}, ss.str(), _engineFontKey, gfx::colors::white, _statsScreenId);
 
+	std::stringstream().swap(ss);
+
+	const gfx::PresentStats& presentStats = gfx::getPresentStats();
+
+	ss << std::setprecision(3);
+	ss << "present upload: " << presentStats._uploadMilliseconds << "ms  "
+		 << "dirty pixels: " << presentStats._dirtyPixels << "  "
+		 << "dirty rects: " << presentStats._dirtyRects << "  "
+		 << "skipped screens: " << presentStats._skippedScreens;
+	gfx::drawText({10, 30}, ss.str(), _engineFontKey, gfx::colors::white, _statsScreenId);
+
 	_needRedrawEngineStats = false;
 }
 
@@ -1,23 +1,27 @@
-#include <SDL.h>
-#include <SDL_opengl.h>
 #include <vector>
 #include <array>
-#include <map>
+#include <unordered_map>
 #include <string>
 #include <cstring>
 #include <sstream>
 #include <cinttypes>
 #include <limits>
 #include <cassert>
+#include <algorithm>
+#include <type_traits>
 
 #include <chrono>
 
 #include "pxr_xml.h"
 #include "pxr_gfx.h"
+#include "pxr_backend.h"
 #include "pxr_vec.h"
 #include "pxr_rect.h"
 #include "pxr_color.h"
 #include "pxr_bmp.h"
+#include "pxr_blit.h"
+#include "pxr_slotmap.h"
+#include "pxr_workers.h"
 #include "pxr_log.h"
 
 using namespace tinyxml2;
@@ -34,22 +38,35 @@ namespace gfx
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
-static constexpr int MIN_OPENGL_VERSION_MAJOR = 2;
-static constexpr int MIN_OPENGL_VERSION_MINOR = 1;
-static constexpr int DEF_OPENGL_VERSION_MAJOR = 3;
-static constexpr int DEF_OPENGL_VERSION_MINOR = 0;
-
-static constexpr int ALPHA_KEY = 0;
-
 static std::string windowTitle;
 static Vector2i windowSize;
 static bool fullscreen;
 static int minPixelSize;
 static int maxPixelSize;
-static SDL_Window* window;
-static SDL_GLContext glContext;
+static int maxTextureSize;
+static std::unique_ptr<RenderBackend> backend;
+static BackendType backendType;
 static iRect viewport;
 static std::vector<Screen> screens;
+static PresentStats presentStats;
+
+//
+// A group of screens merged by the compositor into the pixels of its own screen, which is 
+// uploaded and drawn in place of the group. The screens of the group are 
+// [_firstScreenid, _firstScreenid + _screenCount).
+//
+struct Composite
+{
+	int _firstScreenid;
+	int _screenCount;
+	Screen _screen;
+	std::vector<Vector2i> _scrolls;   // scroll of each screen when last composed.
+	bool _isUsed;
+};
+
+static bool isCompositing {false};
+static std::vector<Composite> composites;
+static std::vector<int> screenComposites;  // index of the composite of each screen, or -1.
 
 struct SpritesheetResource
 {
@@ -65,17 +82,246 @@ struct FontResource
 	int _referenceCount;
 };
 
-static ResourceKey_t nextResourceKey {0};
+//
+// A chunk of a tile map pre-rasterized into a spritesheet with a single sprite spanning the 
+// image, such that drawing the chunk is drawing the sprite. Stale chunks are rebuilt when next
+// drawn.
+//
+struct TileChunk
+{
+	Spritesheet _cache;
+	bool _isStale;
+};
+
+struct TileMapResource
+{
+	ResourceKey_t _sheetKey;
+	Vector2i _mapSize;                 // num cells (cols x rows).
+	Vector2i _tileSize;                // size of each cell in pixels.
+	Vector2i _chunkCount;              // num chunks (cols x rows).
+	std::vector<SpriteID_t> _tiles;    // accessed [col + (row * _mapSize._x)]
+	std::vector<TileChunk> _chunks;    // accessed [col + (row * _chunkCount._x)]
+	int _pinnedFlush;                  // flushCount while pending commands draw the map.
+};
+
+//
+// A string of a font pre-rasterized into a mask of the opaque pixels of its glyphs (packed as 
+// glyph masks), such that drawing the string expands the mask rather than placing every glyph.
+// Runs are cached in a bounded pool and the least recently used run is replaced by a new one
+// when the pool is full; runs drawn by pending commands are pinned until the commands are
+// flushed.
+//
+struct TextRun
+{
+	std::string _key;                // font key bytes then the string; empty if the run is unused.
+	ResourceKey_t _fontKey;
+	Vector2i _size;                  // as calculateTextSize.
+	iRect _bounds;                   // of the opaque pixels w.r.t the position drawn at.
+	int _maskStride;                 // num words per row of the mask.
+	std::vector<uint64_t> _mask;     // as a glyph mask of the rows and cols of _bounds.
+	uint64_t _lastUse;
+	int _pinnedFlush;                // flushCount while pinned.
+};
 
-static std::map<ResourceKey_t, SpritesheetResource> spritesheets;
-static std::map<ResourceKey_t, FontResource> fonts;
+static constexpr int maxTextRuns {256};
+static std::vector<TextRun> textRuns;
+static std::unordered_map<std::string, int> textRunIds;
+static uint64_t textRunUseCount {0};
+
+//
+// Resources are stored in slot maps such that resource keys index them directly. The name 
+// indexes map resource names to keys to find already loaded resources.
+//
+static SlotMap<SpritesheetResource> spritesheets;
+static SlotMap<FontResource> fonts;
+static SlotMap<TileMapResource> tileMaps;
+static std::unordered_map<std::string, ResourceKey_t> spritesheetKeys;
+static std::unordered_map<std::string, ResourceKey_t> fontKeys;
 
 static constexpr const char* errorSpritesheetName {"error_spritesheet"};
 static constexpr const char* errorFontName {"error_font"};
 
 static ResourceKey_t errorSpritesheetKey;
-static SpritesheetResource errorSpritesheet;
-static FontResource errorFont;
+static ResourceKey_t errorFontKey;
+
+static DrawMode drawMode {DrawMode::IMMEDIATE};
+
+enum class DrawCommandType : uint8_t
+{
+	CLEAR,
+	SPRITE,
+	SPRITE_COLUMN,
+	TEXT,
+	BORDER_RECTANGLE,
+	FILL_RECTANGLE,
+	GRADIENT_RECTANGLE,
+	DITHER_RECTANGLE,
+	LINE,
+	LINE_LIST,
+	LINE_STRIP,
+	FILL_ELLIPSES,
+	BORDER_ELLIPSES,
+	FILL_POLYGONS,
+	POINT,
+	POINTS,
+	COLORED_POINTS,
+	TILE_MAP,
+	BLIT
+};
+
+//
+// A row shader bound to the shader callable it applies. The callable is owned by the screen (or,
+// once replaced, by retiredShaders until pending commands using it have executed).
+//
+struct RowShader
+{
+	PXRowShader_t _rowShader;
+	const void* _shader;
+};
+
+//
+// A draw call. In DrawMode::IMMEDIATE commands are executed as soon as they are made, in
+// DrawMode::DEFERRED they are recorded. Commands are plain data; the meaning of the generic 
+// fields depends on the type:
+//
+//   type             | _p0      | _p1      | _key  | _arg0     | _arg1       | _color
+//   -----------------+----------+----------+-------+-----------+-------------+--------
+//   CLEAR            |          |          |       |           |             | clear
+//   SPRITE           | position |          | sheet | sprite id |             |
+//   SPRITE_COLUMN    | position |          | sheet | sprite id | col id      |
+//   TEXT             | position |          | font  | text run  |             | text
+//   BORDER/FILL_RECT | x,y      | w,h      |       |           |             | rect
+//   GRADIENT_RECT    | x,y      | w,h      |       | direction |             | from, to
+//   DITHER_RECT      | x,y      | w,h      |       | density   |             | color0, color1
+//   LINE             | p0       | p1       |       |           |             | line
+//   LINE_LIST/STRIP  |          |          |       | points    | point count |  line
+//   FILL/BORDER_ELLI |          |          |       | ellipses  | count       | shape
+//   FILL_POLYGONS    |          |          |       | polygons  | count       | shape
+//   POINT            | position |          |       |           |             | point
+//   POINTS           |          |          |       | points    | point count | points
+//   COLORED_POINTS   |          |          |       | points    | point count |
+//   TILE_MAP         | position |          | map   |           |             |
+//   BLIT             | position | src x,y  | src   | src w     | src h       |
+//
+// where the ellipses (polygons) are the index of the first shape of the batch in ellipseArena 
+// (polygonArena), the text run is the index of the run in textRuns, the points are the index of
+// the first point of the batch in pointArena and the blit src is the id of the screen read. A
+// list draws the lines joining each pair of points, a strip those joining each point to the
+// next. The points of a batch of points are those of the batch within the screen (and clip
+// rect), and the colors of colored points are at the same indices in pointColorArena
+// (pointIndexArena on indexed screens). The second color (if any) is _color1.
+//
+// The shader is that of the screen when the call was made (a null row shader if the screen was
+// not in PixelMode::SHADER) so changes to pixel modes between draws apply as in immediate mode.
+//
+// On indexed screens the index is the palette index of the color (_index1 that of _color1), 
+// found when the call was made.
+//
+// Commands made while the screen had a clip rect are clipped; their bounds are clipped to the
+// clip rect and they are executed clipped to their bounds.
+//
+// The bounds are a conservative screen space bounding box of the pixels the command can write,
+// clipped to the screen. They are used to mark the screen dirty, to cull covered commands, to 
+// prove reorderings safe and to bin commands into raster tiles.
+//
+struct DrawCommand
+{
+	DrawCommandType _type;
+	bool _mirrorX;
+	bool _mirrorY;
+	bool _isCulled;
+	bool _isClipped;
+	int _screenid;
+	RowShader _shader;
+	Vector2i _p0;
+	Vector2i _p1;
+	ResourceKey_t _key;
+	int _arg0;
+	int _arg1;
+	Color4u _color;
+	Color4u _color1;
+	uint8_t _index;
+	uint8_t _index1;
+	iRect _bounds;
+};
+
+//
+// The per-frame arenas of the command buffer. All are cleared (but keep their capacity) after
+// execution so the command buffer does not allocate in steady state.
+//
+static std::vector<DrawCommand> drawCommands;
+static std::vector<DrawCommand> sortedDrawCommands;
+static std::vector<int> screenCommandCounts;
+static std::vector<std::shared_ptr<const void>> retiredShaders;
+static std::vector<Vector2i> pointArena;
+
+//
+// A polygon of a batch; the vertices [_firstPoint, _firstPoint + _pointCount) of pointArena.
+//
+struct PolygonRef
+{
+	int _firstPoint;
+	int _pointCount;
+};
+
+static std::vector<Ellipse> ellipseArena;
+static std::vector<PolygonRef> polygonArena;
+static std::vector<Color4u> pointColorArena;
+static std::vector<uint8_t> pointIndexArena;
+
+//
+// Scratch for clipping and converting batches of points as they are drawn.
+//
+static std::vector<int> pointSurvivors;
+static std::vector<Vector2i> pointConversions;
+
+//
+// The num flushes which executed commands; identifies the commands pending (if any).
+//
+static int flushCount {0};
+
+//
+// The screens read by the pending blit commands; draws to them must wait for the blits.
+//
+static std::vector<int> blitSources;
+
+//
+// A tile of a screen and its bin of commands; the range [_commandsBegin, _commandsEnd) of 
+// tileCommands. Tiles are rebuilt every flush.
+//
+struct RasterTile
+{
+	int _screenid;
+	iRect _clip;
+	int _commandsBegin;
+	int _commandsEnd;
+};
+
+static std::vector<RasterTile> rasterTiles;
+static std::vector<int> tileCommands;
+
+//
+// Executes the tiles of deferred commands. Has no worker threads (runs everything on the calling
+// thread) unless setRasterThreadCount is called.
+//
+static WorkerPool rasterWorkers;
+
+//
+// Num commands executed and culled since the last present.
+//
+static int executedCommandCount {0};
+static int culledCommandCount {0};
+
+//
+// Sprite commands are batched by spritesheet only within runs of consecutive sprite commands of
+// at most this length to bound the (quadratic) cost of proving reorderings safe.
+//
+static constexpr int maxSpriteBatchRun {256};
+
+//
+// The max number of later fills tracked when culling covered commands.
+//
+static constexpr int maxCullingFills {8};
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -83,20 +329,81 @@ static FontResource errorFont;
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
-static Color4u pxShaderDefault(Color4u color, int pxx, int pxy)
+static void setViewport(iRect viewport)
 {
-	return color;
+	backend->setViewport(viewport);
+	pxr::gfx::viewport = viewport;
 }
 
-static void setViewport(iRect viewport)
+//
+// Builds the opaque span encoding of a sprite from the pixels of its spritesheet image. 
+//
+// Also decides whether draw calls should blit the sprite span by span; a sprite with many short
+// spans (e.g. dithered) is blitted faster by the keyed row kernels, which handle transparency 
+// branch-free, than by a memcpy per span.
+//
+static void buildSpriteSpans(const Bmp& image, Sprite& sprite)
 {
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	glOrtho(0.0, viewport._w, 0.0, viewport._h, -1.0, 1.0);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	glViewport(viewport._x, viewport._y, viewport._w, viewport._h);
-	pxr::gfx::viewport = viewport;
+	static constexpr int spanBlitMinAverageLength {16};
+
+	BmpView spritePxs = image.getView(sprite._position, sprite._size);
+
+	sprite._spans.clear();
+	sprite._mirroredSpans.clear();
+	sprite._rowSpans.clear();
+	sprite._rowSpans.reserve(sprite._size._y + 1);
+
+	int opaqueCount {0};
+	for(int spriteRow = 0; spriteRow < sprite._size._y; ++spriteRow){
+		sprite._rowSpans.push_back(static_cast<int>(sprite._spans.size()));
+		const Color4u* src = spritePxs.getRow(spriteRow);
+		int spriteCol {0};
+		while(spriteCol < sprite._size._x){
+			if(src[spriteCol]._a == ALPHA_KEY){
+				++spriteCol;
+				continue;
+			}
+			SpriteSpan span {spriteCol, 0};
+			while(spriteCol < sprite._size._x && src[spriteCol]._a != ALPHA_KEY){
+				++span._count;
+				++spriteCol;
+			}
+			sprite._spans.push_back(span);
+			opaqueCount += span._count;
+		}
+	}
+	sprite._rowSpans.push_back(static_cast<int>(sprite._spans.size()));
+
+	//
+	// Mirroring in x maps col c to col (w - 1 - c), thus span [c, c + n) maps to span
+	// [w - c - n, w - c) and the order of the spans within a row reverses.
+	//
+	sprite._mirroredSpans.resize(sprite._spans.size());
+	for(int spriteRow = 0; spriteRow < sprite._size._y; ++spriteRow){
+		int spanBegin = sprite._rowSpans[spriteRow];
+		int spanEnd = sprite._rowSpans[spriteRow + 1];
+		for(int i = spanBegin; i < spanEnd; ++i){
+			const SpriteSpan& span = sprite._spans[i];
+			SpriteSpan& mirrored = sprite._mirroredSpans[spanBegin + spanEnd - 1 - i];
+			mirrored._col = sprite._size._x - span._col - span._count;
+			mirrored._count = span._count;
+		}
+	}
+
+	sprite._isSpanBlit = static_cast<int>(sprite._spans.size()) * spanBlitMinAverageLength <= opaqueCount;
+}
+
+//
+// Marks the chunks of the tile maps of a spritesheet stale, such that their caches are rebuilt
+// (and requantized) from the sheet when next drawn.
+//
+static void markSheetTileChunksStale(ResourceKey_t sheetKey)
+{
+	tileMaps.forEach([sheetKey](ResourceKey_t, TileMapResource& map){
+		if(map._sheetKey == sheetKey)
+			for(auto& chunk : map._chunks)
+				chunk._isStale = true;
+	});
 }
 
 // 
@@ -114,14 +421,50 @@ static void genErrorSpritesheet()
 	sprite._origin = Vector2i{0, 0};
 
 	resource._sheet._image.create(sprite._size, colors::red);
+	buildSpriteSpans(resource._sheet._image, sprite);
 	resource._sheet._sprites.push_back(sprite);
 
 	resource._name = errorSpritesheetName;
 	resource._referenceCount = 0;
 
-	errorSpritesheetKey = nextResourceKey++;
+	errorSpritesheetKey = spritesheets.insert(std::move(resource));
+	spritesheetKeys.emplace(errorSpritesheetName, errorSpritesheetKey);
+}
+
+static inline int getMaskStride(int width)
+{
+	return (width + GLYPH_MASK_WORD_BITS - 1) / GLYPH_MASK_WORD_BITS;
+}
+
+static inline bool isMaskBitSet(const uint64_t* mask, int bit)
+{
+	return (mask[bit / GLYPH_MASK_WORD_BITS] >> (bit % GLYPH_MASK_WORD_BITS)) & 1;
+}
+
+//
+// Packs the alpha of each glyph of the font image into the glyph's mask.
+//
+static void buildGlyphMasks(Font& font, const Bmp& image)
+{
+	int wordCount {0};
+	for(const auto& glyph : font._glyphs)
+		wordCount += getMaskStride(glyph._width) * glyph._height;
 
-	spritesheets.emplace(std::make_pair(errorSpritesheetKey, resource));
+	font._masks.assign(wordCount, 0);
+	int offset {0};
+	for(auto& glyph : font._glyphs){
+		glyph._maskOffset = offset;
+		int stride = getMaskStride(glyph._width);
+		BmpView glyphPxs = image.getView({glyph._x, glyph._y}, {glyph._width, glyph._height});
+		for(int glyphRow = 0; glyphRow < glyph._height; ++glyphRow){
+			const Color4u* src = glyphPxs.getRow(glyphRow);
+			uint64_t* dst = font._masks.data() + offset + (glyphRow * stride);
+			for(int glyphCol = 0; glyphCol < glyph._width; ++glyphCol)
+				if(src[glyphCol]._a != ALPHA_KEY)
+					dst[glyphCol / GLYPH_MASK_WORD_BITS] |= uint64_t{1} << (glyphCol % GLYPH_MASK_WORD_BITS);
+		}
+		offset += stride * glyph._height;
+	}
 }
 
 //
@@ -135,7 +478,6 @@ static void genErrorFont()
 	resource._font._lineHeight = 8;
 	resource._font._baseLine = 1;
 	resource._font._glyphSpace = 0;
-	resource._font._image.create(Vector2i{8, 8}, colors::red);
 	for(auto& glyph : resource._font._glyphs){
 		glyph._x = 0;
 		glyph._y = 0;
@@ -146,13 +488,18 @@ static void genErrorFont()
 		glyph._xadvance = 8;
 	}
 
+	Bmp image {};
+	image.create(Vector2i{8, 8}, colors::red);
+	buildGlyphMasks(resource._font, image);
+
 	resource._name = errorFontName;
 	resource._referenceCount = 0;
 
-	fonts.emplace(std::make_pair(nextResourceKey++, resource));
+	errorFontKey = fonts.insert(std::move(resource));
+	fontKeys.emplace(errorFontName, errorFontKey);
 }
 
-bool initialize(std::string windowTitle_, Vector2i windowSize_, bool fullscreen_)
+bool initialize(std::string windowTitle_, Vector2i windowSize_, bool fullscreen_, const BackendConfig& backend_)
 {
 	log::log(log::LVL_INFO, log::msg_gfx_initializing);
 
@@ -160,76 +507,31 @@ bool initialize(std::string windowTitle_, Vector2i windowSize_, bool fullscreen_
 	windowTitle = windowTitle_;
 	fullscreen = fullscreen_;
 
-	uint32_t flags = SDL_WINDOW_OPENGL;
-	if(fullscreen){
-		flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
-		log::log(log::LVL_INFO, log::msg_gfx_fullscreen);
-	}
-
-	std::stringstream ss {};
-	ss << "{w:" << windowSize._x << ",h:" << windowSize._y << "}";
-	log::log(log::LVL_INFO, log::msg_gfx_creating_window, std::string{ss.str()});
-
-	window = SDL_CreateWindow(
-			windowTitle.c_str(), 
-			SDL_WINDOWPOS_UNDEFINED,
-			SDL_WINDOWPOS_UNDEFINED,
-			windowSize._x,
-			windowSize._y,
-			flags
-	);
-
-	if(window == nullptr){
-		log::log(log::LVL_FATAL, log::msg_gfx_fail_create_window, std::string{SDL_GetError()});
-		return false;
-	}
-
-	SDL_GL_GetDrawableSize(window, &windowSize._x, &windowSize._y);
-	std::stringstream().swap(ss);
-	ss << "{w:" << windowSize._x << ",h:" << windowSize._y << "}";
-	log::log(log::LVL_INFO, log::msg_gfx_created_window, std::string{ss.str()});
-
-	glContext = SDL_GL_CreateContext(window);
-	if(glContext == nullptr){
-		log::log(log::LVL_FATAL, log::msg_gfx_fail_create_opengl_context, std::string{SDL_GetError()});
-		return false;
-	}
-
-	if(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, DEF_OPENGL_VERSION_MAJOR) < 0){
-		log::log(log::LVL_FATAL, log::msg_gfx_fail_set_opengl_attribute, std::string{SDL_GetError()});
-		return false;
+	backendType = backend_._type;
+	switch(backendType){
+	case BackendType::OPENGL:
+		backend = createOpenGLBackend();
+		break;
+	case BackendType::HEADLESS:
+		backend = createHeadlessBackend(backend_);
+		break;
 	}
+	log::log(log::LVL_INFO, log::msg_gfx_backend, backend->getName());
 
-	if(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, DEF_OPENGL_VERSION_MINOR) < 0){
-		log::log(log::LVL_FATAL, log::msg_gfx_fail_set_opengl_attribute, std::string{SDL_GetError()});
+	if(!backend->initialize(windowTitle, windowSize, fullscreen))
 		return false;
-	}
-
-	std::string glVersion {reinterpret_cast<const char*>(glGetString(GL_VERSION))};
-	log::log(log::LVL_INFO, log::msg_gfx_opengl_version, glVersion);
-
-	// TODO: extract version from string and check it meets min requirement.
-
-	const char* glRenderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
-	log::log(log::LVL_INFO, log::msg_gfx_opengl_renderer, glRenderer);
 
-	const char* glVendor {reinterpret_cast<const char*>(glGetString(GL_VENDOR))};
-	log::log(log::LVL_INFO, log::msg_gfx_opengl_vendor, glVendor);
-
-	GLfloat params[2];
-	glGetFloatv(GL_ALIASED_POINT_SIZE_RANGE, params);
-	minPixelSize = params[0];
-	maxPixelSize = params[1];
-	std::stringstream().swap(ss);
+	windowSize = backend->getWindowSize();
+	minPixelSize = 1;
+	maxPixelSize = backend->getMaxPixelSize();
+	maxTextureSize = backend->getMaxScreenSize();
+	std::stringstream ss {};
 	ss << "[min:" << minPixelSize << ",max:" << maxPixelSize << "]";
 	log::log(log::LVL_INFO, log::msg_gfx_pixel_size_range, std::string{ss.str()});
 
-	setViewport(iRect{0, 0, windowSize._x, windowSize._y});
+	log::log(log::LVL_INFO, log::msg_gfx_blit_kernel, getBlitKernelName(getBlitKernel()));
 
-	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_COLOR_ARRAY);
-	glEnable(GL_ALPHA_TEST);
-	glAlphaFunc(GL_GREATER, 0.f);
+	setViewport(iRect{0, 0, windowSize._x, windowSize._y});
 
 	genErrorSpritesheet();
 	genErrorFont();
@@ -237,26 +539,41 @@ bool initialize(std::string windowTitle_, Vector2i windowSize_, bool fullscreen_
 	return true;
 }
 
+static void freeScreen(Screen& screen)
+{
+	delete[] screen._pxColors;
+	delete[] screen._pxIndices;
+	screen._pxColors = nullptr;
+	screen._pxIndices = nullptr;
+	if(!screen._isOffscreen)
+		backend->freeScreenResources(screen);
+}
+
 static void freeScreens()
 {
-	for(auto& screen : screens){
-		delete[] screen._pxColors;
-		delete[] screen._pxPositions;
-		screen._pxColors = nullptr;
-		screen._pxPositions = nullptr;
-	}
+	for(auto& screen : screens)
+		freeScreen(screen);
+	for(auto& composite : composites)
+		freeScreen(composite._screen);
+	composites.clear();
 }
 
 void shutdown()
 {
+	rasterWorkers.stop();
 	freeScreens();
-	SDL_GL_DeleteContext(glContext);
-	SDL_DestroyWindow(window);
+	backend->shutdown();
+	backend.reset();
+}
+
+BackendType getBackendType()
+{
+	return backendType;
 }
 
 //
-// Recalculates screen position, pixel size, pixel positions etc to a account for a change in 
-// window size, display resolution or screen mode attributes.
+// Recalculates screen position and pixel size to account for a change in window size, display
+// resolution or screen mode attributes.
 //
 static void autoAdjustScreen(Vector2i windowSize, Screen& screen)
 {
@@ -297,120 +614,518 @@ static void autoAdjustScreen(Vector2i windowSize, Screen& screen)
 		screen._position._y = 0;
 		break;
 	}
+}
 
-	//
-	// Pixels are drawn as an array of points of _pxSize diameter. When drawing points in opengl, 
-	// the position of the point is taken as the center position. For odd pixel sizes e.g. 7 the 
-	// center pixel is simply 3,3 (= floor(7/2)). For even pixel sizes e.g. 8 the center of the 
-	// pixel is considered the bottom-left pixel in the top-right quadrant, i.e. 4,4 (= floor(8/2)).
-	//
-	int pixelCenterOffset = screen._pxSize / 2;
+static int rectArea(const iRect& r)
+{
+	return r._w * r._h;
+}
 
-	for(int row = 0; row < screen._resolution._y; ++row){
-		for(int col = 0; col < screen._resolution._x; ++col){
-			Vector2i& pxPosition = screen._pxPositions[col + (row * screen._resolution._x)];
-			pxPosition._x = screen._position._x + (col * screen._pxSize) + pixelCenterOffset;
-			pxPosition._y = screen._position._y + (row * screen._pxSize) + pixelCenterOffset;
-		}
-	}
+static bool isRectOverlap(const iRect& a, const iRect& b)
+{
+	return a._x < b._x + b._w && b._x < a._x + a._w && a._y < b._y + b._h && b._y < a._y + a._h;
 }
 
-int createScreen(Vector2i resolution)
+static iRect rectUnion(const iRect& a, const iRect& b)
 {
-	assert(resolution._x > 0 && resolution._y > 0);
+	int xmin = std::min(a._x, b._x);
+	int ymin = std::min(a._y, b._y);
+	int xmax = std::max(a._x + a._w, b._x + b._w);
+	int ymax = std::max(a._y + a._h, b._y + b._h);
+	return iRect{xmin, ymin, xmax - xmin, ymax - ymin};
+}
 
-	screens.push_back(Screen{});
-	ResourceKey_t screenid = screens.size() - 1;
+static iRect clipRect(iRect rect, const iRect& clip)
+{
+	int xmin = std::max(rect._x, clip._x);
+	int ymin = std::max(rect._y, clip._y);
+	int xmax = std::min(rect._x + rect._w, clip._x + clip._w);
+	int ymax = std::min(rect._y + rect._h, clip._y + clip._h);
+	return iRect{xmin, ymin, std::max(0, xmax - xmin), std::max(0, ymax - ymin)};
+}
 
-	auto& screen = screens.back();
+//
+// Adds the region [xmin, xmax] x [ymin, ymax] (inclusive, w.r.t screen space) to the dirty 
+// region of a screen. The region is clipped to the screen so callers can pass the unclipped 
+// bounds of whatever they are drawing.
+//
+// Dirty rects are kept disjoint; an overlapping rect is merged with the rects it overlaps. If 
+// the screen is already tracking the max number of rects, the new rect is merged into the rect 
+// whose area grows the least as a result.
+//
+static void markDirty(Screen& screen, int xmin, int ymin, int xmax, int ymax)
+{
+	DirtyRegion& dirty = screen._dirty;
 
-	screen._pxShader = pxShaderDefault;
-	screen._pmode = PositionMode::CENTER;
-	screen._smode = SizeMode::AUTO_MAX;
-	screen._xmode = PixelMode::NO_SHADER;
-	screen._position = Vector2i{0, 0};
-	screen._manualPosition = Vector2i{0, 0};
-	screen._resolution = resolution;
-	screen._pxManualSize = 1;
-	screen._pxCount = screen._resolution._x * screen._resolution._y;
-	screen._pxColors = new Color4u[screen._pxCount];
-	screen._pxPositions = new Vector2i[screen._pxCount];
-	screen._isEnabled = true;
+	if(dirty._isFullScreen)
+		return;
 
-	clearScreenTransparent(screenid); 
-	autoAdjustScreen(windowSize, screen);
+	xmin = std::max(xmin, 0);
+	ymin = std::max(ymin, 0);
+	xmax = std::min(xmax, screen._resolution._x - 1);
+	ymax = std::min(ymax, screen._resolution._y - 1);
+	if(xmin > xmax || ymin > ymax)
+		return;
 
-	int memkib = ((screen._pxCount * sizeof(Color4u)) + (screen._pxCount * sizeof(Vector2i))) / 1024;
+	iRect rect {xmin, ymin, xmax - xmin + 1, ymax - ymin + 1};
 
-	std::stringstream ss {};
-	ss << "resolution:" << resolution._x << "x" << resolution._y << "vpx mem:" << memkib << "kib";
-	log::log(log::LVL_INFO, log::msg_gfx_created_vscreen, ss.str());
+	if(rectArea(rect) == screen._pxCount){
+		dirty._rects[0] = rect;
+		dirty._rectCount = 1;
+		dirty._isFullScreen = true;
+		return;
+	}
 
-	return screenid;
+	bool merged {false};
+	do{
+		merged = false;
+		for(int i = 0; i < dirty._rectCount; ++i){
+			if(isRectOverlap(rect, dirty._rects[i])){
+				rect = rectUnion(rect, dirty._rects[i]);
+				dirty._rects[i] = dirty._rects[--dirty._rectCount];
+				merged = true;
+				break;
+			}
+		}
+	}
+	while(merged);
+
+	if(dirty._rectCount == SCREEN_MAX_DIRTY_RECTS){
+		int best {0}, bestGrowth {std::numeric_limits<int>::max()};
+		for(int i = 0; i < dirty._rectCount; ++i){
+			int growth = rectArea(rectUnion(rect, dirty._rects[i])) - rectArea(dirty._rects[i]);
+			if(growth < bestGrowth){
+				bestGrowth = growth;
+				best = i;
+			}
+		}
+		rect = rectUnion(rect, dirty._rects[best]);
+		dirty._rects[best] = dirty._rects[--dirty._rectCount];
+
+		//
+		// The grown rect may now overlap others so must be merged again.
+		//
+		markDirty(screen, rect._x, rect._y, rect._x + rect._w - 1, rect._y + rect._h - 1);
+		return;
+	}
+
+	dirty._rects[dirty._rectCount++] = rect;
+	dirty._isFullScreen = (rectArea(rect) == screen._pxCount);
 }
 
-static ResourceKey_t useErrorSpritesheet()
+static void markDirtyFullScreen(Screen& screen)
 {
-	for(auto& pair : spritesheets){
-		if(pair.second._name == errorSpritesheetName){
-			pair.second._referenceCount++;
-			std::string addendum = "ref count=" + std::to_string(pair.second._referenceCount);
-			log::log(log::LVL_INFO, log::msg_gfx_using_error_spritesheet, addendum);
-			return pair.first;
-		}
-	}
-  
-	assert(0);   // This would mean the error sprite has not been generated.
+	markDirty(screen, 0, 0, screen._resolution._x - 1, screen._resolution._y - 1);
 }
 
-static ResourceKey_t useErrorFont()
+static void clearDirty(Screen& screen)
 {
-	for(auto& resource : fonts){
-		if(resource.second._name == errorFontName){
-			resource.second._referenceCount++;
-			std::string addendum = "ref count=" + std::to_string(resource.second._referenceCount);
-			log::log(log::LVL_INFO, log::msg_gfx_using_error_font, addendum);
-			return resource.first;
-		}
+	screen._dirty._rectCount = 0;
+	screen._dirty._isFullScreen = false;
+}
+
+//
+// Hands the dirty regions of the screen's pixels to the backend then clears them.
+//
+static void uploadScreen(Screen& screen)
+{
+	const DirtyRegion& dirty = screen._dirty;
+
+	if(dirty._rectCount == 0){
+		++presentStats._skippedScreens;
+		return;
 	}
 
-	assert(0);  // This would mean the error font has not been generated.
+	backend->uploadScreen(screen);
+
+	for(int i = 0; i < dirty._rectCount; ++i)
+		presentStats._dirtyPixels += rectArea(dirty._rects[i]);
+	presentStats._dirtyRects += dirty._rectCount;
+
+	clearDirty(screen);
 }
 
-ResourceKey_t loadSpritesheet(ResourceName_t name)
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// COMPOSITOR
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline int wrapCoord(int value, int size)
 {
-	log::log(log::LVL_INFO, log::msg_gfx_loading_spritesheet, name);
+	return ((value % size) + size) % size;
+}
 
-	for(auto& pair : spritesheets){
-		if(pair.second._name == name){
-			pair.second._referenceCount++;
-			std::string addendum {"ref count="};
-			addendum += std::to_string(pair.second._referenceCount);
-			log::log(log::LVL_INFO, log::msg_gfx_spritesheet_already_loaded, addendum);
-			return pair.first;
+//
+// Splits a rect w.r.t the screen space (within the screen) at the seams where the view of the 
+// screen wraps around and calls f(screenRect, viewRect) for each piece; the piece w.r.t the screen
+// and view spaces.
+//
+template<typename F>
+static void forEachViewRect(const Screen& screen, const iRect& rect, F f)
+{
+	int xs[3] {rect._x, std::clamp(screen._scroll._x, rect._x, rect._x + rect._w), rect._x + rect._w};
+	int ys[3] {rect._y, std::clamp(screen._scroll._y, rect._y, rect._y + rect._h), rect._y + rect._h};
+	for(int j = 0; j < 2; ++j){
+		for(int i = 0; i < 2; ++i){
+			iRect piece {xs[i], ys[j], xs[i + 1] - xs[i], ys[j + 1] - ys[j]};
+			if(piece._w == 0 || piece._h == 0)
+				continue;
+			iRect view {
+				wrapCoord(piece._x - screen._scroll._x, screen._resolution._x),
+				wrapCoord(piece._y - screen._scroll._y, screen._resolution._y),
+				piece._w, piece._h
+			};
+			f(piece, view);
 		}
 	}
+}
 
-	SpritesheetResource resource{};
-	Spritesheet& sheet = resource._sheet;
+//
+// Calls f(i, pixels, count) for the (at most 2) runs of screen pixels presented in the view row
+// segment [col, col + count) of 'row'; the run presented from col + i.
+//
+template<typename F>
+static void forEachViewRun(const Screen& screen, int row, int col, int count, F f)
+{
+	int width = screen._resolution._x;
+	const Color4u* src = screen._pxColors + (wrapCoord(row + screen._scroll._y, screen._resolution._y) * width);
+	int srcCol = wrapCoord(col + screen._scroll._x, width);
+	int first = std::min(count, width - srcCol);
+	f(0, src + srcCol, first);
+	if(first < count)
+		f(first, src, count - first);
+}
 
-	resource._name = name;
-	resource._referenceCount = 1;
+static bool isComposable(const Screen& a, const Screen& b)
+{
+	return a._resolution == b._resolution && a._position == b._position && a._pxSize == b._pxSize;
+}
 
-	std::string bmppath{};
-	bmppath += RESOURCE_PATH_SPRITESHEETS;
-	bmppath += name;
-	bmppath += Bmp::FILE_EXTENSION;
-	if(!sheet._image.load(bmppath)){
-		log::log(log::LVL_ERROR, log::msg_gfx_fail_load_asset_bmp, name);
-		return useErrorSpritesheet();
-	}
+static int createComposite(int firstScreenid, int screenCount)
+{
+	const Screen& first = screens[firstScreenid];
+	composites.emplace_back();
+	Composite& composite = composites.back();
+	composite._firstScreenid = firstScreenid;
+	composite._screenCount = screenCount;
+	composite._isUsed = true;
+	for(int screenid = firstScreenid; screenid < firstScreenid + screenCount; ++screenid)
+		composite._scrolls.push_back(screens[screenid]._scroll);
+
+	Screen& screen = composite._screen;
+	screen._resolution = first._resolution;
+	screen._pxCount = first._pxCount;
+	screen._pxColors = new Color4u[screen._pxCount];
+	screen._isEnabled = true;
+	backend->createScreenResources(screen);
+	clearDirty(screen);
+	markDirtyFullScreen(screen);
 
-	std::string xmlpath {};
-	xmlpath += RESOURCE_PATH_SPRITESHEETS;
-	xmlpath += name;
-	xmlpath += XML_RESOURCE_EXTENSION_SPRITESHEETS;
-	XMLDocument doc{};
+	return static_cast<int>(composites.size()) - 1;
+}
+
+//
+// The screens of a destroyed composite are marked fully dirty as their textures were not 
+// updated while composited.
+//
+static void destroyComposite(Composite& composite)
+{
+	freeScreen(composite._screen);
+
+	int screenEnd = std::min(composite._firstScreenid + composite._screenCount, static_cast<int>(screens.size()));
+	for(int screenid = composite._firstScreenid; screenid < screenEnd; ++screenid)
+		markDirtyFullScreen(screens[screenid]);
+}
+
+static void destroyComposites()
+{
+	for(auto& composite : composites)
+		destroyComposite(composite);
+	composites.clear();
+	screenComposites.assign(screens.size(), -1);
+}
+
+//
+// Merges a row segment of the screens of a composite top down; each lower screen is only read
+// while pixels of the merged segment remain transparent. The composite is w.r.t the view space
+// (it is never scrolled) thus each screen is read through its scroll.
+//
+static void composeRow(Composite& composite, int row, int col, int count)
+{
+	Color4u* dst = composite._screen._pxColors + col + (row * composite._screen._resolution._x);
+	int screenid = composite._firstScreenid + composite._screenCount - 1;
+	forEachViewRun(screens[screenid], row, col, count, [dst](int i, const Color4u* src, int n){
+		memcpy(dst + i, src, n * sizeof(Color4u));
+	});
+	bool isKeyed = isRowKeyed(dst, count);
+	while(isKeyed && --screenid >= composite._firstScreenid){
+		isKeyed = false;
+		forEachViewRun(screens[screenid], row, col, count, [dst, &isKeyed](int i, const Color4u* src, int n){
+			isKeyed |= underlayRowKeyed(dst + i, src, n);
+		});
+	}
+}
+
+//
+// Recomposes the union of the dirty regions of the screens of the composite. The dirty regions
+// of the screens are consumed (mapped to the view space); the composite's screen is dirtied 
+// instead. A screen scrolled since the last compose dirties the whole composite.
+//
+static void compose(Composite& composite)
+{
+	Screen& target = composite._screen;
+	const Screen& first = screens[composite._firstScreenid];
+	target._position = first._position;
+	target._pxSize = first._pxSize;
+
+	for(int i = 0; i < composite._screenCount; ++i){
+		Screen& screen = screens[composite._firstScreenid + i];
+		if(!(composite._scrolls[i] == screen._scroll)){
+			composite._scrolls[i] = screen._scroll;
+			markDirtyFullScreen(target);
+		}
+		for(int r = 0; r < screen._dirty._rectCount; ++r){
+			forEachViewRect(screen, screen._dirty._rects[r], [&target](const iRect&, const iRect& view){
+				markDirty(target, view._x, view._y, view._x + view._w - 1, view._y + view._h - 1);
+			});
+		}
+		clearDirty(screen);
+	}
+
+	for(int r = 0; r < target._dirty._rectCount; ++r){
+		const iRect& rect = target._dirty._rects[r];
+		for(int row = rect._y; row < rect._y + rect._h; ++row)
+			composeRow(composite, row, rect._x, rect._w);
+		presentStats._composedPixels += rectArea(rect);
+	}
+	presentStats._composedScreens += composite._screenCount;
+}
+
+//
+// Regroups the enabled screens, reusing the composites of unchanged groups, then composes each
+// group.
+//
+static void updateComposites()
+{
+	for(auto& composite : composites)
+		composite._isUsed = false;
+
+	screenComposites.assign(screens.size(), -1);
+	int screenCount = static_cast<int>(screens.size());
+	int screenid {0};
+	while(screenid < screenCount){
+		int screenEnd = screenid + 1;
+		if(screens[screenid]._isEnabled)
+			while(screenEnd < screenCount && screens[screenEnd]._isEnabled && isComposable(screens[screenid], screens[screenEnd]))
+				++screenEnd;
+
+		if(screenEnd - screenid >= 2){
+			int index {-1};
+			for(int i = 0; i < static_cast<int>(composites.size()); ++i){
+				if(composites[i]._firstScreenid == screenid && composites[i]._screenCount == screenEnd - screenid){
+					index = i;
+					break;
+				}
+			}
+			if(index == -1)
+				index = createComposite(screenid, screenEnd - screenid);
+			composites[index]._isUsed = true;
+			for(int i = screenid; i < screenEnd; ++i)
+				screenComposites[i] = index;
+		}
+		screenid = screenEnd;
+	}
+
+	for(int i = 0; i < static_cast<int>(composites.size());){
+		if(composites[i]._isUsed){
+			++i;
+			continue;
+		}
+		destroyComposite(composites[i]);
+		composites.erase(composites.begin() + i);
+		for(int& index : screenComposites)
+			if(index > i) --index;
+	}
+
+	for(auto& composite : composites)
+		compose(composite);
+}
+
+//
+// Returns the screen to upload and draw in place of a screen; the screen itself, the screen of
+// its composite if it is the first screen of one, or nullptr if it is another screen of one.
+//
+static Screen* getPresentedScreen(int screenid)
+{
+	if(!isCompositing || screenComposites[screenid] == -1)
+		return &screens[screenid];
+	Composite& composite = composites[screenComposites[screenid]];
+	return (composite._firstScreenid == screenid) ? &composite._screen : nullptr;
+}
+
+void enableCompositor()
+{
+	isCompositing = true;
+}
+
+void disableCompositor()
+{
+	isCompositing = false;
+	destroyComposites();
+}
+
+bool isCompositorEnabled()
+{
+	return isCompositing;
+}
+
+static int createScreen(Vector2i resolution, ColorMode cmode, const Palette_t& palette, bool isOffscreen)
+{
+	assert(resolution._x > 0 && resolution._y > 0);
+	assert(isOffscreen || (resolution._x <= maxTextureSize && resolution._y <= maxTextureSize));
+
+	screens.push_back(Screen{});
+	ResourceKey_t screenid = screens.size() - 1;
+
+	auto& screen = screens.back();
+
+	screen._rowShader = nullptr;
+	screen._shader = nullptr;
+	screen._pmode = PositionMode::CENTER;
+	screen._smode = SizeMode::AUTO_MAX;
+	screen._xmode = PixelMode::NO_SHADER;
+	screen._cmode = cmode;
+	screen._position = Vector2i{0, 0};
+	screen._manualPosition = Vector2i{0, 0};
+	screen._resolution = resolution;
+	screen._scroll = Vector2i{0, 0};
+	screen._clip = iRect{0, 0, resolution._x, resolution._y};
+	screen._isClipped = false;
+	screen._pxManualSize = 1;
+	screen._pxCount = screen._resolution._x * screen._resolution._y;
+	screen._pxColors = new Color4u[screen._pxCount];
+	screen._pxIndices = (cmode == ColorMode::INDEXED) ? new uint8_t[screen._pxCount] : nullptr;
+	screen._palette = palette;
+	screen._palette[0] = Color4u{ALPHA_KEY, ALPHA_KEY, ALPHA_KEY, ALPHA_KEY};
+	screen._isEnabled = !isOffscreen;
+	screen._isOffscreen = isOffscreen;
+	screen._isLocked = false;
+	clearDirty(screen);
+
+	clearScreenTransparent(screenid); 
+	autoAdjustScreen(windowSize, screen);
+	if(!isOffscreen)
+		backend->createScreenResources(screen);
+
+	int memkib = (screen._pxCount * sizeof(Color4u)) / 1024;
+	if(cmode == ColorMode::INDEXED)
+		memkib += screen._pxCount / 1024;
+
+	std::stringstream ss {};
+	ss << "resolution:" << resolution._x << "x" << resolution._y << "vpx mem:" << memkib << "kib";
+	if(cmode == ColorMode::INDEXED)
+		ss << " indexed";
+	if(isOffscreen)
+		ss << " offscreen";
+	log::log(log::LVL_INFO, log::msg_gfx_created_vscreen, ss.str());
+
+	return screenid;
+}
+
+int createScreen(Vector2i resolution)
+{
+	return createScreen(resolution, ColorMode::FULL_RGB, Palette_t{}, false);
+}
+
+int createIndexedScreen(Vector2i resolution, const Palette_t& palette)
+{
+	return createScreen(resolution, ColorMode::INDEXED, palette, false);
+}
+
+int createSurface(Vector2i resolution)
+{
+	return createScreen(resolution, ColorMode::FULL_RGB, Palette_t{}, true);
+}
+
+bool isSurface(int screenid)
+{
+	assert(0 <= screenid && screenid < screens.size());
+	return screens[screenid]._isOffscreen;
+}
+
+static ResourceKey_t useErrorSpritesheet()
+{
+	SpritesheetResource* resource = spritesheets.find(errorSpritesheetKey);
+	assert(resource != nullptr);   // This would mean the error sprite has not been generated.
+	resource->_referenceCount++;
+	std::string addendum = "ref count=" + std::to_string(resource->_referenceCount);
+	log::log(log::LVL_INFO, log::msg_gfx_using_error_spritesheet, addendum);
+	return errorSpritesheetKey;
+}
+
+// 
+// Validates all sprites of a sheet against its image to avoid segfaults.
+//
+static bool validateSprites(const Spritesheet& sheet)
+{
+	Vector2i bmpSize = sheet._image.getSize();
+	for(auto& sprite : sheet._sprites){
+		if(sprite._position._x < 0 || sprite._position._y < 0) return false;
+		if(sprite._size._x < 0 || sprite._size._y < 0) return false;
+		if(sprite._origin._x < 0 || sprite._origin._y < 0) return false;
+		if(sprite._origin._x >= sprite._size._x || sprite._origin._y >= sprite._size._y) return false;
+		if(sprite._position._x + sprite._size._x > bmpSize._x) return false;
+		if(sprite._position._y + sprite._size._y > bmpSize._y) return false;
+	}
+	return true;
+}
+
+static ResourceKey_t useErrorFont()
+{
+	FontResource* resource = fonts.find(errorFontKey);
+	assert(resource != nullptr);   // This would mean the error font has not been generated.
+	resource->_referenceCount++;
+	std::string addendum = "ref count=" + std::to_string(resource->_referenceCount);
+	log::log(log::LVL_INFO, log::msg_gfx_using_error_font, addendum);
+	return errorFontKey;
+}
+
+ResourceKey_t loadSpritesheet(ResourceName_t name)
+{
+	log::log(log::LVL_INFO, log::msg_gfx_loading_spritesheet, name);
+
+	auto search = spritesheetKeys.find(name);
+	if(search != spritesheetKeys.end()){
+		SpritesheetResource* loaded = spritesheets.find(search->second);
+		assert(loaded != nullptr);
+		loaded->_referenceCount++;
+		std::string addendum {"ref count="};
+		addendum += std::to_string(loaded->_referenceCount);
+		log::log(log::LVL_INFO, log::msg_gfx_spritesheet_already_loaded, addendum);
+		return search->second;
+	}
+
+	SpritesheetResource resource{};
+	Spritesheet& sheet = resource._sheet;
+
+	resource._name = name;
+	resource._referenceCount = 1;
+
+	std::string bmppath{};
+	bmppath += RESOURCE_PATH_SPRITESHEETS;
+	bmppath += name;
+	bmppath += Bmp::FILE_EXTENSION;
+	if(!sheet._image.load(bmppath)){
+		log::log(log::LVL_ERROR, log::msg_gfx_fail_load_asset_bmp, name);
+		return useErrorSpritesheet();
+	}
+
+	std::string xmlpath {};
+	xmlpath += RESOURCE_PATH_SPRITESHEETS;
+	xmlpath += name;
+	xmlpath += XML_RESOURCE_EXTENSION_SPRITESHEETS;
+	XMLDocument doc{};
 	if(!parseXmlDocument(&doc, xmlpath)) 
 		return useErrorSpritesheet();
 
@@ -434,29 +1149,16 @@ ResourceKey_t loadSpritesheet(ResourceName_t name)
 	while(xmlsprite != 0);
 	if(err) return useErrorSpritesheet();
 
-	// 
-	// Validate all sprites to avoid segfaults.
-	//
-	err = 0;
-	Vector2i bmpSize = sheet._image.getSize();
-	for(auto& sprite : sheet._sprites){
-		if(sprite._position._x < 0 || sprite._position._y < 0){++err; break;}
-		if(sprite._size._x < 0 || sprite._size._y < 0){++err; break;}
-		if(sprite._origin._x < 0 || sprite._origin._y < 0){++err; break;}
-		if(sprite._origin._x >= sprite._size._x || sprite._origin._y >= sprite._size._y){++err; break;}
-		if(sprite._position._x + sprite._size._x > bmpSize._x){++err; break;}
-		if(sprite._position._y + sprite._size._y > bmpSize._y){++err; break;}
-	}
-
-	if(err){
+	if(!validateSprites(sheet)){
 		log::log(log::LVL_ERROR, log::msg_gfx_spritesheet_invalid_xml_bmp_mismatch, name);
 		return useErrorSpritesheet();
 	}
 
-	ResourceKey_t newKey = nextResourceKey;
-	++nextResourceKey;
+	for(auto& sprite : sheet._sprites)
+		buildSpriteSpans(sheet._image, sprite);
 
-	spritesheets.emplace(std::make_pair(newKey, std::move(resource)));
+	ResourceKey_t newKey = spritesheets.insert(std::move(resource));
+	spritesheetKeys.emplace(name, newKey);
 
 	std::string addendum{};
 	addendum += "[name:key]=[";
@@ -471,30 +1173,95 @@ ResourceKey_t loadSpritesheet(ResourceName_t name)
 
 void unloadSpritesheet(ResourceKey_t sheetKey)
 {
-	auto search = spritesheets.find(sheetKey);
-	if(search == spritesheets.end()){
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	if(resource == nullptr){
 		log::log(log::LVL_WARN, log::msg_gfx_unloading_nonexistent_resource, "key=" + std::to_string(sheetKey));
 		return;
 	}
 
-	SpritesheetResource& resource = search->second;
-	resource._referenceCount--;
-	if(resource._referenceCount <= 0 && resource._name != errorSpritesheetName){
+	resource->_referenceCount--;
+	if(resource->_referenceCount <= 0 && sheetKey != errorSpritesheetKey){
+		//
+		// Pending commands may draw the sheet; they must be drawn before it is erased.
+		//
+		flushDrawCommands();
 		log::log(log::LVL_INFO, log::msg_gfx_unload_spritesheet_success, "key=" + std::to_string(sheetKey));
-		spritesheets.erase(search);
+		spritesheetKeys.erase(resource->_name);
+		spritesheets.erase(sheetKey);
+	}
+}
+
+ResourceKey_t registerSpritesheet(ResourceName_t name, io::Bmp image, std::vector<Sprite> sprites)
+{
+	assert(std::string{name} != errorSpritesheetName);
+
+	Spritesheet sheet {};
+	sheet._image = std::move(image);
+	sheet._sprites = std::move(sprites);
+	if(!validateSprites(sheet)){
+		log::log(log::LVL_ERROR, log::msg_gfx_spritesheet_invalid_sprites, name);
+		return useErrorSpritesheet();
+	}
+	for(auto& sprite : sheet._sprites)
+		buildSpriteSpans(sheet._image, sprite);
+
+	//
+	// Pending commands may draw the sheet being replaced, and tile maps cache its sprites.
+	//
+	auto search = spritesheetKeys.find(name);
+	if(search != spritesheetKeys.end()){
+		flushDrawCommands();
+		SpritesheetResource* resource = spritesheets.find(search->second);
+		assert(resource != nullptr);
+		resource->_sheet = std::move(sheet);
+		markSheetTileChunksStale(search->second);
+		log::log(log::LVL_INFO, log::msg_gfx_replaced_spritesheet, name);
+		return search->second;
 	}
+
+	SpritesheetResource resource {};
+	resource._sheet = std::move(sheet);
+	resource._name = name;
+	resource._referenceCount = 1;
+
+	ResourceKey_t newKey = spritesheets.insert(std::move(resource));
+	spritesheetKeys.emplace(name, newKey);
+
+	std::string addendum{};
+	addendum += "[name:key]=[";
+	addendum += name; 
+	addendum += ":"; 
+	addendum += std::to_string(newKey);
+	addendum += "]";
+	log::log(log::LVL_INFO, log::msg_gfx_registered_spritesheet, addendum);
+
+	return newKey;
+}
+
+ResourceKey_t registerSurfaceSpritesheet(ResourceName_t name, int screenid, Vector2i origin)
+{
+	Bmp image {};
+	captureScreen(screenid, image);
+
+	Sprite sprite {};
+	sprite._position = Vector2i{0, 0};
+	sprite._size = image.getSize();
+	sprite._origin = origin;
+
+	return registerSpritesheet(name, std::move(image), std::vector<Sprite>{sprite});
 }
 
 ResourceKey_t loadFont(ResourceName_t name)
 {
 	log::log(log::LVL_INFO, log::msg_gfx_loading_font, name);
 
-	for(auto& resource : fonts){
-		if(resource.second._name == name){
-			log::log(log::LVL_INFO, log::msg_gfx_loading_font_success);
-			resource.second._referenceCount++;
-			return resource.first;
-		}
+	auto search = fontKeys.find(name);
+	if(search != fontKeys.end()){
+		FontResource* loaded = fonts.find(search->second);
+		assert(loaded != nullptr);
+		log::log(log::LVL_INFO, log::msg_gfx_loading_font_success);
+		loaded->_referenceCount++;
+		return search->second;
 	}
 
 	FontResource resource {};
@@ -503,11 +1270,12 @@ ResourceKey_t loadFont(ResourceName_t name)
 	resource._name = name;
 	resource._referenceCount = 1;
 
+	Bmp image {};
 	std::string bmppath{};
 	bmppath += RESOURCE_PATH_FONTS;
 	bmppath += name;
 	bmppath += Bmp::FILE_EXTENSION;
-	if(!resource._font._image.load(bmppath)){
+	if(!image.load(bmppath)){
 		log::log(log::LVL_ERROR, log::msg_gfx_fail_load_asset_bmp, name);
 		return useErrorFont();
 	}
@@ -571,7 +1339,7 @@ ResourceKey_t loadFont(ResourceName_t name)
 	// Validate all glyphs to avoid segfaults.
 	//
 	err = 0;
-	Vector2i bmpSize = font._image.getSize();
+	Vector2i bmpSize = image.getSize();
 	for(auto& glyph : font._glyphs){
 		if(glyph._ascii < 32 || glyph._ascii > 126){++err; break;}
 		if(glyph._x < 0 || glyph._y < 0){++err; break;}
@@ -598,332 +1366,2401 @@ ResourceKey_t loadFont(ResourceName_t name)
 		return useErrorFont();
 	}
 
-	log::log(log::LVL_INFO, log::msg_gfx_loading_font_success);
+	buildGlyphMasks(font, image);
 
-	ResourceKey_t newKey = nextResourceKey;
-	++nextResourceKey;
+	log::log(log::LVL_INFO, log::msg_gfx_loading_font_success);
 
-	fonts.emplace(std::make_pair(newKey, std::move(resource)));
+	ResourceKey_t newKey = fonts.insert(std::move(resource));
+	fontKeys.emplace(name, newKey);
 
 	return newKey;
 }
 
+//
+// ORs the first 'count' bits of the mask 'src' into the mask 'dst' from bit 'bit'.
+//
+static void orMaskBits(uint64_t* dst, int bit, const uint64_t* src, int count)
+{
+	int shift = bit % GLYPH_MASK_WORD_BITS;
+	uint64_t* d = dst + (bit / GLYPH_MASK_WORD_BITS);
+	for(int i = 0; i < getMaskStride(count); ++i){
+		d[i] |= src[i] << shift;
+		if(shift != 0 && (src[i] >> (GLYPH_MASK_WORD_BITS - shift)) != 0)
+			d[i + 1] |= src[i] >> (GLYPH_MASK_WORD_BITS - shift);
+	}
+}
+
+//
+// ORs the glyph masks of a string into a mask of its bounds. Glyphs may overlap; their union is
+// drawn.
+//
+static void buildTextRun(const Font& font, const char* text, int length, TextRun& run)
+{
+	run._size = Vector2i{0, 0};
+	run._bounds = iRect{0, 0, 0, 0};
+	int x {0};
+	for(int i = 0; i < length; ++i){
+		char c = text[i];
+		if(c == '\n') continue;
+		assert(' ' <= c && c <= '~');
+		const Glyph& glyph = font._glyphs[static_cast<int>(c - ' ')];
+		iRect glyphRect {x + glyph._xoffset, font._baseLine + glyph._yoffset, glyph._width, glyph._height};
+		if(rectArea(glyphRect) != 0)
+			run._bounds = (rectArea(run._bounds) == 0) ? glyphRect : rectUnion(run._bounds, glyphRect);
+		run._size._x += glyph._xadvance + font._glyphSpace;
+		run._size._y = std::max(run._size._y, glyph._height);
+		x += glyph._xadvance + font._glyphSpace;
+	}
+
+	const iRect& bounds = run._bounds;
+	run._maskStride = getMaskStride(bounds._w);
+	run._mask.assign(run._maskStride * bounds._h, 0);
+	x = 0;
+	for(int i = 0; i < length; ++i){
+		if(text[i] == '\n') continue;
+		const Glyph& glyph = font._glyphs[static_cast<int>(text[i] - ' ')];
+		const uint64_t* glyphMask = font._masks.data() + glyph._maskOffset;
+		int glyphStride = getMaskStride(glyph._width);
+		int maskRowBase = font._baseLine + glyph._yoffset - bounds._y;
+		int maskColBase = x + glyph._xoffset - bounds._x;
+		for(int glyphRow = 0; glyphRow < glyph._height; ++glyphRow){
+			uint64_t* dst = run._mask.data() + ((maskRowBase + glyphRow) * run._maskStride);
+			orMaskBits(dst, maskColBase, glyphMask + (glyphRow * glyphStride), glyph._width);
+		}
+		x += glyph._xadvance + font._glyphSpace;
+	}
+}
+
+//
+// Returns the index of the cached run of a string, building it if not cached. Runs are only 
+// looked up and built on the calling thread (never while rasterizing). If every run is pinned 
+// the pending commands are flushed to free one.
+//
+static int findTextRun(ResourceKey_t fontKey, const char* text, int length)
+{
+	static std::string key;
+
+	key.assign(reinterpret_cast<const char*>(&fontKey), sizeof(fontKey));
+	key.append(text, length);
+	auto search = textRunIds.find(key);
+	if(search != textRunIds.end()){
+		textRuns[search->second]._lastUse = ++textRunUseCount;
+		return search->second;
+	}
+
+	FontResource* resource = fonts.find(fontKey);
+	assert(resource != nullptr);
+
+	int runid {-1};
+	if(static_cast<int>(textRuns.size()) < maxTextRuns){
+		textRuns.emplace_back();
+		runid = static_cast<int>(textRuns.size()) - 1;
+	}
+	else{
+		bool isPinned {true};
+		for(int i = 0; i < maxTextRuns; ++i){
+			bool isRunPinned = (textRuns[i]._pinnedFlush == flushCount);
+			if(runid == -1 || (isPinned && !isRunPinned) || 
+			   (isPinned == isRunPinned && textRuns[i]._lastUse < textRuns[runid]._lastUse)){
+				runid = i;
+				isPinned = isRunPinned;
+			}
+		}
+		if(isPinned)
+			flushDrawCommands();
+		if(!textRuns[runid]._key.empty())
+			textRunIds.erase(textRuns[runid]._key);
+	}
+
+	TextRun& run = textRuns[runid];
+	run._key = key;
+	run._fontKey = fontKey;
+	run._lastUse = ++textRunUseCount;
+	run._pinnedFlush = -1;
+	buildTextRun(resource->_font, text, length, run);
+	textRunIds.emplace(key, runid);
+	return runid;
+}
+
+//
+// Frees the runs of an unloaded font for reuse.
+//
+static void purgeTextRuns(ResourceKey_t fontKey)
+{
+	for(auto& run : textRuns){
+		if(run._key.empty() || run._fontKey != fontKey)
+			continue;
+		textRunIds.erase(run._key);
+		run._key.clear();
+		run._lastUse = 0;
+	}
+}
+
 void unloadFont(ResourceKey_t fontKey)
 {
-	auto search = fonts.find(fontKey);
-	if(search == fonts.end()){
+	FontResource* resource = fonts.find(fontKey);
+	if(resource == nullptr){
 		log::log(log::LVL_WARN, log::msg_gfx_unloading_nonexistent_resource, "font" + std::to_string(fontKey));
 		return;
 	}
 
-	FontResource& resource = search->second;
-	resource._referenceCount--;
-	if(resource._referenceCount <= 0 && resource._name != errorFontName){
+	resource->_referenceCount--;
+	if(resource->_referenceCount <= 0 && fontKey != errorFontKey){
 		log::log(log::LVL_INFO, log::msg_gfx_unload_font_success, "key=" + std::to_string(fontKey));
-		fonts.erase(search);
+		fontKeys.erase(resource->_name);
+		fonts.erase(fontKey);
+		purgeTextRuns(fontKey);
 	}
 }
 
 const Font* getFont(ResourceKey_t fontKey)
 {
-	auto search = fonts.find(fontKey);
-	if(search == fonts.end()){
+	FontResource* resource = fonts.find(fontKey);
+	if(resource == nullptr){
 		log::log(log::LVL_WARN, log::msg_gfx_unloading_nonexistent_resource, "font" + std::to_string(fontKey));
 		return nullptr;
 	}
-	return &(search->second._font);
+	return &(resource->_font);
 }
 
 int getSpriteCount(ResourceKey_t sheetKey)
 {
-	auto search = spritesheets.find(sheetKey);
-	assert(search != spritesheets.end());
-	return search->second._sheet._sprites.size();
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	assert(resource != nullptr);
+	return resource->_sheet._sprites.size();
 }
 
-void onWindowResize(Vector2i windowSize)
+ResourceKey_t createTileMap(ResourceKey_t sheetKey, Vector2i tileSize, Vector2i mapSize)
 {
-	setViewport(iRect{0, 0, windowSize._x, windowSize._y});
-	for(auto& screen : screens)
-		autoAdjustScreen(windowSize, screen);
+	assert(spritesheets.contains(sheetKey));
+	assert(tileSize._x > 0 && tileSize._y > 0);
+	assert(mapSize._x > 0 && mapSize._y > 0);
+
+	TileMapResource map {};
+	map._sheetKey = sheetKey;
+	map._mapSize = mapSize;
+	map._tileSize = tileSize;
+	map._chunkCount = Vector2i{
+		(mapSize._x + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE,
+		(mapSize._y + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE
+	};
+	map._tiles.assign(mapSize._x * mapSize._y, EMPTY_TILE);
+	map._chunks.resize(map._chunkCount._x * map._chunkCount._y);
+	for(auto& chunk : map._chunks)
+		chunk._isStale = true;
+	map._pinnedFlush = -1;
+
+	ResourceKey_t mapKey = tileMaps.insert(std::move(map));
+
+	std::stringstream ss {};
+	ss << "key:" << mapKey << " cells:" << mapSize._x << "x" << mapSize._y << " tile:" << tileSize._x << "x" << tileSize._y;
+	log::log(log::LVL_INFO, log::msg_gfx_created_tilemap, ss.str());
+
+	return mapKey;
 }
 
-void clearWindowColor(Color4f color)
+void destroyTileMap(ResourceKey_t mapKey)
 {
-	glClearColor(color._r, color._g, color._b, color._a); 
-	glClear(GL_COLOR_BUFFER_BIT);
+	if(!tileMaps.contains(mapKey)){
+		log::log(log::LVL_WARN, log::msg_gfx_unloading_nonexistent_resource, "tilemap" + std::to_string(mapKey));
+		return;
+	}
+	flushDrawCommands();
+	tileMaps.erase(mapKey);
 }
 
-void clearScreenTransparent(int screenid)
+static TileMapResource& getTileMap(ResourceKey_t mapKey)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	memset(screens[screenid]._pxColors, ALPHA_KEY, screens[screenid]._pxCount * sizeof(Color4u));
+	TileMapResource* map = tileMaps.find(mapKey);
+	assert(map != nullptr);
+	return *map;
 }
 
-void clearScreenShade(int shade, int screenid)
+static bool isCellInMap(const TileMapResource& map, Vector2i cell)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	shade = std::max(0, std::min(shade, 255));
-	memset(screens[screenid]._pxColors, shade, screens[screenid]._pxCount * sizeof(Color4u));
+	return 0 <= cell._x && cell._x < map._mapSize._x && 0 <= cell._y && cell._y < map._mapSize._y;
 }
 
-void clearScreenColor(Color4u color, int screenid)
+//
+// Pending commands draw the chunks as they were when recorded, as in immediate mode, thus are
+// flushed before a chunk they may draw is made stale. A stale chunk is drawn by no pending
+// command as drawing a chunk rebuilds it.
+//
+void setTile(Vector2i cell, SpriteID_t spriteid, ResourceKey_t mapKey)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	Screen& screen = screens[screenid];
-	for(int px = 0; px < screen._pxCount; ++px)
-		screen._pxColors[px] = color;
+	TileMapResource& map = getTileMap(mapKey);
+	if(!isCellInMap(map, cell))
+		return;
+	SpriteID_t& tile = map._tiles[cell._x + (cell._y * map._mapSize._x)];
+	if(tile == spriteid)
+		return;
+	int chunkCol = cell._x / TILE_CHUNK_SIZE;
+	int chunkRow = cell._y / TILE_CHUNK_SIZE;
+	TileChunk& chunk = map._chunks[chunkCol + (chunkRow * map._chunkCount._x)];
+	if(!chunk._isStale && map._pinnedFlush == flushCount)
+		flushDrawCommands();
+	tile = spriteid;
+	chunk._isStale = true;
 }
 
-void drawSprite(Vector2i position, ResourceKey_t sheetKey, int spriteid, int screenid, 
-								bool mirrorX, bool mirrorY)
+SpriteID_t getTile(Vector2i cell, ResourceKey_t mapKey)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	auto& screen = screens[screenid];
+	const TileMapResource& map = getTileMap(mapKey);
+	if(!isCellInMap(map, cell))
+		return EMPTY_TILE;
+	return map._tiles[cell._x + (cell._y * map._mapSize._x)];
+}
 
-	auto search = spritesheets.find(sheetKey);
-	if(search == spritesheets.end()){
-		assert(0);
-	}
-	const auto& sheet = search->second._sheet;
-	const Color4u* const * sheetPxs = sheet._image.getPixels();
+Vector2i getTileMapSize(ResourceKey_t mapKey)
+{
+	return getTileMap(mapKey)._mapSize;
+}
 
-	assert(0 <= spriteid);
+Vector2i getTileMapTileSize(ResourceKey_t mapKey)
+{
+	return getTileMap(mapKey)._tileSize;
+}
 
-	if(sheetKey == errorSpritesheetKey)
-		spriteid = (spriteid < sheet._sprites.size()) ? spriteid : 0;
-	else
+//
+// Calls f(chunk, chunkPosition) for each chunk of a map drawn at 'position' which overlaps
+// the clip rect.
+//
+template<typename Map, typename F>
+static void forEachVisibleTileChunk(Map& map, Vector2i position, const iRect& clip, F f)
+{
+	int chunkWidth = TILE_CHUNK_SIZE * map._tileSize._x;
+	int chunkHeight = TILE_CHUNK_SIZE * map._tileSize._y;
+	int xmin = clip._x - position._x;
+	int ymin = clip._y - position._y;
+	int xmax = clip._x + clip._w - 1 - position._x;
+	int ymax = clip._y + clip._h - 1 - position._y;
+	if(xmax < 0 || ymax < 0)
+		return;
+	int colBegin = std::max(0, xmin) / chunkWidth;
+	int rowBegin = std::max(0, ymin) / chunkHeight;
+	int colEnd = std::min(map._chunkCount._x, (xmax / chunkWidth) + 1);
+	int rowEnd = std::min(map._chunkCount._y, (ymax / chunkHeight) + 1);
+	for(int row = rowBegin; row < rowEnd; ++row)
+		for(int col = colBegin; col < colEnd; ++col)
+			f(map._chunks[col + (row * map._chunkCount._x)], 
+			  Vector2i{position._x + (col * chunkWidth), position._y + (row * chunkHeight)});
+}
+
+//
+// Rasterizes the tiles of a chunk into its cache. Tiles with invalid sprite ids (or of an 
+// unloaded spritesheet) are left transparent.
+//
+static void rebuildTileChunk(const TileMapResource& map, TileChunk& chunk)
+{
+	int index = static_cast<int>(&chunk - map._chunks.data());
+	int cellColBegin = (index % map._chunkCount._x) * TILE_CHUNK_SIZE;
+	int cellRowBegin = (index / map._chunkCount._x) * TILE_CHUNK_SIZE;
+	int cellColEnd = std::min(cellColBegin + TILE_CHUNK_SIZE, map._mapSize._x);
+	int cellRowEnd = std::min(cellRowBegin + TILE_CHUNK_SIZE, map._mapSize._y);
+
+	Spritesheet& cache = chunk._cache;
+	Vector2i size {(cellColEnd - cellColBegin) * map._tileSize._x, (cellRowEnd - cellRowBegin) * map._tileSize._y};
+	if(cache._image.getSize() == size)
+		cache._image.clear(Color4u{ALPHA_KEY, ALPHA_KEY, ALPHA_KEY, ALPHA_KEY});
+	else
+		cache._image.create(size, Color4u{ALPHA_KEY, ALPHA_KEY, ALPHA_KEY, ALPHA_KEY});
+
+	const SpritesheetResource* resource = spritesheets.find(map._sheetKey);
+	for(int cellRow = cellRowBegin; resource != nullptr && cellRow < cellRowEnd; ++cellRow){
+		for(int cellCol = cellColBegin; cellCol < cellColEnd; ++cellCol){
+			SpriteID_t spriteid = map._tiles[cellCol + (cellRow * map._mapSize._x)];
+			if(spriteid < 0 || spriteid >= static_cast<int>(resource->_sheet._sprites.size()))
+				continue;
+			const Sprite& sprite = resource->_sheet._sprites[spriteid];
+			BmpView spritePxs = resource->_sheet._image.getView(sprite._position, sprite._size);
+			int width = std::min(sprite._size._x, map._tileSize._x);
+			int height = std::min(sprite._size._y, map._tileSize._y);
+			int x = (cellCol - cellColBegin) * map._tileSize._x;
+			int y = (cellRow - cellRowBegin) * map._tileSize._y;
+			for(int row = 0; row < height; ++row)
+				std::copy_n(spritePxs.getRow(row), width, cache._image.getRow(y + row) + x);
+		}
+	}
+
+	cache._sprites.resize(1);
+	Sprite& sprite = cache._sprites[0];
+	sprite._position = Vector2i{0, 0};
+	sprite._size = size;
+	sprite._origin = Vector2i{0, 0};
+	buildSpriteSpans(cache._image, sprite);
+	cache._indices.clear();
+	chunk._isStale = false;
+}
+
+void onWindowResize(Vector2i windowSize)
+{
+	setViewport(iRect{0, 0, windowSize._x, windowSize._y});
+	for(auto& screen : screens)
+		autoAdjustScreen(windowSize, screen);
+}
+
+void clearWindowColor(Color4f color)
+{
+	backend->clearWindow(color);
+}
+
+//
+// Rasterization.
+//
+// The raster functions write only the pixels of the screen which lie within the clip rect (which
+// must lie within the screen) and never mark the screen dirty; dirtying is done by the caller
+// from the bounds of the draw command so that multiple threads can rasterize disjoint clip rects 
+// of the same screen concurrently.
+//
+// The raster functions are templates specialized on the pixel mode (and sprites also on 
+// mirroring) so that no per-pixel tests remain in the inner loops; executeDrawCommand makes a
+// single runtime dispatch per draw into the right instantiation. Pixels are written unshaded 
+// and, in PixelMode::SHADER, each run of written pixels is then shaded in place.
+//
+
+static inline bool isInClip(const iRect& clip, int x, int y)
+{
+	return clip._x <= x && x < clip._x + clip._w && clip._y <= y && y < clip._y + clip._h;
+}
+
+//
+// The raster functions are also templates on the type of the pixels they write; Color4u for 
+// ColorMode::FULL_RGB screens and uint8_t (palette indices) for ColorMode::INDEXED screens. 
+// Indexed screens are never shaded.
+//
+template<typename Pixel>
+static inline Pixel* getScreenPixels(Screen& screen)
+{
+	if constexpr(std::is_same_v<Pixel, Color4u>)
+		return screen._pxColors;
+	else
+		return screen._pxIndices;
+}
+
+//
+// A view of the quantized pixels of a sprite; the uint8_t counterpart of BmpView.
+//
+struct IndexView
+{
+	const uint8_t* _pixels;
+	int _stride;
+
+	const uint8_t* getRow(int row) const {return _pixels + (row * _stride);}
+	uint8_t getPixel(int row, int col) const {return _pixels[(row * _stride) + col];}
+};
+
+template<typename Pixel>
+static inline auto getSpritePixels(const Spritesheet& sheet, const Sprite& sprite)
+{
+	if constexpr(std::is_same_v<Pixel, Color4u>)
+		return sheet._image.getView(sprite._position, sprite._size);
+	else{
+		int stride = sheet._image.getWidth();
+		return IndexView{sheet._indices.data() + sprite._position._x + (sprite._position._y * stride), stride};
+	}
+}
+
+template<PixelMode Mode, typename Pixel>
+static inline void shadeRun(const RowShader& shader, Pixel* pxColors, int count, int pxx, int pxy)
+{
+	static_assert(Mode == PixelMode::NO_SHADER || std::is_same_v<Pixel, Color4u>);
+	if constexpr(Mode == PixelMode::SHADER)
+		shader._rowShader(shader._shader, pxColors, count, pxx, pxy);
+}
+
+template<PixelMode Mode, typename Pixel>
+static inline void rasterPixel(Screen& screen, const iRect& clip, const RowShader& shader, int x, int y, 
+                               Pixel color)
+{
+	if(!isInClip(clip, x, y))
+		return;
+	Pixel* px = getScreenPixels<Pixel>(screen) + x + (y * screen._resolution._x);
+	*px = color;
+	shadeRun<Mode>(shader, px, 1, x, y);
+}
+
+template<typename Pixel>
+static inline void fillPixels(Pixel* dst, int count, Pixel color)
+{
+	if constexpr(std::is_same_v<Pixel, Color4u>)
+		fillRow(dst, color, count);
+	else
+		memset(dst, color, count);
+}
+
+//
+// The pixel a color is drawn as on the screen; on indexed screens its nearest palette color.
+//
+template<typename Pixel>
+static inline Pixel toScreenPixel(const Screen& screen, Color4u color)
+{
+	if constexpr(std::is_same_v<Pixel, Color4u>)
+		return color;
+	else
+		return static_cast<uint8_t>(findPaletteIndex(screen._palette, color));
+}
+
+//
+// Writes the run [xmin, xmax] of row y (clipped) in color.
+//
+template<PixelMode Mode, typename Pixel>
+static inline void rasterRun(Screen& screen, const iRect& clip, const RowShader& shader, int xmin, 
+                             int xmax, int y, int shaderY, Pixel color)
+{
+	if(y < clip._y || y >= clip._y + clip._h)
+		return;
+	xmin = std::max(xmin, clip._x);
+	xmax = std::min(xmax, clip._x + clip._w - 1);
+	if(xmin > xmax)
+		return;
+	Pixel* px = getScreenPixels<Pixel>(screen) + xmin + (y * screen._resolution._x);
+	fillPixels(px, xmax - xmin + 1, color);
+	shadeRun<Mode>(shader, px, xmax - xmin + 1, xmin, shaderY);
+}
+
+//
+// Rasterizes a clear. Rows are filled with wide stores whatever the color; clears which span
+// whole rows are filled as a single run. Clears are never shaded.
+//
+template<typename Pixel>
+static void rasterClear(Screen& screen, const iRect& clip, Pixel color)
+{
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+	int width = screen._resolution._x;
+	if(clip._x == 0 && clip._w == width){
+		fillPixels(pixels + (clip._y * width), clip._w * clip._h, color);
+		return;
+	}
+	for(int row = clip._y; row < clip._y + clip._h; ++row)
+		fillPixels(pixels + clip._x + (row * width), clip._w, color);
+}
+
+template<PixelMode Mode, bool MirrorX, bool MirrorY, typename Pixel>
+static void rasterSprite(Screen& screen, const iRect& clip, const RowShader& shader, Vector2i position, 
+                         const Spritesheet& sheet, int spriteid)
+{
+	auto& sprite = sheet._sprites[spriteid];
+	auto spritePxs = getSpritePixels<Pixel>(sheet, sprite);
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+
+	int screenRowBase = position._y - sprite._origin._y;
+	int screenColBase = position._x - sprite._origin._x;
+	int spriteRowMax = sprite._size._y - 1;
+	int spriteColMax = sprite._size._x - 1;
+
+	//
+	// Clip the sprite to the clip rect once up front; [spriteRowBegin, spriteRowEnd) and 
+	// [spriteColBegin, spriteColEnd) are the visible rows and cols w.r.t sprite space.
+	//
+	int spriteRowBegin = std::max(0, clip._y - screenRowBase);
+	int spriteRowEnd = std::min(sprite._size._y, clip._y + clip._h - screenRowBase);
+	int spriteColBegin = std::max(0, clip._x - screenColBase);
+	int spriteColEnd = std::min(sprite._size._x, clip._x + clip._w - screenColBase);
+	if(spriteRowBegin >= spriteRowEnd || spriteColBegin >= spriteColEnd)
+		return;
+
+	//
+	// Unshaded sprites with short spans are blitted whole rows at a time by the keyed kernels. 
+	// Indexed sprites always go span by span; at a byte per pixel even short spans are cheap.
+	//
+	if constexpr(std::is_same_v<Pixel, Color4u> && Mode == PixelMode::NO_SHADER){
+		if(!sprite._isSpanBlit){
+			int screenColBegin = screenColBase + spriteColBegin;
+			int colCount = spriteColEnd - spriteColBegin;
+
+			//
+			// When mirrored in x, the visible cols map to the source cols 
+			// [spriteColMax - spriteColEnd + 1, spriteColMax - spriteColBegin] read in reverse.
+			//
+			int srcColBegin = MirrorX ? spriteColMax - spriteColEnd + 1 : spriteColBegin;
+
+			for(int spriteRow = spriteRowBegin; spriteRow < spriteRowEnd; ++spriteRow){
+				int screenRow = screenRowBase + spriteRow;
+				int srcRow = MirrorY ? spriteRowMax - spriteRow : spriteRow; 
+				const Color4u* src = spritePxs.getRow(srcRow) + srcColBegin;
+				Color4u* dst = pixels + screenColBegin + (screenRow * screen._resolution._x);
+				if constexpr(MirrorX)
+					blitRowKeyedReversed(dst, src, colCount);
+				else
+					blitRowKeyed(dst, src, colCount);
+			}
+			return;
+		}
+	}
+
+	//
+	// Opaque spans are clipped to the visible cols and copied whole; transparent runs are never
+	// touched. Drawing with a shader always goes span by span as only spans can be shaded as 
+	// contiguous runs.
+	//
+	const std::vector<SpriteSpan>& spans = MirrorX ? sprite._mirroredSpans : sprite._spans;
+	for(int spriteRow = spriteRowBegin; spriteRow < spriteRowEnd; ++spriteRow){
+		int screenRow = screenRowBase + spriteRow;
+		int screenRowOffset = screenRow * screen._resolution._x;
+		int spanRow = MirrorY ? spriteRowMax - spriteRow : spriteRow;
+		const Pixel* src = spritePxs.getRow(spanRow);
+		for(int i = sprite._rowSpans[spanRow]; i < sprite._rowSpans[spanRow + 1]; ++i){
+			const SpriteSpan& span = spans[i];
+			if(span._col >= spriteColEnd) break;
+			int colBegin = std::max(span._col, spriteColBegin);
+			int colEnd = std::min(span._col + span._count, spriteColEnd);
+			if(colBegin >= colEnd) continue;
+			int count = colEnd - colBegin;
+			Pixel* dst = pixels + screenRowOffset + screenColBase + colBegin;
+			if constexpr(MirrorX && std::is_same_v<Pixel, Color4u>)
+				copyRowReversed(dst, src + spriteColMax - colEnd + 1, count);
+			else if constexpr(MirrorX)
+				std::reverse_copy(src + spriteColMax - colEnd + 1, src + spriteColMax - colBegin + 1, dst);
+			else
+				memcpy(dst, src + colBegin, count * sizeof(Pixel));
+			shadeRun<Mode>(shader, dst, count, screenColBase + colBegin, screenRow);
+		}
+	}
+}
+
+template<PixelMode Mode, typename Pixel>
+static void rasterSprite(Screen& screen, const iRect& clip, const RowShader& shader, Vector2i position, 
+                         ResourceKey_t sheetKey, int spriteid, bool mirrorX, bool mirrorY)
+{
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	assert(resource != nullptr);
+	const auto& sheet = resource->_sheet;
+
+	assert(0 <= spriteid);
+
+	if(sheetKey == errorSpritesheetKey)
+		spriteid = (spriteid < sheet._sprites.size()) ? spriteid : 0;
+	else
 		assert(spriteid < sheet._sprites.size());
 
+	using Raster_t = void (*)(Screen&, const iRect&, const RowShader&, Vector2i, const Spritesheet&, int);
+	static constexpr Raster_t rasters[2][2] {
+		{&rasterSprite<Mode, false, false, Pixel>, &rasterSprite<Mode, false, true, Pixel>},
+		{&rasterSprite<Mode, true, false, Pixel>, &rasterSprite<Mode, true, true, Pixel>}
+	};
+	rasters[mirrorX][mirrorY](screen, clip, shader, position, sheet, spriteid);
+}
+
+template<PixelMode Mode, typename Pixel>
+static void rasterSpriteColumn(Screen& screen, const iRect& clip, const RowShader& shader, Vector2i position, 
+                               ResourceKey_t sheetKey, int spriteid, int colid)
+{
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	assert(resource != nullptr);
+	const auto& sheet = resource->_sheet;
+
+	assert(0 <= spriteid);
+	spriteid = spriteid < sheet._sprites.size() ? spriteid : 0; // may be an error sheet with 1 sprite.
 	auto& sprite = sheet._sprites[spriteid];
+	auto spritePxs = getSpritePixels<Pixel>(sheet, sprite);
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+
+	colid = std::clamp(colid, 0, sprite._size._x - 1);
+
+	int screenRow {0}, screenCol{0}, screenRowOffset{0};
+
+	screenCol = position._x + colid;
+
+	if(screenCol < clip._x || screenCol >= clip._x + clip._w) 
+		return;
+
+	//
+	// The pixel is drawn only if the col lies within one of the opaque spans of the row.
+	//
+	for(int spriteRow = 0; spriteRow < sprite._size._y; ++spriteRow){
+		screenRow = position._y + spriteRow;
+		if(screenRow < clip._y) continue;
+		if(screenRow >= clip._y + clip._h) break;
+		for(int i = sprite._rowSpans[spriteRow]; i < sprite._rowSpans[spriteRow + 1]; ++i){
+			const SpriteSpan& span = sprite._spans[i];
+			if(colid < span._col) break;
+			if(colid >= span._col + span._count) continue;
+			screenRowOffset = screenRow * screen._resolution._x;
+			Pixel* px = pixels + screenCol + screenRowOffset;
+			*px = spritePxs.getPixel(spriteRow, colid);
+			shadeRun<Mode>(shader, px, 1, screenCol, screenRow);
+			break;
+		}
+	}
+}
+
+//
+// Text is drawn by expanding the rows of the mask of its run, clipped to the clip rect. Unshaded
+// rgb rows are expanded by the masked fill kernel; shaded and indexed rows are filled (and 
+// shaded) as runs of set bits.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterText(Screen& screen, const iRect& clip, const RowShader& shader, Vector2i position, 
+                       const TextRun& run, Pixel color)
+{
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+
+	int screenRowBase = position._y + run._bounds._y;
+	int screenColBase = position._x + run._bounds._x;
+	int runRowBegin = std::max(0, clip._y - screenRowBase);
+	int runRowEnd = std::min(run._bounds._h, clip._y + clip._h - screenRowBase);
+	int runColBegin = std::max(0, clip._x - screenColBase);
+	int runColEnd = std::min(run._bounds._w, clip._x + clip._w - screenColBase);
+	if(runRowBegin >= runRowEnd || runColBegin >= runColEnd)
+		return;
+
+	for(int runRow = runRowBegin; runRow < runRowEnd; ++runRow){
+		int screenRow = screenRowBase + runRow;
+		Pixel* dst = pixels + screenColBase + (screenRow * screen._resolution._x);
+		const uint64_t* mask = run._mask.data() + (runRow * run._maskStride);
+		if constexpr(std::is_same_v<Pixel, Color4u> && Mode == PixelMode::NO_SHADER){
+			fillRowMasked(dst + runColBegin, mask, runColBegin, runColEnd - runColBegin, color);
+			continue;
+		}
+		int col = runColBegin;
+		while(col < runColEnd){
+			if(!isMaskBitSet(mask, col)){
+				++col;
+				continue;
+			}
+			int runBegin = col;
+			while(col < runColEnd && isMaskBitSet(mask, col))
+				++col;
+			std::fill(dst + runBegin, dst + col, color);
+			shadeRun<Mode>(shader, dst + runBegin, col - runBegin, screenColBase + runBegin, screenRow);
+		}
+	}
+}
+
+template<PixelMode Mode, typename Pixel>
+static void rasterBorderRectangle(Screen& screen, const iRect& clip, const RowShader& shader, iRect rect, 
+                                  Pixel color)
+{
+	int xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
+	int xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
+	int ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
+	int ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+
+	rasterRun<Mode>(screen, clip, shader, xmin, xmax, ymin, ymin, color);
+	rasterRun<Mode>(screen, clip, shader, xmin, xmax, ymax, ymax, color);
+
+	for(int y = ymin; y <= ymax; ++y){
+		rasterPixel<Mode>(screen, clip, shader, xmin, y, color);
+		rasterPixel<Mode>(screen, clip, shader, xmax, y, color);
+	}
+}
+
+template<PixelMode Mode, typename Pixel>
+static void rasterFillRectangle(Screen& screen, const iRect& clip, const RowShader& shader, iRect rect, 
+                                Pixel color)
+{
+	int xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
+	int xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
+	int ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
+	int ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+
+	for(int y = std::max(ymin, clip._y); y <= std::min(ymax, clip._y + clip._h - 1); ++y)
+		rasterRun<Mode>(screen, clip, shader, xmin, xmax, y, y, color);
+}
+
+//
+// Interpolates the channels of a gradient of 'steps' + 1 colors; rounds to nearest.
+//
+static inline Color4u lerpColor(Color4u from, Color4u to, int step, int steps)
+{
+	if(steps <= 0)
+		return from;
+	auto lerp = [step, steps](int a, int b){
+		int d = (b - a) * step;
+		return static_cast<uint8_t>(a + ((d + (d < 0 ? -steps : steps) / 2) / steps));
+	};
+	return Color4u{lerp(from._r, to._r), lerp(from._g, to._g), lerp(from._b, to._b), lerp(from._a, to._a)};
+}
+
+//
+// Vertical gradients fill each row in its color. Horizontal gradients are the same in every
+// row, thus the first row is interpolated and copied to the rest; shading then follows per row 
+// as shaders vary with the row.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterGradientRectangle(Screen& screen, const iRect& clip, const RowShader& shader, iRect rect,
+                                    Color4u from, Color4u to, GradientDirection direction)
+{
+	iRect r = clipRect(rect, clip);
+	if(r._w <= 0 || r._h <= 0)
+		return;
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+	int width = screen._resolution._x;
+
+	if(direction == GradientDirection::VERTICAL){
+		for(int row = r._y; row < r._y + r._h; ++row){
+			Pixel* dst = pixels + r._x + (row * width);
+			fillPixels(dst, r._w, toScreenPixel<Pixel>(screen, lerpColor(from, to, row - rect._y, rect._h - 1)));
+			shadeRun<Mode>(shader, dst, r._w, r._x, row);
+		}
+		return;
+	}
+
+	Pixel* first = pixels + r._x + (r._y * width);
+	for(int col = r._x; col < r._x + r._w; ++col)
+		first[col - r._x] = toScreenPixel<Pixel>(screen, lerpColor(from, to, col - rect._x, rect._w - 1));
+	for(int row = r._y + 1; row < r._y + r._h; ++row)
+		memcpy(static_cast<void*>(pixels + r._x + (row * width)), first, r._w * sizeof(Pixel));
+	if constexpr(Mode == PixelMode::SHADER){
+		for(int row = r._y; row < r._y + r._h; ++row)
+			shadeRun<Mode>(shader, pixels + r._x + (row * width), r._w, r._x, row);
+	}
+}
+
+//
+// The thresholds of the 4x4 Bayer matrix; pixel [x, y] is drawn in color1 if its threshold
+// (that of [x mod 4, y mod 4]) is less than the density.
+//
+static constexpr std::array<std::array<int, 4>, 4> bayerThresholds {{
+	{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}
+}};
+
+//
+// Each row of the dither repeats a 4 pixel pattern, filled with the pattern kernel.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterDitherRectangle(Screen& screen, const iRect& clip, const RowShader& shader, iRect rect,
+                                  Pixel color0, Pixel color1, int density)
+{
+	iRect r = clipRect(rect, clip);
+	if(r._w <= 0 || r._h <= 0)
+		return;
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+	int width = screen._resolution._x;
+	for(int row = r._y; row < r._y + r._h; ++row){
+		const auto& thresholds = bayerThresholds[row & 3];
+		std::array<Pixel, 4> pattern;
+		for(int i = 0; i < 4; ++i)
+			pattern[i] = (thresholds[i] < density) ? color1 : color0;
+		Pixel* dst = pixels + r._x + (row * width);
+		if constexpr(std::is_same_v<Pixel, Color4u>)
+			fillRowPattern(dst, pattern.data(), r._x & 3, r._w);
+		else{
+			for(int i = 0; i < r._w; ++i)
+				dst[i] = pattern[(r._x + i) & 3];
+		}
+		shadeRun<Mode>(shader, dst, r._w, r._x, row);
+	}
+}
+
+//
+// A line as the integer (Bresenham) walk of its pixels from p0 to p1, both inclusive. The walk
+// steps along the major axis (the axis of the larger delta) and step i is the pixel
+//
+//   major = major0 + (majorStep * i)
+//   minor = minor0 + (minorStep * floor(((2 * i * dminor) + dmajor) / (2 * dmajor)))
+//
+// for i in [0, dmajor]. Lines are clipped by restricting the walk to the range of steps 
+// [_begin, _end] which lie within the clip rect (the range is empty if _begin > _end) rather than
+// by moving the end points, thus a clipped line writes exactly the pixels of the unclipped line
+// which lie within the clip; the same pixels whichever the clip rect (screen, clip rect or raster
+// tile), and so lines drawn across tiles join seamlessly.
+//
+struct LineWalk
+{
+	int _major0, _minor0;
+	int _majorStep, _minorStep;
+	int _dmajor, _dminor;
+	bool _isSteep;
+	int _begin, _end;
+};
+
+static inline int64_t floorDiv(int64_t a, int64_t b)
+{
+	return (a >= 0) ? (a / b) : -((-a + b - 1) / b);
+}
+
+static inline int64_t ceilDiv(int64_t a, int64_t b)
+{
+	return -floorDiv(-a, b);
+}
+
+//
+// The Cohen-Sutherland outcode of a point w.r.t the clip rect; 0 if within it.
+//
+static inline int getOutcode(const iRect& clip, Vector2i p)
+{
+	int code {0};
+	if(p._x < clip._x) code |= 1;
+	else if(p._x >= clip._x + clip._w) code |= 2;
+	if(p._y < clip._y) code |= 4;
+	else if(p._y >= clip._y + clip._h) code |= 8;
+	return code;
+}
+
+//
+// Lines with both end points within the clip (or both beyond the same edge) are trivially
+// accepted (rejected) by their outcodes, the rest have the step range of each axis solved from
+// the walk equation.
+//
+static LineWalk makeLineWalk(Vector2i p0, Vector2i p1, const iRect& clip)
+{
+	int dx = p1._x - p0._x;
+	int dy = p1._y - p0._y;
+
+	LineWalk walk;
+	walk._isSteep = std::abs(dy) > std::abs(dx);
+	int dmajor = walk._isSteep ? dy : dx;
+	int dminor = walk._isSteep ? dx : dy;
+	walk._major0 = walk._isSteep ? p0._y : p0._x;
+	walk._minor0 = walk._isSteep ? p0._x : p0._y;
+	walk._majorStep = (dmajor < 0) ? -1 : 1;
+	walk._minorStep = (dminor < 0) ? -1 : 1;
+	walk._dmajor = std::abs(dmajor);
+	walk._dminor = std::abs(dminor);
+	walk._begin = 0;
+	walk._end = walk._dmajor;
+
+	int code0 = getOutcode(clip, p0);
+	int code1 = getOutcode(clip, p1);
+	if(code0 & code1){
+		walk._begin = 1;
+		walk._end = 0;
+		return walk;
+	}
+	if((code0 | code1) == 0)
+		return walk;
+
+	int majorMin = walk._isSteep ? clip._y : clip._x;
+	int majorMax = majorMin + (walk._isSteep ? clip._h : clip._w) - 1;
+	int minorMin = walk._isSteep ? clip._x : clip._y;
+	int minorMax = minorMin + (walk._isSteep ? clip._w : clip._h) - 1;
+
+	int64_t begin {walk._begin};
+	int64_t end {walk._end};
+
+	if(walk._majorStep > 0){
+		begin = std::max<int64_t>(begin, majorMin - walk._major0);
+		end = std::min<int64_t>(end, majorMax - walk._major0);
+	}
+	else{
+		begin = std::max<int64_t>(begin, walk._major0 - majorMax);
+		end = std::min<int64_t>(end, walk._major0 - majorMin);
+	}
+
+	//
+	// The minor offset floor(((2 * i * dminor) + dmajor) / (2 * dmajor)) must lie in [lo, hi]; it 
+	// never decreases with i, thus each bound is met from (or up to) a single step.
+	//
+	int64_t lo = (walk._minorStep > 0) ? (minorMin - walk._minor0) : (walk._minor0 - minorMax);
+	int64_t hi = (walk._minorStep > 0) ? (minorMax - walk._minor0) : (walk._minor0 - minorMin);
+	if(walk._dminor == 0){
+		if(lo > 0 || hi < 0)
+			end = begin - 1;
+	}
+	else{
+		int64_t twoMajor = int64_t{2} * walk._dmajor;
+		int64_t twoMinor = int64_t{2} * walk._dminor;
+		begin = std::max(begin, ceilDiv((twoMajor * lo) - walk._dmajor, twoMinor));
+		end = std::min(end, ceilDiv((twoMajor * (hi + 1)) - walk._dmajor, twoMinor) - 1);
+	}
+
+	if(begin > end){
+		walk._begin = 1;
+		walk._end = 0;
+	}
+	else{
+		walk._begin = static_cast<int>(begin);
+		walk._end = static_cast<int>(end);
+	}
+	return walk;
+}
+
+static inline bool isLineWalkEmpty(const LineWalk& walk)
+{
+	return walk._begin > walk._end;
+}
+
+static inline Vector2i getLineWalkPixel(const LineWalk& walk, int step)
+{
+	int64_t numerator = (int64_t{2} * step * walk._dminor) + walk._dmajor;
+	int minor = walk._minor0 + (walk._minorStep * static_cast<int>(numerator / std::max(1, 2 * walk._dmajor)));
+	int major = walk._major0 + (walk._majorStep * step);
+	return walk._isSteep ? Vector2i{minor, major} : Vector2i{major, minor};
+}
+
+//
+// The bounds of the pixels of a line within the clip; those of the first and last steps as the
+// walk is monotonic in both axes.
+//
+static iRect calculateLineBounds(Vector2i p0, Vector2i p1, const iRect& clip)
+{
+	LineWalk walk = makeLineWalk(p0, p1, clip);
+	if(isLineWalkEmpty(walk))
+		return iRect{0, 0, 0, 0};
+	Vector2i first = getLineWalkPixel(walk, walk._begin);
+	Vector2i last = getLineWalkPixel(walk, walk._end);
+	int xmin = std::min(first._x, last._x);
+	int ymin = std::min(first._y, last._y);
+	return iRect{xmin, ymin, std::max(first._x, last._x) - xmin + 1, std::max(first._y, last._y) - ymin + 1};
+}
+
+//
+// Walks the steps of the line within the clip with the error term of the walk equation. Shallow
+// lines are written as the horizontal runs of pixels they have on each row (shaded per run), 
+// steep lines pixel by pixel.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterLine(Screen& screen, const iRect& clip, const RowShader& shader, Vector2i p0, Vector2i p1, 
+                       Pixel color)
+{
+	LineWalk walk = makeLineWalk(p0, p1, clip);
+	if(isLineWalkEmpty(walk))
+		return;
+
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+	int width = screen._resolution._x;
+
+	int twoMajor = std::max(1, 2 * walk._dmajor);
+	int twoMinor = 2 * walk._dminor;
+	int64_t numerator = (int64_t{2} * walk._begin * walk._dminor) + walk._dmajor;
+	int error = static_cast<int>(numerator % twoMajor);
+	int minor = walk._minor0 + (walk._minorStep * static_cast<int>(numerator / twoMajor));
+	int major = walk._major0 + (walk._majorStep * walk._begin);
+
+	if(walk._isSteep){
+		for(int step = walk._begin; step <= walk._end; ++step){
+			Pixel* px = pixels + minor + (major * width);
+			*px = color;
+			shadeRun<Mode>(shader, px, 1, minor, major);
+			major += walk._majorStep;
+			error += twoMinor;
+			if(error >= twoMajor){
+				error -= twoMajor;
+				minor += walk._minorStep;
+			}
+		}
+		return;
+	}
 
-	int screenRow {0}, screenCol{0}, screenRowOffset{0}, screenRowBase{0}, screenColBase{0},
-			spriteRowOffset{0}, spriteColOffset{0}, spriteRowMax{0}, spriteColMax{0};
-	screenRowBase = position._y - sprite._origin._y;
-	screenColBase = position._x - sprite._origin._x;
-	spriteRowMax = sprite._size._y - 1;
-	spriteColMax = sprite._size._x - 1;
-	for(int spriteRow = 0; spriteRow <= spriteRowMax; ++spriteRow){
-		screenRow = screenRowBase + spriteRow;
-		if(screenRow < 0) continue;
-		if(screenRow >= screen._resolution._y) break;
-		screenRowOffset = screenRow * screen._resolution._x;
-		spriteRowOffset = sprite._position._y + (mirrorY ? spriteRowMax - spriteRow : spriteRow); 
-		for(int spriteCol = 0; spriteCol <= spriteColMax; ++spriteCol){
-			screenCol = screenColBase + spriteCol;
-			if(screenCol < 0) continue;
-			if(screenCol >= screen._resolution._x) break;
-			spriteColOffset = sprite._position._x + (mirrorX ? spriteColMax - spriteCol : spriteCol); 
-			const Color4u& color = sheetPxs[spriteRowOffset][spriteColOffset];
-			if(color._a == ALPHA_KEY) continue;
-			screen._pxColors[screenCol + screenRowOffset] =
-				(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, screenCol, screenRow) : color;
+	int runBegin = major;
+	for(int step = walk._begin; step <= walk._end; ++step){
+		int nextMajor = major + walk._majorStep;
+		error += twoMinor;
+		bool isRowEnd = (step == walk._end) || (error >= twoMajor);
+		if(isRowEnd){
+			int xmin = std::min(runBegin, major);
+			int count = std::abs(major - runBegin) + 1;
+			Pixel* px = pixels + xmin + (minor * width);
+			std::fill_n(px, count, color);
+			shadeRun<Mode>(shader, px, count, xmin, minor);
+			runBegin = nextMajor;
+		}
+		if(error >= twoMajor){
+			error -= twoMajor;
+			minor += walk._minorStep;
 		}
+		major = nextMajor;
 	}
 }
 
-void drawSpriteColumn(Vector2i position, ResourceKey_t sheetKey, int spriteid, int colid, int screenid)
+//
+// Draws the lines of a batch; the segments [points[i], points[i + 1]] for every stride'th i.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterLines(Screen& screen, const iRect& clip, const RowShader& shader, const Vector2i* points, 
+                        int count, int stride, Pixel color)
+{
+	for(int i = 0; i + 1 < count; i += stride)
+		rasterLine<Mode>(screen, clip, shader, points[i], points[i + 1], color);
+}
+
+//
+// The half width of row dy (w.r.t the center) of the run of an ellipse; the largest dx for which
+// [dx, dy] lies within the ellipse of radii (rx + 1/2, ry + 1/2), i.e.
+//
+//   (2dx)^2 (2ry + 1)^2 + (2dy)^2 (2rx + 1)^2 <= (2rx + 1)^2 (2ry + 1)^2
+//
+// or -1 if the row is beyond the ellipse.
+//
+static inline int getEllipseHalfWidth(Vector2i radii, int dy)
+{
+	int64_t w = (int64_t{2} * radii._x) + 1;
+	int64_t h = (int64_t{2} * radii._y) + 1;
+	int64_t rows = (h * h) - (int64_t{4} * dy * dy);
+	if(rows < 0)
+		return -1;
+	int64_t limit = (w * w * rows) / (4 * h * h);
+	int64_t dx = static_cast<int64_t>(std::sqrt(static_cast<double>(limit)));
+	while(dx * dx > limit) --dx;
+	while((dx + 1) * (dx + 1) <= limit) ++dx;
+	return static_cast<int>(dx);
+}
+
+static inline iRect getEllipseRect(const Ellipse& ellipse)
+{
+	return iRect{
+		ellipse._center._x - ellipse._radii._x, ellipse._center._y - ellipse._radii._y,
+		(2 * ellipse._radii._x) + 1, (2 * ellipse._radii._y) + 1
+	};
+}
+
+//
+// An outline row is the run of the fill row less the run shared by both rows beside it (as
+// those pixels have fill above and below) and less its end pixels, thus one run or two.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterEllipse(Screen& screen, const iRect& clip, const RowShader& shader, const Ellipse& ellipse,
+                          bool isFilled, Pixel color)
+{
+	if(!isRectOverlap(getEllipseRect(ellipse), clip))
+		return;
+	int cx = ellipse._center._x;
+	int cy = ellipse._center._y;
+	int rowBegin = std::max(cy - ellipse._radii._y, clip._y);
+	int rowEnd = std::min(cy + ellipse._radii._y, clip._y + clip._h - 1);
+	int below = getEllipseHalfWidth(ellipse._radii, rowBegin - cy - 1);
+	int halfWidth = getEllipseHalfWidth(ellipse._radii, rowBegin - cy);
+	for(int y = rowBegin; y <= rowEnd; ++y){
+		int above = getEllipseHalfWidth(ellipse._radii, y - cy + 1);
+		int inner = std::min({below, above, halfWidth - 1});
+		if(isFilled || inner < 0)
+			rasterRun<Mode>(screen, clip, shader, cx - halfWidth, cx + halfWidth, y, y, color);
+		else{
+			rasterRun<Mode>(screen, clip, shader, cx - halfWidth, cx - inner - 1, y, y, color);
+			rasterRun<Mode>(screen, clip, shader, cx + inner + 1, cx + halfWidth, y, y, color);
+		}
+		below = halfWidth;
+		halfWidth = above;
+	}
+}
+
+template<PixelMode Mode, typename Pixel>
+static void rasterEllipses(Screen& screen, const iRect& clip, const RowShader& shader, const Ellipse* ellipses,
+                           int count, bool isFilled, Pixel color)
+{
+	for(int i = 0; i < count; ++i)
+		rasterEllipse<Mode>(screen, clip, shader, ellipses[i], isFilled, color);
+}
+
+static iRect getPolygonRect(const Vector2i* vertices, int count)
+{
+	int xmin {vertices[0]._x}, ymin {vertices[0]._y}, xmax {vertices[0]._x}, ymax {vertices[0]._y};
+	for(int i = 1; i < count; ++i){
+		xmin = std::min(xmin, vertices[i]._x);
+		ymin = std::min(ymin, vertices[i]._y);
+		xmax = std::max(xmax, vertices[i]._x);
+		ymax = std::max(ymax, vertices[i]._y);
+	}
+	return iRect{xmin, ymin, xmax - xmin + 1, ymax - ymin + 1};
+}
+
+//
+// The run of each row spans the crossings of the row by the edges; an edge crosses row y at
+// x = x0 + (x1 - x0)(y - y0)/(y1 - y0) rounded to nearest, and a horizontal edge at its ends.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterPolygon(Screen& screen, const iRect& clip, const RowShader& shader, const Vector2i* vertices,
+                          int count, Pixel color)
+{
+	iRect rect = getPolygonRect(vertices, count);
+	if(!isRectOverlap(rect, clip))
+		return;
+	int rowBegin = std::max(rect._y, clip._y);
+	int rowEnd = std::min(rect._y + rect._h - 1, clip._y + clip._h - 1);
+	for(int y = rowBegin; y <= rowEnd; ++y){
+		int xmin {std::numeric_limits<int>::max()};
+		int xmax {std::numeric_limits<int>::min()};
+		for(int i = 0; i < count; ++i){
+			const Vector2i& a = vertices[i];
+			const Vector2i& b = vertices[(i + 1) % count];
+			if(y < std::min(a._y, b._y) || y > std::max(a._y, b._y))
+				continue;
+			if(a._y == b._y){
+				xmin = std::min({xmin, a._x, b._x});
+				xmax = std::max({xmax, a._x, b._x});
+				continue;
+			}
+			int64_t num = int64_t{b._x - a._x} * (y - a._y);
+			int64_t den = b._y - a._y;
+			if(den < 0){
+				num = -num;
+				den = -den;
+			}
+			int x = a._x + static_cast<int>(floorDiv((2 * num) + den, 2 * den));
+			xmin = std::min(xmin, x);
+			xmax = std::max(xmax, x);
+		}
+		if(xmin <= xmax)
+			rasterRun<Mode>(screen, clip, shader, xmin, xmax, y, y, color);
+	}
+}
+
+template<PixelMode Mode, typename Pixel>
+static void rasterPolygons(Screen& screen, const iRect& clip, const RowShader& shader, const PolygonRef* polygons,
+                           int count, Pixel color)
+{
+	for(int i = 0; i < count; ++i)
+		rasterPolygon<Mode>(screen, clip, shader, pointArena.data() + polygons[i]._firstPoint, 
+		                    polygons[i]._pointCount, color);
+}
+
+template<PixelMode Mode, typename Pixel>
+static void rasterPoint(Screen& screen, const iRect& clip, const RowShader& shader, Vector2i position, 
+                        Pixel color)
+{
+	rasterPixel<Mode>(screen, clip, shader, position._x, position._y, color);
+}
+
+//
+// Scatters a batch of points (with a color each if colors is not null); the points were clipped
+// to the screen when drawn, thus are only tested against the clip if it does not contain them all
+// (i.e. when rasterized in tiles).
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterPoints(Screen& screen, const iRect& clip, const RowShader& shader, const Vector2i* points, 
+                         const Pixel* colors, int count, bool isTested, Pixel color)
+{
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+	int width = screen._resolution._x;
+	for(int i = 0; i < count; ++i){
+		const Vector2i& p = points[i];
+		if(isTested && !isInClip(clip, p._x, p._y))
+			continue;
+		Pixel* px = pixels + p._x + (p._y * width);
+		*px = (colors != nullptr) ? colors[i] : color;
+		shadeRun<Mode>(shader, px, 1, p._x, p._y);
+	}
+}
+
+//
+// Chunks are drawn as sprites, thus as their opaque spans or by the keyed blit.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterTileMap(Screen& screen, const iRect& clip, const RowShader& shader, Vector2i position, 
+                          ResourceKey_t mapKey)
+{
+	const TileMapResource* map = tileMaps.find(mapKey);
+	assert(map != nullptr);
+	forEachVisibleTileChunk(*map, position, clip, [&](const TileChunk& chunk, Vector2i chunkPosition){
+		assert(!chunk._isStale);
+		rasterSprite<Mode, false, false, Pixel>(screen, clip, shader, chunkPosition, chunk._cache, 0);
+	});
+}
+
+//
+// Blits a region of another screen (or of the screen itself, provided the region does not 
+// overlap the destination). Unshaded rgb rows are copied by the keyed blit kernels; shaded rows
+// are copied and shaded as runs of opaque pixels. Indexed rows skip index 0, the transparent key.
+//
+template<PixelMode Mode, typename Pixel>
+static void rasterBlit(Screen& screen, const iRect& clip, const RowShader& shader, Vector2i position, 
+                       Screen& source, iRect region)
+{
+	iRect dstRect = clipRect({position._x, position._y, region._w, region._h}, clip);
+	if(rectArea(dstRect) == 0)
+		return;
+
+	Pixel* pixels = getScreenPixels<Pixel>(screen);
+	const Pixel* srcPixels = getScreenPixels<Pixel>(source);
+	int srcColBegin = region._x + dstRect._x - position._x;
+	int srcRowBase = region._y - position._y;
+	for(int row = dstRect._y; row < dstRect._y + dstRect._h; ++row){
+		Pixel* dst = pixels + dstRect._x + (row * screen._resolution._x);
+		const Pixel* src = srcPixels + srcColBegin + ((srcRowBase + row) * source._resolution._x);
+		if constexpr(!std::is_same_v<Pixel, Color4u>){
+			for(int col = 0; col < dstRect._w; ++col)
+				dst[col] = (src[col] != 0) ? src[col] : dst[col];
+		}
+		else if constexpr(Mode == PixelMode::NO_SHADER)
+			blitRowKeyed(dst, src, dstRect._w);
+		else{
+			int col {0};
+			while(col < dstRect._w){
+				if(src[col]._a == ALPHA_KEY){
+					++col;
+					continue;
+				}
+				int runBegin = col;
+				while(col < dstRect._w && src[col]._a != ALPHA_KEY)
+					++col;
+				memcpy(dst + runBegin, src + runBegin, (col - runBegin) * sizeof(Color4u));
+				shadeRun<Mode>(shader, dst + runBegin, col - runBegin, dstRect._x + runBegin, row);
+			}
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// DRAW COMMANDS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool isRectContained(const iRect& inner, const iRect& outer)
+{
+	return outer._x <= inner._x && outer._y <= inner._y &&
+	       inner._x + inner._w <= outer._x + outer._w && inner._y + inner._h <= outer._y + outer._h;
+}
+
+static iRect getScreenBounds(const Screen& screen)
+{
+	return iRect{0, 0, screen._resolution._x, screen._resolution._y};
+}
+
+//
+// Converts a rect (x,y,w,h) to the screen space bounds of the pixels it covers. Note the 
+// rectangle draw calls clamp their rects to the screen so they always write at least one pixel.
+//
+static iRect getClampedRectBounds(const Screen& screen, iRect rect)
+{
+	int xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
+	int xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
+	int ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
+	int ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+	return iRect{xmin, ymin, xmax - xmin + 1, ymax - ymin + 1};
+}
+
+static bool isBlitSource(int screenid)
+{
+	return std::find(blitSources.begin(), blitSources.end(), screenid) != blitSources.end();
+}
+
+static DrawCommand makeDrawCommand(DrawCommandType type, int screenid)
+{
+	assert(0 <= screenid && screenid < screens.size());
+	assert(!screens[screenid]._isLocked);
+	if(!blitSources.empty() && isBlitSource(screenid))
+		flushDrawCommands();
+	const Screen& screen = screens[screenid];
+	DrawCommand command {};
+	command._type = type;
+	command._isCulled = false;
+	command._screenid = screenid;
+	if(screen._xmode == PixelMode::SHADER && screen._rowShader != nullptr && screen._cmode == ColorMode::FULL_RGB)
+		command._shader = RowShader{screen._rowShader, screen._shader.get()};
+	else
+		command._shader = RowShader{nullptr, nullptr};
+	return command;
+}
+
+//
+// Calculates the bounds of a command; the union of the bounds each raster function would have
+// written, clipped to the screen.
+//
+static iRect calculateDrawBounds(const Screen& screen, const DrawCommand& command)
+{
+	iRect bounds {getScreenBounds(screen)};
+	switch(command._type)
+	{
+	case DrawCommandType::CLEAR:
+		return bounds;
+	case DrawCommandType::SPRITE:
+	case DrawCommandType::SPRITE_COLUMN:
+	{
+		const SpritesheetResource* resource = spritesheets.find(command._key);
+		assert(resource != nullptr);
+		const auto& sprites = resource->_sheet._sprites;
+		const Sprite& sprite = sprites[command._arg0 < sprites.size() ? command._arg0 : 0];
+		Vector2i position {command._p0};
+		if(command._type == DrawCommandType::SPRITE_COLUMN){
+			int colid = std::clamp(command._arg1, 0, sprite._size._x - 1);
+			return clipRect({position._x + colid, position._y, 1, sprite._size._y}, bounds);
+		}
+		iRect spriteRect {
+			position._x - sprite._origin._x, position._y - sprite._origin._y, 
+			sprite._size._x, sprite._size._y
+		};
+		return clipRect(spriteRect, bounds);
+	}
+	case DrawCommandType::TEXT:
+	{
+		const iRect& runBounds = textRuns[command._arg0]._bounds;
+		return clipRect({command._p0._x + runBounds._x, command._p0._y + runBounds._y, runBounds._w, runBounds._h}, bounds);
+	}
+	case DrawCommandType::BORDER_RECTANGLE:
+	case DrawCommandType::FILL_RECTANGLE:
+		return getClampedRectBounds(screen, {command._p0._x, command._p0._y, command._p1._x, command._p1._y});
+	case DrawCommandType::GRADIENT_RECTANGLE:
+	case DrawCommandType::DITHER_RECTANGLE:
+		return clipRect({command._p0._x, command._p0._y, command._p1._x, command._p1._y}, bounds);
+	case DrawCommandType::LINE:
+		return calculateLineBounds(command._p0, command._p1, bounds);
+	case DrawCommandType::LINE_LIST:
+	case DrawCommandType::LINE_STRIP:
+	{
+		const Vector2i* points = pointArena.data() + command._arg0;
+		int stride = (command._type == DrawCommandType::LINE_LIST) ? 2 : 1;
+		iRect linesRect {0, 0, 0, 0};
+		for(int i = 0; i + 1 < command._arg1; i += stride){
+			iRect lineRect = calculateLineBounds(points[i], points[i + 1], bounds);
+			if(rectArea(lineRect) == 0)
+				continue;
+			linesRect = (rectArea(linesRect) == 0) ? lineRect : rectUnion(linesRect, lineRect);
+		}
+		return linesRect;
+	}
+	case DrawCommandType::FILL_ELLIPSES:
+	case DrawCommandType::BORDER_ELLIPSES:
+	{
+		iRect shapesRect {0, 0, 0, 0};
+		for(int i = command._arg0; i < command._arg0 + command._arg1; ++i){
+			iRect shapeRect = clipRect(getEllipseRect(ellipseArena[i]), bounds);
+			if(rectArea(shapeRect) == 0)
+				continue;
+			shapesRect = (rectArea(shapesRect) == 0) ? shapeRect : rectUnion(shapesRect, shapeRect);
+		}
+		return shapesRect;
+	}
+	case DrawCommandType::FILL_POLYGONS:
+	{
+		iRect shapesRect {0, 0, 0, 0};
+		for(int i = command._arg0; i < command._arg0 + command._arg1; ++i){
+			const PolygonRef& polygon = polygonArena[i];
+			iRect shapeRect = clipRect(getPolygonRect(pointArena.data() + polygon._firstPoint, polygon._pointCount), bounds);
+			if(rectArea(shapeRect) == 0)
+				continue;
+			shapesRect = (rectArea(shapesRect) == 0) ? shapeRect : rectUnion(shapesRect, shapeRect);
+		}
+		return shapesRect;
+	}
+	case DrawCommandType::POINT:
+		return clipRect({command._p0._x, command._p0._y, 1, 1}, bounds);
+	case DrawCommandType::POINTS:
+	case DrawCommandType::COLORED_POINTS:
+	{
+		const Vector2i* points = pointArena.data() + command._arg0;
+		int xmin {points[0]._x}, ymin {points[0]._y}, xmax {points[0]._x}, ymax {points[0]._y};
+		for(int i = 1; i < command._arg1; ++i){
+			xmin = std::min(xmin, points[i]._x);
+			ymin = std::min(ymin, points[i]._y);
+			xmax = std::max(xmax, points[i]._x);
+			ymax = std::max(ymax, points[i]._y);
+		}
+		return iRect{xmin, ymin, xmax - xmin + 1, ymax - ymin + 1};
+	}
+	case DrawCommandType::TILE_MAP:
+	{
+		const TileMapResource* map = tileMaps.find(command._key);
+		assert(map != nullptr);
+		iRect mapRect {
+			command._p0._x, command._p0._y, 
+			map->_mapSize._x * map->_tileSize._x, map->_mapSize._y * map->_tileSize._y
+		};
+		return clipRect(mapRect, bounds);
+	}
+	case DrawCommandType::BLIT:
+		return clipRect({command._p0._x, command._p0._y, command._arg0, command._arg1}, bounds);
+	}
+	return bounds;
+}
+
+static void markDirty(Screen& screen, const iRect& bounds)
+{
+	if(rectArea(bounds) == 0)
+		return;
+	markDirty(screen, bounds._x, bounds._y, bounds._x + bounds._w - 1, bounds._y + bounds._h - 1);
+}
+
+//
+// Brings the tiles of a lazy screen which overlap rect up to date with the last clear of the
+// screen; stale tiles are cleared (and dirtied) only if drawn to since they were last cleared,
+// else they already hold the clear color. Tiles brought up to date for a draw are marked touched.
+//
+static void resolveLazyClear(Screen& screen, const iRect& rect, bool isDrawn)
+{
+	if(!screen._isLazyClear || rect._w <= 0 || rect._h <= 0)
+		return;
+	int colBegin = rect._x / SCREEN_CLEAR_TILE_SIZE;
+	int colEnd = (rect._x + rect._w - 1) / SCREEN_CLEAR_TILE_SIZE;
+	int rowBegin = rect._y / SCREEN_CLEAR_TILE_SIZE;
+	int rowEnd = (rect._y + rect._h - 1) / SCREEN_CLEAR_TILE_SIZE;
+	for(int row = rowBegin; row <= rowEnd; ++row){
+		for(int col = colBegin; col <= colEnd; ++col){
+			ClearTile& tile = screen._clearTiles[col + (row * screen._clearTileCount._x)];
+			if(tile._generation != screen._clearGeneration){
+				if(tile._isTouched){
+					iRect tileRect = clipRect({
+						col * SCREEN_CLEAR_TILE_SIZE, row * SCREEN_CLEAR_TILE_SIZE, 
+						SCREEN_CLEAR_TILE_SIZE, SCREEN_CLEAR_TILE_SIZE
+					}, getScreenBounds(screen));
+					if(screen._cmode == ColorMode::INDEXED)
+						rasterClear<uint8_t>(screen, tileRect, screen._clearIndex);
+					else
+						rasterClear<Color4u>(screen, tileRect, screen._clearColor);
+					markDirty(screen, tileRect);
+				}
+				tile._generation = screen._clearGeneration;
+				tile._isTouched = false;
+			}
+			tile._isTouched |= isDrawn;
+		}
+	}
+}
+
+static void resolveLazyClear(Screen& screen)
+{
+	resolveLazyClear(screen, getScreenBounds(screen), false);
+}
+
+//
+// A lazy clear only starts a new clear generation; every tile is stale until resolved. The 
+// pending draws to the screen (which, as blits read them, cannot be blit sources; see 
+// makeDrawCommand) are culled as the clear overwrites them. A change of clear color touches
+// every tile as none then holds the color.
+//
+static void clearScreenLazily(Screen& screen, const DrawCommand& command)
+{
+	for(DrawCommand& pending : drawCommands)
+		if(pending._screenid == command._screenid)
+			pending._isCulled = true;
+
+	uint8_t index = 0;
+	if(screen._cmode == ColorMode::INDEXED)
+		index = static_cast<uint8_t>(findPaletteIndex(screen._palette, command._color));
+	const Color4u& color = command._color;
+	const Color4u& last = screen._clearColor;
+	if(color._r != last._r || color._g != last._g || color._b != last._b || color._a != last._a || index != screen._clearIndex)
+		for(ClearTile& tile : screen._clearTiles)
+			tile._isTouched = true;
+
+	screen._clearColor = color;
+	screen._clearIndex = index;
+	++screen._clearGeneration;
+}
+
+template<typename Pixel>
+static inline Pixel getDrawPixel(const DrawCommand& command)
+{
+	if constexpr(std::is_same_v<Pixel, Color4u>)
+		return command._color;
+	else
+		return command._index;
+}
+
+template<typename Pixel>
+static inline Pixel getDrawPixel1(const DrawCommand& command)
+{
+	if constexpr(std::is_same_v<Pixel, Color4u>)
+		return command._color1;
+	else
+		return command._index1;
+}
+
+template<typename Pixel>
+static inline const Pixel* getPointPixels(const DrawCommand& command)
+{
+	if(command._type != DrawCommandType::COLORED_POINTS)
+		return nullptr;
+	if constexpr(std::is_same_v<Pixel, Color4u>)
+		return pointColorArena.data() + command._arg0;
+	else
+		return pointIndexArena.data() + command._arg0;
+}
+
+template<PixelMode Mode, typename Pixel>
+static void executeDrawCommand(Screen& screen, const DrawCommand& command, const iRect& clip)
+{
+	const RowShader& shader = command._shader;
+	Pixel color = getDrawPixel<Pixel>(command);
+	switch(command._type)
+	{
+	case DrawCommandType::CLEAR:
+		rasterClear(screen, clip, color);
+		break;
+	case DrawCommandType::SPRITE:
+		if(spritesheets.contains(command._key))
+			rasterSprite<Mode, Pixel>(screen, clip, shader, command._p0, command._key, command._arg0, 
+			                          command._mirrorX, command._mirrorY);
+		break;
+	case DrawCommandType::SPRITE_COLUMN:
+		if(spritesheets.contains(command._key))
+			rasterSpriteColumn<Mode, Pixel>(screen, clip, shader, command._p0, command._key, command._arg0, command._arg1);
+		break;
+	case DrawCommandType::TEXT:
+		if(fonts.contains(command._key))
+			rasterText<Mode>(screen, clip, shader, command._p0, textRuns[command._arg0], color);
+		break;
+	case DrawCommandType::BORDER_RECTANGLE:
+		rasterBorderRectangle<Mode>(screen, clip, shader, {command._p0._x, command._p0._y, command._p1._x, command._p1._y}, color);
+		break;
+	case DrawCommandType::FILL_RECTANGLE:
+		rasterFillRectangle<Mode>(screen, clip, shader, {command._p0._x, command._p0._y, command._p1._x, command._p1._y}, color);
+		break;
+	case DrawCommandType::GRADIENT_RECTANGLE:
+		rasterGradientRectangle<Mode, Pixel>(screen, clip, shader, {command._p0._x, command._p0._y, command._p1._x, command._p1._y},
+		                                     command._color, command._color1, static_cast<GradientDirection>(command._arg0));
+		break;
+	case DrawCommandType::DITHER_RECTANGLE:
+		rasterDitherRectangle<Mode>(screen, clip, shader, {command._p0._x, command._p0._y, command._p1._x, command._p1._y},
+		                            color, getDrawPixel1<Pixel>(command), command._arg0);
+		break;
+	case DrawCommandType::LINE:
+		rasterLine<Mode>(screen, clip, shader, command._p0, command._p1, color);
+		break;
+	case DrawCommandType::LINE_LIST:
+		rasterLines<Mode>(screen, clip, shader, pointArena.data() + command._arg0, command._arg1, 2, color);
+		break;
+	case DrawCommandType::LINE_STRIP:
+		rasterLines<Mode>(screen, clip, shader, pointArena.data() + command._arg0, command._arg1, 1, color);
+		break;
+	case DrawCommandType::FILL_ELLIPSES:
+	case DrawCommandType::BORDER_ELLIPSES:
+		rasterEllipses<Mode>(screen, clip, shader, ellipseArena.data() + command._arg0, command._arg1, 
+		                     command._type == DrawCommandType::FILL_ELLIPSES, color);
+		break;
+	case DrawCommandType::FILL_POLYGONS:
+		rasterPolygons<Mode>(screen, clip, shader, polygonArena.data() + command._arg0, command._arg1, color);
+		break;
+	case DrawCommandType::POINT:
+		rasterPoint<Mode>(screen, clip, shader, command._p0, color);
+		break;
+	case DrawCommandType::POINTS:
+	case DrawCommandType::COLORED_POINTS:
+		rasterPoints<Mode>(screen, clip, shader, pointArena.data() + command._arg0, getPointPixels<Pixel>(command),
+		                   command._arg1, !isRectContained(command._bounds, clip), color);
+		break;
+	case DrawCommandType::TILE_MAP:
+		if(tileMaps.contains(command._key))
+			rasterTileMap<Mode, Pixel>(screen, clip, shader, command._p0, command._key);
+		break;
+	case DrawCommandType::BLIT:
+		rasterBlit<Mode, Pixel>(screen, clip, shader, command._p0, screens[command._key], 
+		                        {command._p1._x, command._p1._y, command._arg0, command._arg1});
+		break;
+	}
+}
+
+static void executeDrawCommand(Screen& screen, const DrawCommand& command, iRect clip)
+{
+	if(command._isClipped)
+		clip = clipRect(clip, command._bounds);
+	if(screen._cmode == ColorMode::INDEXED)
+		executeDrawCommand<PixelMode::NO_SHADER, uint8_t>(screen, command, clip);
+	else if(command._shader._rowShader != nullptr)
+		executeDrawCommand<PixelMode::SHADER, Color4u>(screen, command, clip);
+	else
+		executeDrawCommand<PixelMode::NO_SHADER, Color4u>(screen, command, clip);
+}
+
+static void quantizeSpritesheet(Spritesheet& sheet, const Palette_t& palette)
+{
+	Vector2i size = sheet._image.getSize();
+	sheet._indices.resize(size._x * size._y);
+	for(int row = 0; row < size._y; ++row){
+		const Color4u* src = sheet._image.getRow(row);
+		uint8_t* dst = sheet._indices.data() + (row * size._x);
+		for(int col = 0; col < size._x; ++col)
+			dst[col] = static_cast<uint8_t>(findPaletteIndex(palette, src[col]));
+	}
+}
+
+//
+// Maps the command's color to the screen's palette and quantizes the spritesheet it draws if
+// not yet quantized. Done when the call is made (on the calling thread) so neither is ever 
+// done while rasterizing.
+//
+static void prepareIndexedDrawCommand(const Screen& screen, DrawCommand& command)
+{
+	command._index = static_cast<uint8_t>(findPaletteIndex(screen._palette, command._color));
+	if(command._type == DrawCommandType::DITHER_RECTANGLE)
+		command._index1 = static_cast<uint8_t>(findPaletteIndex(screen._palette, command._color1));
+	//
+	// The palette search is repeated only when the color changes as batches tend to be runs of
+	// few colors.
+	//
+	if(command._type == DrawCommandType::COLORED_POINTS){
+		pointIndexArena.resize(command._arg0 + command._arg1);
+		Color4u last {pointColorArena[command._arg0]};
+		int lastIndex {findPaletteIndex(screen._palette, last)};
+		for(int i = command._arg0; i < command._arg0 + command._arg1; ++i){
+			const Color4u& color = pointColorArena[i];
+			if(color._r != last._r || color._g != last._g || color._b != last._b || color._a != last._a){
+				last = color;
+				lastIndex = findPaletteIndex(screen._palette, last);
+			}
+			pointIndexArena[i] = static_cast<uint8_t>(lastIndex);
+		}
+	}
+	if(command._type == DrawCommandType::SPRITE || command._type == DrawCommandType::SPRITE_COLUMN){
+		SpritesheetResource* resource = spritesheets.find(command._key);
+		assert(resource != nullptr);
+		if(resource->_sheet._indices.empty())
+			quantizeSpritesheet(resource->_sheet, screen._palette);
+	}
+}
+
+//
+// Rebuilds the stale chunks of the map the command draws on screen, and quantizes them for 
+// indexed screens. Pending commands may draw the chunks as they were, thus are flushed before
+// any chunk is rebuilt.
+//
+static void prepareTileMapDrawCommand(const Screen& screen, const DrawCommand& command)
+{
+	if(rectArea(command._bounds) == 0)
+		return;
+	TileMapResource& map = getTileMap(command._key);
+	forEachVisibleTileChunk(map, command._p0, command._bounds, [&](TileChunk& chunk, Vector2i){
+		if(chunk._isStale){
+			flushDrawCommands();
+			rebuildTileChunk(map, chunk);
+		}
+		if(screen._cmode == ColorMode::INDEXED && chunk._cache._indices.empty())
+			quantizeSpritesheet(chunk._cache, screen._palette);
+	});
+}
+
+//
+// A recorded blit must read its source as the draw calls made before it left it. Commands are 
+// executed per screen (and tiles in parallel), thus the pending commands of the source are 
+// flushed before a blit is recorded and later draws to the source flush the blit (when the
+// command is made, thus before the resources it uses are prepared, e.g. its text run pinned).
+// The region read is brought up to date with any lazy clear of the source.
+//
+static void prepareBlitDrawCommand(const DrawCommand& command)
+{
+	int srcid = command._key;
+	if(drawMode == DrawMode::DEFERRED){
+		auto isSource = [srcid](const DrawCommand& pending){return pending._screenid == srcid;};
+		if(std::any_of(drawCommands.begin(), drawCommands.end(), isSource))
+			flushDrawCommands();
+		blitSources.push_back(srcid);
+	}
+	resolveLazyClear(screens[srcid], {command._p1._x, command._p1._y, command._arg0, command._arg1}, false);
+}
+
+//
+// Records the command in deferred mode, else executes it immediately.
+//
+static void submitDrawCommand(DrawCommand& command)
+{
+	Screen& screen = screens[command._screenid];
+	command._bounds = calculateDrawBounds(screen, command);
+	if(screen._isClipped){
+		command._bounds = clipRect(command._bounds, screen._clip);
+		command._isClipped = true;
+	}
+	if(screen._cmode == ColorMode::INDEXED)
+		prepareIndexedDrawCommand(screen, command);
+	if(command._type == DrawCommandType::TILE_MAP)
+		prepareTileMapDrawCommand(screen, command);
+	if(command._type == DrawCommandType::BLIT)
+		prepareBlitDrawCommand(command);
+	if(drawMode == DrawMode::DEFERRED){
+		drawCommands.push_back(command);
+		return;
+	}
+	if(rectArea(command._bounds) == 0)
+		return;
+	resolveLazyClear(screen, command._bounds, true);
+	markDirty(screen, command._bounds);
+	executeDrawCommand(screen, command, getScreenBounds(screen));
+}
+
+//
+// Fills write every pixel of their rect regardless of color or shader.
+//
+static bool isFillDrawCommand(const DrawCommand& command)
+{
+	switch(command._type)
+	{
+	case DrawCommandType::CLEAR:
+	case DrawCommandType::FILL_RECTANGLE:
+	case DrawCommandType::GRADIENT_RECTANGLE:
+	case DrawCommandType::DITHER_RECTANGLE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//
+// Marks the commands of a screen which need not be executed. Everything prior to the last clear 
+// is overwritten by the clear, and any command whose bounds are contained within the bounds of
+// a later fill (or clipped clear) is overwritten by the fill.
+//
+static void cullDrawCommands(DrawCommand* begin, DrawCommand* end)
+{
+	std::array<iRect, maxCullingFills> fills;
+	int fillCount {0};
+	bool isCleared {false};
+	for(DrawCommand* command = end - 1; command >= begin; --command){
+		if(isCleared || command->_bounds._w == 0 || command->_bounds._h == 0){
+			command->_isCulled = true;
+			continue;
+		}
+		for(int i = 0; i < fillCount; ++i){
+			if(isRectContained(command->_bounds, fills[i])){
+				command->_isCulled = true;
+				break;
+			}
+		}
+		if(command->_isCulled)
+			continue;
+		if(command->_type == DrawCommandType::CLEAR && !command->_isClipped)
+			isCleared = true;
+		else if(isFillDrawCommand(*command)){
+			if(fillCount < maxCullingFills)
+				fills[fillCount++] = command->_bounds;
+			else{
+				int smallest {0};
+				for(int i = 1; i < fillCount; ++i)
+					if(rectArea(fills[i]) < rectArea(fills[smallest]))
+						smallest = i;
+				if(rectArea(fills[smallest]) < rectArea(command->_bounds))
+					fills[smallest] = command->_bounds;
+			}
+		}
+	}
+}
+
+//
+// Groups runs of consecutive sprite commands by spritesheet. This is a stable insertion sort in
+// which a command only moves before another if their bounds do not overlap, thus the result is 
+// always pixel identical to executing the commands in recorded order.
+//
+static void batchSpriteCommands(DrawCommand* begin, DrawCommand* end)
+{
+	DrawCommand* run = begin;
+	while(run < end){
+		if(run->_type != DrawCommandType::SPRITE){
+			++run;
+			continue;
+		}
+		DrawCommand* runEnd = run;
+		while(runEnd < end && runEnd->_type == DrawCommandType::SPRITE && runEnd - run < maxSpriteBatchRun)
+			++runEnd;
+		for(DrawCommand* command = run + 1; command < runEnd; ++command){
+			DrawCommand* slot = command;
+			while(slot > run && (slot - 1)->_key > slot->_key && !isRectOverlap((slot - 1)->_bounds, slot->_bounds)){
+				std::swap(*(slot - 1), *slot);
+				--slot;
+			}
+		}
+		run = runEnd;
+	}
+}
+
+//
+// Splits a screen into tiles and bins the (unculled) commands of the screen by the tiles their
+// bounds touch. The bins are appended to tileCommands in recorded order as indices into 
+// sortedDrawCommands.
+//
+static void binDrawCommands(int screenid, const DrawCommand* begin, const DrawCommand* end)
+{
+	const Screen& screen = screens[screenid];
+	int tileColCount = (screen._resolution._x + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	int tileRowCount = (screen._resolution._y + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	int tileBase = static_cast<int>(rasterTiles.size());
+
+	for(int tileRow = 0; tileRow < tileRowCount; ++tileRow){
+		for(int tileCol = 0; tileCol < tileColCount; ++tileCol){
+			RasterTile tile;
+			tile._screenid = screenid;
+			tile._clip = clipRect({
+				tileCol * RASTER_TILE_SIZE, tileRow * RASTER_TILE_SIZE, RASTER_TILE_SIZE, RASTER_TILE_SIZE
+			}, getScreenBounds(screen));
+			tile._commandsBegin = 0;
+			tile._commandsEnd = 0;
+			rasterTiles.push_back(tile);
+		}
+	}
+
+	auto forEachTile = [&](const iRect& bounds, auto f){
+		int colBegin = bounds._x / RASTER_TILE_SIZE;
+		int colEnd = (bounds._x + bounds._w - 1) / RASTER_TILE_SIZE;
+		int rowBegin = bounds._y / RASTER_TILE_SIZE;
+		int rowEnd = (bounds._y + bounds._h - 1) / RASTER_TILE_SIZE;
+		for(int tileRow = rowBegin; tileRow <= rowEnd; ++tileRow)
+			for(int tileCol = colBegin; tileCol <= colEnd; ++tileCol)
+				f(rasterTiles[tileBase + tileCol + (tileRow * tileColCount)]);
+	};
+
+	//
+	// Count the commands in each tile, allocate each tile its range, then fill the ranges; the
+	// end of each range is used as the fill cursor.
+	//
+	for(const DrawCommand* command = begin; command < end; ++command)
+		if(!command->_isCulled)
+			forEachTile(command->_bounds, [](RasterTile& tile){++tile._commandsEnd;});
+
+	int offset = static_cast<int>(tileCommands.size());
+	for(int tileid = tileBase; tileid < static_cast<int>(rasterTiles.size()); ++tileid){
+		RasterTile& tile = rasterTiles[tileid];
+		tile._commandsBegin = offset;
+		offset += tile._commandsEnd;
+		tile._commandsEnd = tile._commandsBegin;
+	}
+	tileCommands.resize(offset);
+
+	for(const DrawCommand* command = begin; command < end; ++command){
+		if(command->_isCulled)
+			continue;
+		int commandid = static_cast<int>(command - sortedDrawCommands.data());
+		forEachTile(command->_bounds, [commandid](RasterTile& tile){
+			tileCommands[tile._commandsEnd++] = commandid;
+		});
+	}
+}
+
+static void rasterizeTile(int tileid)
+{
+	const RasterTile& tile = rasterTiles[tileid];
+	Screen& screen = screens[tile._screenid];
+	for(int i = tile._commandsBegin; i < tile._commandsEnd; ++i)
+		executeDrawCommand(screen, sortedDrawCommands[tileCommands[i]], tile._clip);
+}
+
+void flushDrawCommands()
+{
+	if(drawCommands.empty())
+		return;
+
+	//
+	// Counting sort the commands by screen (stable, so per screen order is preserved); screens
+	// are independent so this never changes the result.
+	//
+	int screenCount = static_cast<int>(screens.size());
+	screenCommandCounts.assign(screenCount + 1, 0);
+	for(const DrawCommand& command : drawCommands)
+		++screenCommandCounts[command._screenid + 1];
+	for(int i = 1; i <= screenCount; ++i)
+		screenCommandCounts[i] += screenCommandCounts[i - 1];
+	sortedDrawCommands.resize(drawCommands.size());
+	for(const DrawCommand& command : drawCommands)
+		sortedDrawCommands[screenCommandCounts[command._screenid]++] = command;
+
+	bool isTiled = (rasterWorkers.getThreadCount() > 1);
+
+	int screenBegin {0};
+	for(int screenid = 0; screenid < screenCount; ++screenid){
+		int screenEnd = screenCommandCounts[screenid];
+		if(screenBegin == screenEnd)
+			continue;
+
+		DrawCommand* begin = sortedDrawCommands.data() + screenBegin;
+		DrawCommand* end = sortedDrawCommands.data() + screenEnd;
+		screenBegin = screenEnd;
+
+		cullDrawCommands(begin, end);
+		batchSpriteCommands(begin, end);
+
+		//
+		// Screens are marked dirty here, on the calling thread, as the dirty region is shared by
+		// all tiles of the screen.
+		//
+		Screen& screen = screens[screenid];
+		for(DrawCommand* command = begin; command < end; ++command){
+			if(command->_isCulled){
+				++culledCommandCount;
+				continue;
+			}
+			resolveLazyClear(screen, command->_bounds, true);
+			markDirty(screen, command->_bounds);
+			if(!isTiled)
+				executeDrawCommand(screen, *command, getScreenBounds(screen));
+			++executedCommandCount;
+		}
+
+		if(isTiled)
+			binDrawCommands(screenid, begin, end);
+	}
+
+	if(isTiled)
+		rasterWorkers.run(static_cast<int>(rasterTiles.size()), &rasterizeTile);
+
+	drawCommands.clear();
+	sortedDrawCommands.clear();
+	retiredShaders.clear();
+	pointArena.clear();
+	ellipseArena.clear();
+	polygonArena.clear();
+	pointColorArena.clear();
+	pointIndexArena.clear();
+	blitSources.clear();
+	rasterTiles.clear();
+	tileCommands.clear();
+	++flushCount;
+}
+
+void setRasterThreadCount(int count)
+{
+	flushDrawCommands();
+	rasterWorkers.start(count);
+	log::log(log::LVL_INFO, log::msg_gfx_raster_threads, std::to_string(rasterWorkers.getThreadCount()));
+}
+
+int getRasterThreadCount()
+{
+	return rasterWorkers.getThreadCount();
+}
+
+void setDrawMode(DrawMode mode)
+{
+	if(mode == DrawMode::IMMEDIATE)
+		flushDrawCommands();
+	drawMode = mode;
+}
+
+DrawMode getDrawMode()
+{
+	return drawMode;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// DRAW CALLS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+void clearScreenTransparent(int screenid)
+{
+	clearScreenColor(Color4u{ALPHA_KEY, ALPHA_KEY, ALPHA_KEY, ALPHA_KEY}, screenid);
+}
+
+void clearScreenShade(int shade, int screenid)
+{
+	uint8_t s = static_cast<uint8_t>(std::max(0, std::min(shade, 255)));
+	clearScreenColor(Color4u{s, s, s, s}, screenid);
+}
+
+void clearScreenColor(Color4u color, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::CLEAR, screenid);
+	command._color = color;
+	Screen& screen = screens[screenid];
+	if(screen._isLazyClear && !screen._isClipped){
+		clearScreenLazily(screen, command);
+		return;
+	}
+	submitDrawCommand(command);
+}
+
+//
+// The tiles of a newly lazy screen are of unknown content thus touched.
+//
+void setScreenLazyClear(bool isLazy, int screenid)
+{
+	assert(0 <= screenid && screenid < static_cast<int>(screens.size()));
+	Screen& screen = screens[screenid];
+	if(screen._isLazyClear == isLazy)
+		return;
+	flushDrawCommands();
+	if(!isLazy){
+		resolveLazyClear(screen);
+		screen._isLazyClear = false;
+		screen._clearTiles.clear();
+		return;
+	}
+	screen._isLazyClear = true;
+	screen._clearGeneration = 0;
+	screen._clearTileCount = {
+		(screen._resolution._x + SCREEN_CLEAR_TILE_SIZE - 1) / SCREEN_CLEAR_TILE_SIZE,
+		(screen._resolution._y + SCREEN_CLEAR_TILE_SIZE - 1) / SCREEN_CLEAR_TILE_SIZE
+	};
+	screen._clearTiles.assign(screen._clearTileCount._x * screen._clearTileCount._y, ClearTile{0, true});
+}
+
+void drawSprite(Vector2i position, ResourceKey_t sheetKey, int spriteid, int screenid, 
+                bool mirrorX, bool mirrorY)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::SPRITE, screenid);
+	command._p0 = position;
+	command._key = sheetKey;
+	command._arg0 = spriteid;
+	command._mirrorX = mirrorX;
+	command._mirrorY = mirrorY;
+	submitDrawCommand(command);
+}
+
+void drawSpriteColumn(Vector2i position, ResourceKey_t sheetKey, int spriteid, int colid, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::SPRITE_COLUMN, screenid);
+	command._p0 = position;
+	command._key = sheetKey;
+	command._arg0 = spriteid;
+	command._arg1 = colid;
+	submitDrawCommand(command);
+}
+
+//
+// In deferred mode the run is pinned until the command is flushed.
+//
+void drawText(Vector2i position, const std::string& text, ResourceKey_t fontKey, Color4u color, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::TEXT, screenid);
+	command._p0 = position;
+	command._key = fontKey;
+	command._color = color;
+	command._arg0 = findTextRun(fontKey, text.data(), static_cast<int>(text.size()));
+	if(drawMode == DrawMode::DEFERRED)
+		textRuns[command._arg0]._pinnedFlush = flushCount;
+	submitDrawCommand(command);
+}
+
+void drawBorderRectangle(iRect rect, Color4u color, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::BORDER_RECTANGLE, screenid);
+	command._p0 = {rect._x, rect._y};
+	command._p1 = {rect._w, rect._h};
+	command._color = color;
+	submitDrawCommand(command);
+}
+
+void drawFillRectangle(iRect rect, Color4u color, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::FILL_RECTANGLE, screenid);
+	command._p0 = {rect._x, rect._y};
+	command._p1 = {rect._w, rect._h};
+	command._color = color;
+	submitDrawCommand(command);
+}
+
+void drawGradientRectangle(iRect rect, Color4u from, Color4u to, GradientDirection direction, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::GRADIENT_RECTANGLE, screenid);
+	command._p0 = {rect._x, rect._y};
+	command._p1 = {rect._w, rect._h};
+	command._arg0 = static_cast<int>(direction);
+	command._color = from;
+	command._color1 = to;
+	submitDrawCommand(command);
+}
+
+void drawDitherRectangle(iRect rect, Color4u color0, Color4u color1, int density, int screenid)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	auto& screen = screens[screenid];
+	DrawCommand command = makeDrawCommand(DrawCommandType::DITHER_RECTANGLE, screenid);
+	command._p0 = {rect._x, rect._y};
+	command._p1 = {rect._w, rect._h};
+	command._arg0 = std::clamp(density, 0, 16);
+	command._color = color0;
+	command._color1 = color1;
+	submitDrawCommand(command);
+}
 
-	auto search = spritesheets.find(sheetKey);
-	assert(search != spritesheets.end());
-	const auto& sheet = search->second._sheet;
-	const Color4u* const * sheetPxs = sheet._image.getPixels();
+void drawLine(Vector2i p0, Vector2i p1, Color4u color, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::LINE, screenid);
+	command._p0 = p0;
+	command._p1 = p1;
+	command._color = color;
+	submitDrawCommand(command);
+}
 
-	assert(0 <= spriteid);
-	spriteid = spriteid < sheet._sprites.size() ? spriteid : 0; // may be an error sheet with 1 sprite.
-	auto& sprite = sheet._sprites[spriteid];
+//
+// The points of a batch are copied into the point arena; in immediate mode they are dropped
+// again once drawn.
+//
+static void drawLineBatch(DrawCommandType type, const Vector2i* points, int count, bool isClosed, 
+                          Color4u color, int screenid)
+{
+	if(count < 2)
+		return;
+	DrawCommand command = makeDrawCommand(type, screenid);
+	command._arg0 = static_cast<int>(pointArena.size());
+	command._arg1 = count + (isClosed ? 1 : 0);
+	command._color = color;
+	pointArena.insert(pointArena.end(), points, points + count);
+	if(isClosed)
+		pointArena.push_back(points[0]);
+	submitDrawCommand(command);
+	if(drawMode == DrawMode::IMMEDIATE)
+		pointArena.resize(command._arg0);
+}
 
-	colid = std::clamp(colid, 0, sprite._size._x);
+void drawLines(const Vector2i* points, int count, Color4u color, int screenid)
+{
+	drawLineBatch(DrawCommandType::LINE_LIST, points, count, false, color, screenid);
+}
 
-	int screenRow {0}, screenCol{0}, screenRowOffset{0}, sheetCol{0};
+void drawPolyline(const Vector2i* points, int count, Color4u color, int screenid, bool isClosed)
+{
+	drawLineBatch(DrawCommandType::LINE_STRIP, points, count, isClosed && count > 2, color, screenid);
+}
 
-	screenCol = position._x + colid;
-	sheetCol = sprite._position._x + colid;
+static Ellipse toEllipse(const Circle& circle)
+{
+	return Ellipse{circle._center, {circle._radius, circle._radius}};
+}
 
-	if(screenCol < 0 || screenCol >= screen._resolution._x) 
-		return;
+static Ellipse toEllipse(const Ellipse& ellipse)
+{
+	return ellipse;
+}
 
-	for(int spriteRow = 0; spriteRow < sprite._size._y; ++spriteRow){
-		screenRow = position._y + spriteRow;
-		if(screenRow < 0) continue;
-		if(screenRow >= screen._resolution._y) break;
-		screenRowOffset = screenRow * screen._resolution._x;
-		const Color4u& color = sheetPxs[sprite._position._y + spriteRow][sheetCol];
-		if(color._a == ALPHA_KEY) continue;
-		screen._pxColors[screenCol + screenRowOffset] =
-			(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, screenCol, screenRow) : color;
+//
+// The shapes of a batch are copied into the shape arenas (shapes with a negative radius are 
+// dropped); in immediate mode they are dropped again once drawn.
+//
+template<typename Shape>
+static void drawEllipseBatch(DrawCommandType type, const Shape* shapes, int count, Color4u color, int screenid)
+{
+	DrawCommand command = makeDrawCommand(type, screenid);
+	command._arg0 = static_cast<int>(ellipseArena.size());
+	command._color = color;
+	for(int i = 0; i < count; ++i){
+		Ellipse ellipse = toEllipse(shapes[i]);
+		if(ellipse._radii._x < 0 || ellipse._radii._y < 0)
+			continue;
+		ellipse._radii._x = std::min(ellipse._radii._x, MAX_SHAPE_RADIUS);
+		ellipse._radii._y = std::min(ellipse._radii._y, MAX_SHAPE_RADIUS);
+		ellipseArena.push_back(ellipse);
 	}
+	command._arg1 = static_cast<int>(ellipseArena.size()) - command._arg0;
+	if(command._arg1 == 0)
+		return;
+	submitDrawCommand(command);
+	if(drawMode == DrawMode::IMMEDIATE)
+		ellipseArena.resize(command._arg0);
 }
 
-void drawText(Vector2i position, const std::string& text, ResourceKey_t fontKey, Color4u color, int screenid)
+void drawFillCircles(const Circle* circles, int count, Color4u color, int screenid)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	auto& screen = screens[screenid];
-
-	auto search = fonts.find(fontKey);
-	assert(search != fonts.end());
-	auto& font = search->second._font;
-	const Color4u* const* fontPxs = font._image.getPixels();
+	drawEllipseBatch(DrawCommandType::FILL_ELLIPSES, circles, count, color, screenid);
+}
 
-	int baseLineY = position._y + font._baseLine;
-	for(char c : text){
-		if(c == '\n') continue;
-		assert(' ' <= c && c <= '~');
-		const Glyph& glyph = font._glyphs[static_cast<int>(c - ' ')];
-		int screenRow{0}, screenCol{0}, screenRowBase{0}, screenRowOffset {0};
-		screenRowBase = baseLineY + glyph._yoffset;
-		for(int glyphRow = 0; glyphRow < glyph._height; ++glyphRow){
-			screenRow = screenRowBase + glyphRow;
-			if(screenRow < 0) continue;
-			if(screenRow >= screen._resolution._y) break;
-			screenRowOffset = screenRow * screen._resolution._x;
-			for(int glyphCol = 0; glyphCol < glyph._width; ++glyphCol){
-				screenCol = position._x + glyphCol + glyph._xoffset;
-				if(screenCol < 0) continue;
-				if(screenCol >= screen._resolution._x) return;
-				const Color4u& pxcolor = fontPxs[glyph._y + glyphRow][glyph._x + glyphCol];
-				if(pxcolor._a == ALPHA_KEY) continue;
-				screen._pxColors[screenCol + screenRowOffset] =
-					(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, screenCol, screenRow) : color;
-			}
-		}
-		position._x += glyph._xadvance + font._glyphSpace;
-	}
+void drawBorderCircles(const Circle* circles, int count, Color4u color, int screenid)
+{
+	drawEllipseBatch(DrawCommandType::BORDER_ELLIPSES, circles, count, color, screenid);
 }
 
-void drawBorderRectangle(iRect rect, Color4u color, int screenid)
+void drawFillEllipses(const Ellipse* ellipses, int count, Color4u color, int screenid)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	auto& screen = screens[screenid];
+	drawEllipseBatch(DrawCommandType::FILL_ELLIPSES, ellipses, count, color, screenid);
+}
 
-	int xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
-	int xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
-	int ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
-	int ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+void drawBorderEllipses(const Ellipse* ellipses, int count, Color4u color, int screenid)
+{
+	drawEllipseBatch(DrawCommandType::BORDER_ELLIPSES, ellipses, count, color, screenid);
+}
 
-	for(int x = xmin; x <= xmax; ++x){
-		screen._pxColors[x + (ymin * screen._resolution._x)] = 
-			(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, ymin) : color;
-		screen._pxColors[x + (ymax * screen._resolution._x)] = 
-			(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, ymax) : color;
-	}
+void drawFillCircle(Vector2i center, int radius, Color4u color, int screenid)
+{
+	Circle circle {center, radius};
+	drawFillCircles(&circle, 1, color, screenid);
+}
 
-	for(int y = ymin; y <= ymax; ++y){
-		screen._pxColors[xmin + (y * screen._resolution._x)] = 
-			(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, xmin, y) : color;
-		screen._pxColors[xmax + (y * screen._resolution._x)] = 
-			(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, xmax, y) : color;
-	}
+void drawBorderCircle(Vector2i center, int radius, Color4u color, int screenid)
+{
+	Circle circle {center, radius};
+	drawBorderCircles(&circle, 1, color, screenid);
 }
 
-void drawFillRectangle(iRect rect, Color4u color, int screenid)
+void drawFillEllipse(Vector2i center, Vector2i radii, Color4u color, int screenid)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	auto& screen = screens[screenid];
+	Ellipse ellipse {center, radii};
+	drawFillEllipses(&ellipse, 1, color, screenid);
+}
 
-	int xmin = std::clamp(rect._x,           0, screen._resolution._x - 1);
-	int xmax = std::clamp(rect._x + rect._w, 0, screen._resolution._x - 1);
-	int ymin = std::clamp(rect._y,           0, screen._resolution._y - 1);
-	int ymax = std::clamp(rect._y + rect._h, 0, screen._resolution._y - 1);
+void drawBorderEllipse(Vector2i center, Vector2i radii, Color4u color, int screenid)
+{
+	Ellipse ellipse {center, radii};
+	drawBorderEllipses(&ellipse, 1, color, screenid);
+}
 
-	for(int x = xmin; x <= xmax; ++x)
-		for(int y = ymin; y <= ymax; ++y)
-			screen._pxColors[x + (y * screen._resolution._x)] = 
-				(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, ymin) : color;
+void drawFillPolygons(const Vector2i* vertices, const int* counts, int polygonCount, Color4u color, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::FILL_POLYGONS, screenid);
+	command._arg0 = static_cast<int>(polygonArena.size());
+	command._color = color;
+	int pointBegin = static_cast<int>(pointArena.size());
+	for(int i = 0; i < polygonCount; ++i){
+		if(counts[i] > 0){
+			polygonArena.push_back(PolygonRef{static_cast<int>(pointArena.size()), counts[i]});
+			pointArena.insert(pointArena.end(), vertices, vertices + counts[i]);
+		}
+		vertices += std::max(0, counts[i]);
+	}
+	command._arg1 = static_cast<int>(polygonArena.size()) - command._arg0;
+	if(command._arg1 == 0)
+		return;
+	submitDrawCommand(command);
+	if(drawMode == DrawMode::IMMEDIATE){
+		polygonArena.resize(command._arg0);
+		pointArena.resize(pointBegin);
+	}
 }
 
-void drawLine(Vector2i p0, Vector2i p1, Color4u color, int screenid)
+void drawFillPolygon(const Vector2i* vertices, int count, Color4u color, int screenid)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	auto& screen = screens[screenid];
+	drawFillPolygons(vertices, &count, 1, color, screenid);
+}
 
-	p0._x = std::clamp(p0._x, 0, screen._resolution._x - 1);
-	p1._x = std::clamp(p1._x, 0, screen._resolution._x - 1);
-	p0._y = std::clamp(p0._y, 0, screen._resolution._y - 1);
-	p1._y = std::clamp(p1._y, 0, screen._resolution._y - 1);
+void drawBorderPolygon(const Vector2i* vertices, int count, Color4u color, int screenid)
+{
+	drawPolyline(vertices, count, color, screenid, true);
+}
 
-	//
-	// constants in line equation y=mx+c
-	//
-	int dx = static_cast<float>(p1._x - p0._x);
-	int dy = static_cast<float>(p1._y - p0._y);
+void drawPoint(Vector2i position, Color4u color, int screenid)
+{
+	DrawCommand command = makeDrawCommand(DrawCommandType::POINT, screenid);
+	command._p0 = position;
+	command._color = color;
+	submitDrawCommand(command);
+}
 
-	if(dx == 0 && dy == 0)
+//
+// The points of a batch are clipped to the screen (and clip rect) as they are drawn and only the
+// survivors copied into the point arenas; in immediate mode they are dropped again once drawn.
+//
+static void drawPointBatch(const Vector2i* points, const Color4u* colors, int count, Color4u color, int screenid)
+{
+	if(count <= 0)
+		return;
+	DrawCommand command = makeDrawCommand(colors != nullptr ? DrawCommandType::COLORED_POINTS : DrawCommandType::POINTS, screenid);
+	const Screen& screen = screens[screenid];
+	iRect clip {getScreenBounds(screen)};
+	if(screen._isClipped)
+		clip = clipRect(clip, screen._clip);
+	pointSurvivors.resize(count);
+	int survivorCount = clipPoints(points, count, clip, pointSurvivors.data());
+	if(survivorCount == 0)
 		return;
 
-	int ymin, ymax;
-	if(p0._y < p1._y){
-		ymin = p0._y;
-		ymax = p1._y;
+	command._arg0 = static_cast<int>(pointArena.size());
+	command._arg1 = survivorCount;
+	command._color = color;
+	pointArena.resize(command._arg0 + survivorCount);
+	for(int i = 0; i < survivorCount; ++i)
+		pointArena[command._arg0 + i] = points[pointSurvivors[i]];
+	if(colors != nullptr){
+		pointColorArena.resize(command._arg0 + survivorCount);
+		for(int i = 0; i < survivorCount; ++i)
+			pointColorArena[command._arg0 + i] = colors[pointSurvivors[i]];
 	}
-	else{
-		ymin = p1._y;
-		ymax = p0._y;
+	submitDrawCommand(command);
+	if(drawMode == DrawMode::IMMEDIATE){
+		pointArena.resize(command._arg0);
+		pointColorArena.resize(std::min<size_t>(pointColorArena.size(), command._arg0));
+		pointIndexArena.resize(std::min<size_t>(pointIndexArena.size(), command._arg0));
 	}
+}
 
-	int xmin, xmax;
-	if(p0._x < p1._x){
-		xmin = p0._x;
-		xmax = p1._x;
-	}
-	else{
-		xmin = p1._x;
-		xmax = p0._x;
-	}
+//
+// Points are converted as drawPoint converts them (truncated toward zero).
+//
+static const Vector2i* convertPoints(const Vector2f* points, int count)
+{
+	pointConversions.resize(std::max(0, count));
+	for(int i = 0; i < count; ++i)
+		pointConversions[i] = Vector2i{points[i]};
+	return pointConversions.data();
+}
+
+void drawPoints(const Vector2i* points, int count, Color4u color, int screenid)
+{
+	drawPointBatch(points, nullptr, count, color, screenid);
+}
 
-	if(dx == 0)
-		for(int y = ymin; y < ymax; ++y)
-			screen._pxColors[xmin + (y * screen._resolution._x)] = 
-				(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, xmin, y) : color;
+void drawPoints(const Vector2f* points, int count, Color4u color, int screenid)
+{
+	drawPointBatch(convertPoints(points, count), nullptr, count, color, screenid);
+}
 
-	else if(dy == 0)
-		for(int x = xmin; x < xmax; ++x)
-			screen._pxColors[x + (ymin * screen._resolution._x)] = 
-				(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, ymin) : color;
+void drawPoints(const Vector2i* points, const Color4u* colors, int count, int screenid)
+{
+	drawPointBatch(points, colors, count, Color4u{}, screenid);
+}
 
-	else{
-		float m = static_cast<float>(dy) / dx;
-		for(int x = xmin; x <= xmax; ++x){
-			int y = (m * x) + ymin;
-			screen._pxColors[x + (y * screen._resolution._x)] = 
-				(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, y) : color;
+void drawPoints(const Vector2f* points, const Color4u* colors, int count, int screenid)
+{
+	drawPointBatch(convertPoints(points, count), colors, count, Color4u{}, screenid);
+}
+
+//
+// Expands the dirty regions of the indices of an indexed screen through its palette into its
+// colors, which are then uploaded (or composed) as the colors of any other screen.
+//
+static void expandScreen(Screen& screen)
+{
+	const DirtyRegion& dirty = screen._dirty;
+	for(int i = 0; i < dirty._rectCount; ++i){
+		const iRect& rect = dirty._rects[i];
+		for(int row = rect._y; row < rect._y + rect._h; ++row){
+			int offset = rect._x + (row * screen._resolution._x);
+			expandRowIndexed(screen._pxColors + offset, screen._pxIndices + offset, screen._palette.data(), rect._w);
 		}
 	}
 }
 
-void drawPoint(Vector2i position, Color4u color, int screenid)
+//
+// In deferred mode the map is pinned until the command is flushed; see setTile.
+//
+void drawTileMap(Vector2i position, ResourceKey_t mapKey, int screenid)
 {
-	assert(0 <= screenid && screenid < screens.size());
-	auto& screen = screens[screenid];
+	DrawCommand command = makeDrawCommand(DrawCommandType::TILE_MAP, screenid);
+	command._p0 = position;
+	command._key = mapKey;
+	submitDrawCommand(command);
+	if(drawMode == DrawMode::DEFERRED)
+		getTileMap(mapKey)._pinnedFlush = flushCount;
+}
 
-	int x{position._x}, y{position._y};
+void blitScreenRegion(iRect region, int srcid, Vector2i position, int screenid)
+{
+	assert(0 <= srcid && srcid < screens.size());
+	const Screen& source = screens[srcid];
+	DrawCommand command = makeDrawCommand(DrawCommandType::BLIT, screenid);
+	assert(source._cmode == screens[screenid]._cmode);
 
-	if(x < 0 || x >= screen._resolution._x)
-		return;
+	//
+	// The region is clipped to the source; the position moves with the clipped edges.
+	//
+	iRect clipped = clipRect(region, getScreenBounds(source));
+	command._p0 = {position._x + clipped._x - region._x, position._y + clipped._y - region._y};
+	command._p1 = {clipped._x, clipped._y};
+	command._key = srcid;
+	command._arg0 = clipped._w;
+	command._arg1 = clipped._h;
 
-	if(y < 0 || y >= screen._resolution._y)
+	//
+	// The tiles of a screen may execute in parallel thus an overlapping blit would read pixels
+	// another tile is writing (and, even on one thread, depend on the order rows are written).
+	//
+	if(srcid == screenid && isRectOverlap(clipped, {command._p0._x, command._p0._y, clipped._w, clipped._h})){
+		log::log(log::LVL_WARN, log::msg_gfx_overlapping_blit, "screen=" + std::to_string(screenid));
 		return;
-
-	screen._pxColors[x + (y * screen._resolution._x)] =
-				(screen._xmode == PixelMode::SHADER) ? screen._pxShader(color, x, y) : color;
+	}
+	submitDrawCommand(command);
 }
 
 void present()
 {
+	flushDrawCommands();
+	presentStats._executedCommands = executedCommandCount;
+	presentStats._culledCommands = culledCommandCount;
+	executedCommandCount = 0;
+	culledCommandCount = 0;
+
+	presentStats._dirtyPixels = 0;
+	presentStats._dirtyRects = 0;
+	presentStats._skippedScreens = 0;
+
+	presentStats._composedScreens = 0;
+	presentStats._composedPixels = 0;
+
 	for(auto& screen : screens){
-		if(!screen._isEnabled) 
+		assert(!screen._isLocked);
+		resolveLazyClear(screen);
+	}
+
+	for(auto& screen : screens)
+		if(screen._isEnabled && screen._cmode == ColorMode::INDEXED)
+			expandScreen(screen);
+
+	if(isCompositing)
+		updateComposites();
+
+	auto uploadStart = std::chrono::steady_clock::now();
+	for(int screenid = 0; screenid < static_cast<int>(screens.size()); ++screenid){
+		Screen* screen = getPresentedScreen(screenid);
+		if(screen != nullptr && screen->_isEnabled)
+			uploadScreen(*screen);
+	}
+	auto uploadEnd = std::chrono::steady_clock::now();
+
+	presentStats._uploadMilliseconds = 
+		std::chrono::duration<double, std::milli>(uploadEnd - uploadStart).count();
+
+	for(int screenid = 0; screenid < static_cast<int>(screens.size()); ++screenid){
+		Screen* presented = getPresentedScreen(screenid);
+		if(presented == nullptr || !presented->_isEnabled) 
 			continue;
 
-		glVertexPointer(2, GL_INT, 0, screen._pxPositions);
-		glColorPointer(4, GL_UNSIGNED_BYTE, 0, screen._pxColors);
-		glPointSize(screen._pxSize);
-		glDrawArrays(GL_POINTS, 0, screen._pxCount);
+		backend->drawScreen(*presented);
 	}
 
-	SDL_GL_SwapWindow(window);
+	backend->endFrame();
 }
 
 void setScreenPixelMode(PixelMode mode, int screenid)
@@ -969,14 +3806,213 @@ void setScreenManualPixelSize(int pxSize, int screenid)
 void setPixelShader(PXShader_t shader, int screenid)
 {
 	assert(shader != nullptr);
+	setPixelShader(&shadeRow<PXShader_t>, std::make_shared<const PXShader_t>(shader), screenid);
+}
+
+void setSpanShader(PXSpanShader_t shader, int screenid)
+{
+	assert(shader != nullptr);
+	setPixelShader(&shadeSpan<PXSpanShader_t>, std::make_shared<const PXSpanShader_t>(shader), screenid);
+}
+
+void setPixelShader(PXRowShader_t rowShader, std::shared_ptr<const void> shader, int screenid)
+{
+	assert(rowShader != nullptr);
+	assert(0 <= screenid && screenid < screens.size());
+	auto& screen = screens[screenid];
+	if(!drawCommands.empty())
+		retiredShaders.push_back(std::move(screen._shader));
+	screen._rowShader = rowShader;
+	screen._shader = std::move(shader);
+}
+
+static Screen& getIndexedScreen(int screenid)
+{
+	assert(0 <= screenid && screenid < screens.size());
+	Screen& screen = screens[screenid];
+	assert(screen._cmode == ColorMode::INDEXED);
+	return screen;
+}
+
+void setScreenPalette(const Palette_t& palette, int screenid)
+{
+	Screen& screen = getIndexedScreen(screenid);
+	std::copy(palette.begin() + 1, palette.end(), screen._palette.begin() + 1);
+	markDirtyFullScreen(screen);
+}
+
+void setScreenPaletteColor(int index, Color4u color, int screenid)
+{
+	Screen& screen = getIndexedScreen(screenid);
+	if(index <= 0 || index >= PALETTE_SIZE)
+		return;
+	screen._palette[index] = color;
+	markDirtyFullScreen(screen);
+}
+
+void rotateScreenPalette(int first, int count, int shift, int screenid)
+{
+	Screen& screen = getIndexedScreen(screenid);
+	int last = std::min(first + count, PALETTE_SIZE);
+	first = std::max(first, 1);
+	count = last - first;
+	if(count <= 1)
+		return;
+	shift = ((shift % count) + count) % count;
+	auto begin = screen._palette.begin() + first;
+	std::rotate(begin, begin + (count - shift), begin + count);
+	markDirtyFullScreen(screen);
+}
+
+const Palette_t& getScreenPalette(int screenid)
+{
+	return getIndexedScreen(screenid)._palette;
+}
+
+int findPaletteIndex(const Palette_t& palette, Color4u color)
+{
+	if(color._a == ALPHA_KEY)
+		return 0;
+	int best {1}, bestDistance {std::numeric_limits<int>::max()};
+	for(int index = 1; index < PALETTE_SIZE; ++index){
+		const Color4u& entry = palette[index];
+		int dr {entry._r - color._r}, dg {entry._g - color._g}, db {entry._b - color._b};
+		int distance = (dr * dr) + (dg * dg) + (db * db);
+		if(distance < bestDistance){
+			bestDistance = distance;
+			best = index;
+			if(distance == 0)
+				break;
+		}
+	}
+	return best;
+}
+
+//
+// Pending commands may draw the sheet with its current indices, and tile maps cache them.
+//
+void quantizeSpritesheet(ResourceKey_t sheetKey, const Palette_t& palette)
+{
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	assert(resource != nullptr);
+	flushDrawCommands();
+	quantizeSpritesheet(resource->_sheet, palette);
+	markSheetTileChunksStale(sheetKey);
+}
+
+void setScreenScroll(Vector2i scroll, int screenid)
+{
+	assert(0 <= screenid && screenid < screens.size());
+	auto& screen = screens[screenid];
+	screen._scroll._x = wrapCoord(scroll._x, screen._resolution._x);
+	screen._scroll._y = wrapCoord(scroll._y, screen._resolution._y);
+}
+
+Vector2i getScreenScroll(int screenid)
+{
+	assert(0 <= screenid && screenid < screens.size());
+	return screens[screenid]._scroll;
+}
+
+//
+// The strip exposed by scrolling an axis by delta (from 'scroll', the offset prior to the scroll)
+// is the range of screen cols (or rows) [scroll, scroll + delta) for delta > 0 and 
+// [scroll + delta, scroll) for delta < 0, wrapped; these are the cols which were the first (or 
+// last) cols of the view and are now presented at the opposite edge. Calls f(begin, count) for
+// the (at most 2) unwrapped ranges of the strip.
+//
+template<typename F>
+static void forEachExposedRange(int scroll, int delta, int size, F f)
+{
+	if(delta == 0)
+		return;
+	if(std::abs(delta) >= size){
+		f(0, size);
+		return;
+	}
+	int begin = wrapCoord((delta > 0) ? scroll : scroll + delta, size);
+	int count = std::abs(delta);
+	int first = std::min(count, size - begin);
+	f(begin, first);
+	if(first < count)
+		f(0, count - first);
+}
+
+const ScrollExposure& scrollScreen(Vector2i delta, int screenid)
+{
+	static ScrollExposure exposure;
+
+	assert(0 <= screenid && screenid < screens.size());
+	auto& screen = screens[screenid];
+
+	Vector2i scroll = screen._scroll;
+	setScreenScroll(Vector2i{scroll._x + delta._x, scroll._y + delta._y}, screenid);
+
+	exposure._rectCount = 0;
+	auto expose = [&screen](const iRect& rect){
+		forEachViewRect(screen, rect, [](const iRect& piece, const iRect& view){
+			assert(exposure._rectCount < ScrollExposure::MAX_RECTS);
+			exposure._rects[exposure._rectCount] = piece;
+			exposure._offsets[exposure._rectCount] = Vector2i{piece._x - view._x, piece._y - view._y};
+			++exposure._rectCount;
+		});
+	};
+
+	//
+	// A scroll exceeding the screen in either axis exposes the whole screen.
+	//
+	if(std::abs(delta._x) >= screen._resolution._x || std::abs(delta._y) >= screen._resolution._y){
+		expose(getScreenBounds(screen));
+		return exposure;
+	}
+
+	forEachExposedRange(scroll._x, delta._x, screen._resolution._x, [&](int begin, int count){
+		expose(iRect{begin, 0, count, screen._resolution._y});
+	});
+
+	//
+	// The row strip excludes the cols already exposed.
+	//
+	int colBegin = (delta._x > 0) ? 0 : std::abs(delta._x);
+	int colEnd = screen._resolution._x - ((delta._x > 0) ? delta._x : 0);
+	forEachExposedRange(scroll._y, delta._y, screen._resolution._y, [&](int begin, int count){
+		forEachViewRect(screen, iRect{0, begin, screen._resolution._x, count}, [&](const iRect& piece, const iRect& view){
+			int xmin = std::max(view._x, colBegin);
+			int xmax = std::min(view._x + view._w, colEnd);
+			if(xmin >= xmax)
+				return;
+			assert(exposure._rectCount < ScrollExposure::MAX_RECTS);
+			Vector2i offset {piece._x - view._x, piece._y - view._y};
+			exposure._rects[exposure._rectCount] = iRect{xmin + offset._x, piece._y, xmax - xmin, piece._h};
+			exposure._offsets[exposure._rectCount] = offset;
+			++exposure._rectCount;
+		});
+	});
+
+	return exposure;
+}
+
+void setScreenClip(iRect clip, int screenid)
+{
+	assert(0 <= screenid && screenid < screens.size());
+	auto& screen = screens[screenid];
+	screen._clip = clipRect(clip, getScreenBounds(screen));
+	screen._isClipped = true;
+}
+
+void resetScreenClip(int screenid)
+{
 	assert(0 <= screenid && screenid < screens.size());
 	auto& screen = screens[screenid];
-	screen._pxShader = shader;
+	screen._clip = getScreenBounds(screen);
+	screen._isClipped = false;
 }
 
 void enableScreen(int screenid)
 {
 	assert(0 <= screenid && screenid < screens.size());
+	if(screens[screenid]._isOffscreen)
+		return;
 	screens[screenid]._isEnabled = true;
 }
 
@@ -988,49 +4024,106 @@ void disableScreen(int screenid)
 
 Vector2i calculateTextSize(const std::string& text, ResourceKey_t fontKey)
 {
-	Vector2i size{0, 0};
-
-	auto search = fonts.find(fontKey);
-	assert(search != fonts.end());
-	auto& font = search->second._font;
-
-	for(char c : text){
-		if(c == '\n') continue;
-		assert(' ' <= c && c <= '~');
-		const Glyph& glyph = font._glyphs[static_cast<int>(c - ' ')];
-		size._x += glyph._xadvance + font._glyphSpace;
-		size._y = size._y < glyph._height ? glyph._height : size._y;
-	}
-	return size;
+	return textRuns[findTextRun(fontKey, text.data(), static_cast<int>(text.size()))]._size;
 }
 
 bool isErrorSpritesheet(ResourceKey_t sheetKey)
 {
-	auto search = spritesheets.find(sheetKey);
-	assert(search != spritesheets.end());
-	return search->second._name == errorSpritesheetName;
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	assert(resource != nullptr);
+	return resource->_name == errorSpritesheetName;
 }
 
 Vector2i getSpritesheetSize(ResourceKey_t sheetKey)
 {
-	auto search = spritesheets.find(sheetKey);
-	assert(search != spritesheets.end());
-	return search->second._sheet._image.getSize();
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	assert(resource != nullptr);
+	return resource->_sheet._image.getSize();
 }
 
 Vector2i getSpriteSize(ResourceKey_t sheetKey, int spriteid)
 {
-	auto search = spritesheets.find(sheetKey);
-	assert(search != spritesheets.end());
-	assert(0 <= spriteid && spriteid < search->second._sheet._sprites.size());
-	return search->second._sheet._sprites[spriteid]._size;
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	assert(resource != nullptr);
+	assert(0 <= spriteid && spriteid < resource->_sheet._sprites.size());
+	return resource->_sheet._sprites[spriteid]._size;
 }
 
 const Spritesheet& getSpritesheet(ResourceKey_t sheetKey)
 {
-	auto search = spritesheets.find(sheetKey);
-	assert(search != spritesheets.end());
-	return search->second._sheet;
+	SpritesheetResource* resource = spritesheets.find(sheetKey);
+	assert(resource != nullptr);
+	return resource->_sheet;
+}
+
+const PresentStats& getPresentStats()
+{
+	return presentStats;
+}
+
+int getScreenCount()
+{
+	return static_cast<int>(screens.size());
+}
+
+void captureScreen(int screenid, io::Bmp& bmp)
+{
+	assert(0 <= screenid && screenid < static_cast<int>(screens.size()));
+	flushDrawCommands();
+	resolveLazyClear(screens[screenid]);
+	const Screen& screen = screens[screenid];
+	bmp.create(screen._resolution, Color4u{});
+	for(int row = 0; row < screen._resolution._y; ++row){
+		Color4u* dst = bmp.getRow(row);
+		if(screen._cmode == ColorMode::INDEXED){
+			forEachViewRun(screen, row, 0, screen._resolution._x, [&](int i, const Color4u* src, int n){
+				const uint8_t* indices = screen._pxIndices + (src - screen._pxColors);
+				expandRowIndexed(dst + i, indices, screen._palette.data(), n);
+			});
+		}
+		else{
+			forEachViewRun(screen, row, 0, screen._resolution._x, [dst](int i, const Color4u* src, int n){
+				memcpy(static_cast<void*>(dst + i), src, n * sizeof(Color4u));
+			});
+		}
+	}
+}
+
+ScreenPixels lockScreen(int screenid)
+{
+	assert(0 <= screenid && screenid < static_cast<int>(screens.size()));
+	assert(!screens[screenid]._isLocked);
+	flushDrawCommands();
+	Screen& screen = screens[screenid];
+	resolveLazyClear(screen);
+	screen._isLocked = true;
+	ScreenPixels pixels {};
+	pixels._colors = (screen._cmode == ColorMode::INDEXED) ? nullptr : screen._pxColors;
+	pixels._indices = screen._pxIndices;
+	pixels._size = screen._resolution;
+	pixels._stride = screen._resolution._x;
+	return pixels;
+}
+
+//
+// The tiles of a lazy screen were all resolved by the lock; the touched region is marked drawn
+// so the next lazy clear clears it.
+//
+void unlockScreen(iRect touched, int screenid)
+{
+	assert(0 <= screenid && screenid < static_cast<int>(screens.size()));
+	Screen& screen = screens[screenid];
+	assert(screen._isLocked);
+	screen._isLocked = false;
+	touched = clipRect(touched, getScreenBounds(screen));
+	resolveLazyClear(screen, touched, true);
+	markDirty(screen, touched);
+}
+
+void unlockScreen(int screenid)
+{
+	assert(0 <= screenid && screenid < static_cast<int>(screens.size()));
+	unlockScreen(getScreenBounds(screens[screenid]), screenid);
 }
 
 } // namespace gfx
@@ -2,9 +2,13 @@
 #include <vector>
 #include <cassert>
 #include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 #include <SDL_events.h>
 
 #include "pxr_input.h"
+#include "pxr_log.h"
 
 namespace pxr
 {
@@ -14,6 +18,22 @@ namespace input
 static std::array<KeyLog, KEY_COUNT> keys;   // logs for all keys.
 static std::vector<KeyCode> history;         // ordered history of keys pressed.
 
+struct ReplayEvent
+{
+	int _tick;            // the number of the update tick the event precedes.
+	KeyCode _key;
+	bool _isDown;
+};
+
+static int tickNumber {0};                   // num update ticks done.
+static bool isRecordingInput {false};
+static std::string recordingPath;
+static int recordingStartTick {0};
+static std::vector<ReplayEvent> recording;
+static bool isReplayingInput {false};
+static std::vector<ReplayEvent> replay;      // ordered by tick.
+static size_t nextReplayEvent {0};
+
 static KeyCode convertSdlKeyCode(int sdlCode)
 {
 	switch(sdlCode) {
@@ -60,16 +80,9 @@ void initialize()
 		key._isDown = key._isReleased = key._isPressed = false;
 }
 
-void onKeyEvent(const SDL_Event& event)
+static void applyKeyEvent(KeyCode key, bool isDown)
 {
-	assert(event.type == SDL_KEYDOWN || event.type == SDL_KEYUP);
-
-	KeyCode key = convertSdlKeyCode(event.key.keysym.sym);
-
-	if(key == KEY_COUNT) 
-		return;
-
-	if(event.type == SDL_KEYDOWN){
+	if(isDown){
 		keys[key]._isDown = true;
 		keys[key]._isPressed = true;
 		history.push_back(key);
@@ -80,11 +93,125 @@ void onKeyEvent(const SDL_Event& event)
 	}
 }
 
+static void applyReplayEvents()
+{
+	while(nextReplayEvent < replay.size() && replay[nextReplayEvent]._tick <= tickNumber){
+		const ReplayEvent& event = replay[nextReplayEvent];
+		applyKeyEvent(event._key, event._isDown);
+		++nextReplayEvent;
+	}
+}
+
+void onKeyEvent(const SDL_Event& event)
+{
+	assert(event.type == SDL_KEYDOWN || event.type == SDL_KEYUP);
+
+	KeyCode key = convertSdlKeyCode(event.key.keysym.sym);
+
+	if(key == KEY_COUNT || isReplayingInput) 
+		return;
+
+	bool isDown = (event.type == SDL_KEYDOWN);
+	if(isRecordingInput)
+		recording.push_back(ReplayEvent{tickNumber - recordingStartTick, key, isDown});
+
+	applyKeyEvent(key, isDown);
+}
+
 void onUpdate()
 {
 	for(auto& key : keys)
 		key._isPressed = key._isReleased = false;
 	history.clear();
+
+	++tickNumber;
+	if(isReplayingInput)
+		applyReplayEvents();
+}
+
+//
+// The key strings of each key code; the inverse of keyStringToKeyCode.
+//
+static constexpr std::array<const char*, KEY_COUNT> keyStrings {
+	"KEY_a", "KEY_b", "KEY_c", "KEY_d", "KEY_e", "KEY_f", "KEY_g", "KEY_h", "KEY_i", "KEY_j", 
+	"KEY_k", "KEY_l", "KEY_m", "KEY_n", "KEY_o", "KEY_p", "KEY_q", "KEY_r", "KEY_s", "KEY_t", 
+	"KEY_u", "KEY_v", "KEY_w", "KEY_x", "KEY_y", "KEY_z", "KEY_SPACE", "KEY_BACKSPACE", 
+	"KEY_ENTER", "KEY_LEFT", "KEY_RIGHT", "KEY_UP", "KEY_DOWN"
+};
+
+bool startRecording(const std::string& filepath)
+{
+	std::ofstream file {filepath, std::ios_base::trunc};
+	if(!file){
+		log::log(log::LVL_ERROR, log::msg_inp_fail_write_replay, filepath);
+		return false;
+	}
+	log::log(log::LVL_INFO, log::msg_inp_recording, filepath);
+	recordingPath = filepath;
+	recording.clear();
+	recordingStartTick = tickNumber;
+	isRecordingInput = true;
+	return true;
+}
+
+void stopRecording()
+{
+	if(!isRecordingInput)
+		return;
+
+	isRecordingInput = false;
+	std::ofstream file {recordingPath, std::ios_base::trunc};
+	for(const auto& event : recording)
+		file << event._tick << ' ' << keyStrings[event._key] << ' ' << (event._isDown ? "down" : "up") << '\n';
+	if(!file)
+		log::log(log::LVL_ERROR, log::msg_inp_fail_write_replay, recordingPath);
+	recording.clear();
+}
+
+//
+// Ticks are recorded and replayed relative to the tick recording/replaying started on. The 
+// events of the first tick of a replay are applied immediately.
+//
+bool startReplay(const std::string& filepath)
+{
+	std::ifstream file {filepath};
+	if(!file){
+		log::log(log::LVL_ERROR, log::msg_inp_fail_open_replay, filepath);
+		return false;
+	}
+	log::log(log::LVL_INFO, log::msg_inp_replaying, filepath);
+
+	replay.clear();
+	std::string line;
+	while(std::getline(file, line)){
+		if(line.empty())
+			continue;
+		std::istringstream ss {line};
+		ReplayEvent event {};
+		std::string keyString, state;
+		ss >> event._tick >> keyString >> state;
+		event._key = keyStringToKeyCode(keyString);
+		event._isDown = (state == "down");
+		if(!ss || event._key == KEY_COUNT || (state != "down" && state != "up")){
+			log::log(log::LVL_WARN, log::msg_inp_invalid_replay_event, line);
+			continue;
+		}
+		event._tick += tickNumber;
+		replay.push_back(event);
+	}
+	std::stable_sort(replay.begin(), replay.end(), [](const ReplayEvent& a, const ReplayEvent& b){
+		return a._tick < b._tick;
+	});
+
+	nextReplayEvent = 0;
+	isReplayingInput = true;
+	applyReplayEvents();
+	return true;
+}
+
+bool isReplaying()
+{
+	return isReplayingInput;
 }
 
 bool isKeyDown(KeyCode key)
@@ -12,6 +12,7 @@ ParticleEngine::ParticleEngine(Configuration config) :
 {
 	assert(0 < _config._maxParticles && _config._maxParticles <= HARD_MAX_PARTICLES);
 	_particles = new Particle[_config._maxParticles];
+	_drawPositions.reserve(_config._maxParticles);
 }
 
 ParticleEngine::~ParticleEngine()
@@ -49,11 +50,13 @@ void ParticleEngine::update(float dt)
 void ParticleEngine::draw(int screenid)
 {
 	assert(_particles != nullptr);
+	_drawPositions.clear();
 	for(int i = 0; i < _config._maxParticles; ++i){
 		auto& particle = _particles[i];
 		if(particle._isAlive)
-			gfx::drawPoint(particle._position, _config._color, screenid);
+			_drawPositions.push_back(particle._position);
 	}
+	gfx::drawPoints(_drawPositions.data(), static_cast<int>(_drawPositions.size()), _config._color, screenid);
 }
 
 void ParticleEngine::spawnParticle(Vector2f position, Vector2f velocity, Vector2f acceleration)
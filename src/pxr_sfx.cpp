@@ -8,6 +8,7 @@
 #include "pxr_sfx.h"
 #include "pxr_log.h"
 #include "pxr_wav.h"
+#include "pxr_slotmap.h"
 
 #include <iostream>
 
@@ -72,15 +73,17 @@ static ResourceName_t errorSoundName {"sfxerror"};
 ResourceKey_t errorSoundKey {0};
 
 //
-// The set of all loaded sounds accessed via their resource key.
+// The set of all loaded sounds accessed via their resource key. The name index maps sound names
+// to keys to find already loaded sounds.
 //
-static ResourceKey_t nextResourceKey {0};
-static std::unordered_map<ResourceKey_t, SoundResource> sounds;
+static SlotMap<SoundResource> sounds;
+static std::unordered_map<std::string, ResourceKey_t> soundKeys;
 
 //
 // The set of all loaded music accessed via their resource key.
 //
-static std::unordered_map<ResourceKey_t, MusicResource> music;
+static SlotMap<MusicResource> music;
+static std::unordered_map<std::string, ResourceKey_t> musicKeys;
 
 //
 // Music volume is updated in the update function at the next point in which the update will
@@ -169,33 +172,34 @@ static void generateErrorSound(SampleFormat format)
 	resource._name = errorSoundName;
 	resource._chunk = chunk;
 	resource._referenceCount = 0;
-	errorSoundKey = nextResourceKey++;
-	sounds.emplace(std::make_pair(errorSoundKey, resource));
+	errorSoundKey = sounds.insert(std::move(resource));
+	soundKeys.emplace(errorSoundName, errorSoundKey);
 }
 
 static void freeErrorSound()
 {
-	auto search = sounds.find(errorSoundKey);
-	assert(search != sounds.end());
-	auto& resource = search->second;
-	delete[] resource._chunk->abuf;
-	delete resource._chunk;
-	resource._chunk = nullptr;
-	sounds.erase(search);
+	SoundResource* resource = sounds.find(errorSoundKey);
+	assert(resource != nullptr);
+	delete[] resource->_chunk->abuf;
+	delete resource->_chunk;
+	resource->_chunk = nullptr;
+	soundKeys.erase(resource->_name);
+	sounds.erase(errorSoundKey);
 }
 
 static bool unloadSound(ResourceKey_t soundKey)
 {
 	assert(soundKey != errorSoundKey);
-	auto search = sounds.find(soundKey);
-	if(search == sounds.end()){
+	SoundResource* resource = sounds.find(soundKey);
+	if(resource == nullptr){
 		log::log(log::LVL_WARN, log::msg_sfx_unloading_nonexistent_sound, std::to_string(soundKey));
 	}
 	else{
-		search->second._referenceCount--;
-		if(search->second._referenceCount <= 0){
-			Mix_FreeChunk(search->second._chunk);
-			sounds.erase(search);
+		resource->_referenceCount--;
+		if(resource->_referenceCount <= 0){
+			Mix_FreeChunk(resource->_chunk);
+			soundKeys.erase(resource->_name);
+			sounds.erase(soundKey);
 			log::log(log::LVL_INFO, log::msg_sfx_sound_unloaded, std::to_string(soundKey));
 		}
 	}
@@ -217,10 +221,10 @@ static void unloadUnusedSounds()
 
 static ResourceKey_t returnErrorSound()
 {
-	auto search = sounds.find(errorSoundKey);
-	assert(search != sounds.end());
-	search->second._referenceCount++;
-	log::log(log::LVL_INFO, log::msg_sfx_error_sound_usage, std::to_string(search->second._referenceCount));
+	SoundResource* resource = sounds.find(errorSoundKey);
+	assert(resource != nullptr);
+	resource->_referenceCount++;
+	log::log(log::LVL_INFO, log::msg_sfx_error_sound_usage, std::to_string(resource->_referenceCount));
 	return errorSoundKey;
 }
 
@@ -228,14 +232,15 @@ ResourceKey_t loadSoundWAV(ResourceName_t soundName)
 {
 	log::log(log::LVL_INFO, log::msg_sfx_loading_sound, soundName);
 
-	for(auto& pair : sounds){
-		if(pair.second._name == soundName){
-			pair.second._referenceCount++;
-			std::string addendum {"reference count="};
-			addendum += std::to_string(pair.second._referenceCount);
-			log::log(log::LVL_INFO, log::msg_sfx_sound_already_loaded, addendum);
-			return pair.first;
-		}
+	auto search = soundKeys.find(soundName);
+	if(search != soundKeys.end()){
+		SoundResource* loaded = sounds.find(search->second);
+		assert(loaded != nullptr);
+		loaded->_referenceCount++;
+		std::string addendum {"reference count="};
+		addendum += std::to_string(loaded->_referenceCount);
+		log::log(log::LVL_INFO, log::msg_sfx_sound_already_loaded, addendum);
+		return search->second;
 	}
 
 	SoundResource resource {};
@@ -252,8 +257,8 @@ ResourceKey_t loadSoundWAV(ResourceName_t soundName)
 	resource._name = soundName;
 	resource._referenceCount = 1;
 
-	ResourceKey_t newKey = nextResourceKey++;
-	sounds.emplace(std::make_pair(newKey, resource));
+	ResourceKey_t newKey = sounds.insert(std::move(resource));
+	soundKeys.emplace(soundName, newKey);
 
 	std::string addendum{};
 	addendum += "[name:key]=[";
@@ -274,12 +279,12 @@ void queueUnloadSound(ResourceKey_t soundKey)
 
 static Mix_Chunk* findChunk(ResourceKey_t soundKey)
 {
-	auto search = sounds.find(soundKey);
-	if(search == sounds.end()){
+	SoundResource* resource = sounds.find(soundKey);
+	if(resource == nullptr){
 		log::log(log::LVL_WARN, log::msg_sfx_playing_nonexistent_sound, std::to_string(soundKey));
 		return nullptr;
 	}
-	return search->second._chunk;
+	return resource->_chunk;
 }
 
 static SoundChannel_t onSoundPlayError(ResourceKey_t soundKey)
@@ -412,12 +417,12 @@ static Mix_Music* findMusic(ResourceKey_t musicKey)
 		log::log(log::LVL_WARN, log::msg_sfx_playing_nonexistent_music, std::to_string(musicKey));
 		return nullptr;
 	}
-	auto search = music.find(musicKey);
-	if(search == music.end()){
+	MusicResource* resource = music.find(musicKey);
+	if(resource == nullptr){
 		log::log(log::LVL_WARN, log::msg_sfx_playing_nonexistent_music, std::to_string(musicKey));
 		return nullptr;
 	}
-	return search->second._music;
+	return resource->_music;
 }
 
 static void onMusicPlayError(ResourceKey_t musicKey)
@@ -535,7 +540,7 @@ void MusicSequencePlayer::resume()
 
 bool MusicSequencePlayer::isUsingMusicResource(ResourceKey_t musicKey)
 {
-	return music.find(musicKey) != music.end();
+	return music.contains(musicKey);
 }
 
 void MusicSequencePlayer::playNode(const MusicSequenceNode* node)
@@ -590,14 +595,15 @@ ResourceKey_t loadMusicWAV(ResourceName_t musicName)
 {
 	log::log(log::LVL_INFO, log::msg_sfx_loading_music, musicName);
 
-	for(auto& pair : music){
-		if(pair.second._name == musicName){
-			pair.second._referenceCount++;
-			std::string addendum {"reference count="};
-			addendum += std::to_string(pair.second._referenceCount);
-			log::log(log::LVL_INFO, log::msg_sfx_music_already_loaded, addendum);
-			return pair.first;
-		}
+	auto search = musicKeys.find(musicName);
+	if(search != musicKeys.end()){
+		MusicResource* loaded = music.find(search->second);
+		assert(loaded != nullptr);
+		loaded->_referenceCount++;
+		std::string addendum {"reference count="};
+		addendum += std::to_string(loaded->_referenceCount);
+		log::log(log::LVL_INFO, log::msg_sfx_music_already_loaded, addendum);
+		return search->second;
 	}
 
 	MusicResource resource {};
@@ -614,8 +620,8 @@ ResourceKey_t loadMusicWAV(ResourceName_t musicName)
 	resource._name = musicName;
 	resource._referenceCount = 1;
 
-	ResourceKey_t newKey = nextResourceKey++;
-	music.emplace(std::make_pair(newKey, resource));
+	ResourceKey_t newKey = music.insert(std::move(resource));
+	musicKeys.emplace(musicName, newKey);
 
 	std::string addendum{};
 	addendum += "[name:key]=[";
@@ -630,15 +636,16 @@ ResourceKey_t loadMusicWAV(ResourceName_t musicName)
 
 static bool unloadMusic(ResourceKey_t musicKey)
 {
-	auto search = music.find(musicKey);
-	if(search == music.end()){
+	MusicResource* resource = music.find(musicKey);
+	if(resource == nullptr){
 		log::log(log::LVL_WARN, log::msg_sfx_unloading_nonexistent_music, std::to_string(musicKey));
 	}
 	else{
-		search->second._referenceCount--;
-		if(search->second._referenceCount <= 0){
-			Mix_FreeMusic(search->second._music);
-			music.erase(search);
+		resource->_referenceCount--;
+		if(resource->_referenceCount <= 0){
+			Mix_FreeMusic(resource->_music);
+			musicKeys.erase(resource->_name);
+			music.erase(musicKey);
 			log::log(log::LVL_INFO, log::msg_sfx_music_unloaded, std::to_string(musicKey));
 		}
 	}
@@ -783,9 +790,11 @@ void shutdown()
 {
 	stopChannel(ALL_CHANNELS);
 	freeErrorSound();
-	for(auto& pair : sounds)
-		Mix_FreeChunk(pair.second._chunk);
+	sounds.forEach([](ResourceKey_t, SoundResource& resource){
+		Mix_FreeChunk(resource._chunk);
+	});
 	sounds.clear();
+	soundKeys.clear();
 	Mix_CloseAudio();
 }
 
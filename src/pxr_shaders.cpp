@@ -0,0 +1,192 @@
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PXR_SHADERS_SSE2
+#endif
+
+#include "pxr_shaders.h"
+
+namespace pxr
+{
+namespace gfx
+{
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// ROW KERNELS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline uint8_t scaleChannel(uint8_t channel, uint8_t factor)
+{
+	return static_cast<uint8_t>((channel * (factor + 1)) >> 8);
+}
+
+static inline Color4u scaleColor(Color4u color, Color4u factors)
+{
+	return Color4u{
+		scaleChannel(color._r, factors._r),
+		scaleChannel(color._g, factors._g),
+		scaleChannel(color._b, factors._b),
+		scaleChannel(color._a, factors._a)
+	};
+}
+
+#ifdef PXR_SHADERS_SSE2
+
+//
+// Scales the 4 pixels in 'pixels' by the 4 sets of factors in 'factors'. The channels are
+// widened to 16-bits so the products (at most 255 * 256) do not overflow.
+//
+static inline __m128i scalePixelsSSE2(__m128i pixels, __m128i factors)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_add_epi16(_mm_unpacklo_epi8(factors, zero), one));
+	__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), _mm_add_epi16(_mm_unpackhi_epi8(factors, zero), one));
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+#endif
+
+void multiplyRow(Color4u* pxColors, int count, Color4u factors)
+{
+	int i {0};
+#ifdef PXR_SHADERS_SSE2
+	uint32_t bits;
+	static_assert(sizeof(bits) == sizeof(Color4u));
+	memcpy(&bits, &factors, sizeof(bits));
+	const __m128i f = _mm_set1_epi32(static_cast<int>(bits));
+	for(; i + 4 <= count; i += 4){
+		__m128i* px = reinterpret_cast<__m128i*>(pxColors + i);
+		_mm_storeu_si128(px, scalePixelsSSE2(_mm_loadu_si128(px), f));
+	}
+#endif
+	for(; i < count; ++i)
+		pxColors[i] = scaleColor(pxColors[i], factors);
+}
+
+void multiplyRow(Color4u* pxColors, int count, const Color4u* factors)
+{
+	int i {0};
+#ifdef PXR_SHADERS_SSE2
+	for(; i + 4 <= count; i += 4){
+		__m128i* px = reinterpret_cast<__m128i*>(pxColors + i);
+		__m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(factors + i));
+		_mm_storeu_si128(px, scalePixelsSSE2(_mm_loadu_si128(px), f));
+	}
+#endif
+	for(; i < count; ++i)
+		pxColors[i] = scaleColor(pxColors[i], factors[i]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SHADERS
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MultiplyShader::operator()(Color4u* pxColors, int count, int, int) const
+{
+	multiplyRow(pxColors, count, _factors);
+}
+
+ScanlineShader::ScanlineShader(uint8_t shade, int period, int phase) :
+	_factors{shade, shade, shade, 255},
+	_period{std::max(1, period)},
+	_phase{phase}
+{}
+
+void ScanlineShader::operator()(Color4u* pxColors, int count, int, int pxy) const
+{
+	int row = (((pxy - _phase) % _period) + _period) % _period;
+	if(row != 0)
+		return;
+	multiplyRow(pxColors, count, _factors);
+}
+
+GradientShader::GradientShader(Color4u left, Color4u right, int width) :
+	_factors(std::max(1, width))
+{
+	auto lerp = [](uint8_t a, uint8_t b, int col, int cols){
+		return static_cast<uint8_t>(a + (((b - a) * col) / cols));
+	};
+	int cols = std::max(1, width - 1);
+	for(int col = 0; col < static_cast<int>(_factors.size()); ++col){
+		_factors[col] = Color4u{
+			lerp(left._r, right._r, col, cols),
+			lerp(left._g, right._g, col, cols),
+			lerp(left._b, right._b, col, cols),
+			255
+		};
+	}
+}
+
+void GradientShader::operator()(Color4u* pxColors, int count, int pxx, int) const
+{
+	int width = static_cast<int>(_factors.size());
+
+	//
+	// Cols outside the table are scaled by the factors of the nearest col.
+	//
+	while(count > 0 && pxx < 0){
+		*pxColors = scaleColor(*pxColors, _factors.front());
+		++pxColors; ++pxx; --count;
+	}
+	int inside = std::min(count, width - pxx);
+	if(inside > 0){
+		multiplyRow(pxColors, inside, _factors.data() + pxx);
+		pxColors += inside;
+		count -= inside;
+	}
+	if(count > 0)
+		multiplyRow(pxColors, count, _factors.back());
+}
+
+PaletteShader::PaletteShader(const std::vector<Color4u>& palette) :
+	_lut(LUT_SIZE)
+{
+	assert(!palette.empty());
+
+	//
+	// Each entry holds the nearest palette color to the center of the cube of colors it covers.
+	//
+	constexpr int shift {8 - CHANNEL_BITS};
+	constexpr int half {1 << (shift - 1)};
+	for(int index = 0; index < LUT_SIZE; ++index){
+		int r = (((index >> (CHANNEL_BITS * 2)) & ((1 << CHANNEL_BITS) - 1)) << shift) + half;
+		int g = (((index >> CHANNEL_BITS) & ((1 << CHANNEL_BITS) - 1)) << shift) + half;
+		int b = ((index & ((1 << CHANNEL_BITS) - 1)) << shift) + half;
+		int best {std::numeric_limits<int>::max()};
+		for(const Color4u& color : palette){
+			int dr {color._r - r}, dg {color._g - g}, db {color._b - b};
+			int distance = (dr * dr) + (dg * dg) + (db * db);
+			if(distance < best){
+				best = distance;
+				_lut[index] = color;
+			}
+		}
+	}
+}
+
+//
+// note: table lookups do not vectorize well (SSE2 has no gather and AVX2 gathers are slow) thus
+// this is a scalar loop.
+//
+void PaletteShader::operator()(Color4u* pxColors, int count, int, int) const
+{
+	constexpr int shift {8 - CHANNEL_BITS};
+	for(int i = 0; i < count; ++i){
+		Color4u& px = pxColors[i];
+		int index = ((px._r >> shift) << (CHANNEL_BITS * 2)) | ((px._g >> shift) << CHANNEL_BITS) | (px._b >> shift);
+		const Color4u& color = _lut[index];
+		px = Color4u{color._r, color._g, color._b, px._a};
+	}
+}
+
+} // namespace gfx
+} // namespace pxr
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include "pxr_workers.h"
+
+namespace pxr
+{
+
+WorkerPool::WorkerPool() :
+	_threads{},
+	_job{nullptr},
+	_jobCount{0},
+	_nextJob{0},
+	_batchid{0},
+	_busyWorkers{0},
+	_isStopping{false}
+{}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+void WorkerPool::start(int threadCount)
+{
+	stop();
+	threadCount = std::clamp(threadCount, 1, MAX_THREADS);
+	_isStopping = false;
+	for(int i = 1; i < threadCount; ++i)
+		_threads.emplace_back(&WorkerPool::workerMain, this, _batchid);
+}
+
+void WorkerPool::stop()
+{
+	if(_threads.empty())
+		return;
+	{
+		std::lock_guard<std::mutex> lock {_mutex};
+		_isStopping = true;
+	}
+	_batchStarted.notify_all();
+	for(auto& thread : _threads)
+		thread.join();
+	_threads.clear();
+}
+
+void WorkerPool::run(int jobCount, const Job_t& job)
+{
+	if(jobCount <= 0)
+		return;
+
+	if(_threads.empty() || jobCount == 1){
+		for(int jobid = 0; jobid < jobCount; ++jobid)
+			job(jobid);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock {_mutex};
+		_job = &job;
+		_jobCount = jobCount;
+		_nextJob.store(0, std::memory_order_relaxed);
+		_busyWorkers = static_cast<int>(_threads.size());
+		++_batchid;
+	}
+	_batchStarted.notify_all();
+
+	executeJobs();
+
+	//
+	// Workers decrement the busy count under the mutex after their last job, thus acquiring the
+	// mutex here also makes all their writes visible to the caller.
+	//
+	std::unique_lock<std::mutex> lock {_mutex};
+	_batchFinished.wait(lock, [this]{return _busyWorkers == 0;});
+	_job = nullptr;
+}
+
+//
+// Workers are passed the batch id at creation rather than reading it themselves so a batch run
+// before a new worker first acquires the mutex is not missed.
+//
+void WorkerPool::workerMain(int batchid)
+{
+	while(true){
+		{
+			std::unique_lock<std::mutex> lock {_mutex};
+			_batchStarted.wait(lock, [this, batchid]{return _isStopping || _batchid != batchid;});
+			if(_isStopping)
+				return;
+			batchid = _batchid;
+		}
+
+		executeJobs();
+
+		std::lock_guard<std::mutex> lock {_mutex};
+		if(--_busyWorkers == 0)
+			_batchFinished.notify_one();
+	}
+}
+
+void WorkerPool::executeJobs()
+{
+	int jobid = _nextJob.fetch_add(1, std::memory_order_relaxed);
+	while(jobid < _jobCount){
+		(*_job)(jobid);
+		jobid = _nextJob.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+} // namespace pxr
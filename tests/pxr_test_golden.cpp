@@ -0,0 +1,508 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iterator>
+
+#include "pxr_gfx.h"
+#include "pxr_blit.h"
+#include "pxr_shaders.h"
+#include "pxr_bmp.h"
+#include "pxr_log.h"
+
+//
+// Draws synthetic scenes covering every draw call, mirror mode, shader mode and color mode on
+// the headless backend and compares the screens against the golden images checked in under
+// the golden directory. Every scene is drawn with every blit kernel the CPU supports, in
+// immediate mode and deferred with 1 and RASTER_THREADS raster threads; all must match the same
+// golden image pixel for pixel. A mismatch writes <scene>_diff.bmp (see compareBmps) to the
+// working directory and fails the test.
+//
+// usage: pxr_test_golden <goldenDir> [record]
+//
+// With 'record' the goldens are (re)written from the immediate scalar run before the others are
+// compared against them; only do so after checking a change to the output is intended.
+//
+
+using namespace pxr;
+using namespace pxr::gfx;
+
+static constexpr Vector2i screenSize {128, 96};
+static constexpr int RASTER_THREADS {4};
+
+//
+// The screens the scenes draw to; a scene draws to one of them.
+//
+enum ScreenType
+{
+	SCREEN_RGB,
+	SCREEN_INDEXED,
+	SCREEN_PIXEL_SHADER,
+	SCREEN_SPAN_SHADER,
+	SCREEN_TYPE_COUNT
+};
+
+struct Scene
+{
+	const char* _name;
+	ScreenType _screen;
+	void (*_draw)(ScreenID_t screenid);
+};
+
+struct DrawConfig
+{
+	BlitKernel _kernel;
+	DrawMode _mode;
+	int _threads;
+};
+
+static ResourceKey_t sheetKey {0};
+static ResourceKey_t fontKey {0};
+static ResourceKey_t mapKey {0};
+static ScreenID_t surfaceid {0};
+
+static constexpr Vector2i spriteSize {12, 10};
+static constexpr int spriteCount {4};
+static constexpr Vector2i tileSize {8, 8};
+static constexpr Vector2i mapSize {20, 14};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RESOURCES
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// Sprites are asymmetric with transparent holes so every mirror mode draws a distinct image.
+// The tile sprites follow the sprites in the same sheet.
+//
+static ResourceKey_t makeSpritesheet()
+{
+	Vector2i imageSize {(spriteSize._x * spriteCount) + (tileSize._x * 2), spriteSize._y};
+	io::Bmp image {};
+	image.create(imageSize, Color4u{0, 0, 0, ALPHA_KEY});
+	std::vector<Sprite> sprites {};
+	for(int i = 0; i < spriteCount; ++i){
+		int x0 = i * spriteSize._x;
+		for(int row = 0; row < spriteSize._y; ++row){
+			for(int col = 0; col < spriteSize._x; ++col){
+				if(col > row + i || ((col + row) % 5) == 0)
+					continue;
+				Color4u color {uint8_t(40 + (i * 50)), uint8_t(col * 20), uint8_t(row * 25), 255};
+				image.getRow(row)[x0 + col] = color;
+			}
+		}
+		Sprite sprite {};
+		sprite._position = Vector2i{x0, 0};
+		sprite._size = spriteSize;
+		sprite._origin = Vector2i{i, i / 2};
+		sprites.push_back(std::move(sprite));
+	}
+	for(int i = 0; i < 2; ++i){
+		int x0 = (spriteSize._x * spriteCount) + (i * tileSize._x);
+		for(int row = 0; row < tileSize._y; ++row){
+			for(int col = 0; col < tileSize._x; ++col){
+				if(i == 1 && col == row)
+					continue;
+				Color4u color {uint8_t(200 - (col * 10)), uint8_t(90 + (i * 80)), uint8_t(row * 30), 255};
+				image.getRow(row)[x0 + col] = color;
+			}
+		}
+		Sprite tile {};
+		tile._position = Vector2i{x0, 0};
+		tile._size = tileSize;
+		tile._origin = Vector2i{0, 0};
+		sprites.push_back(std::move(tile));
+	}
+	return registerSpritesheet("pxr_test_sprites", std::move(image), std::move(sprites));
+}
+
+//
+// A 6x6x6 color cube followed by a ramp of grays; index 0 is the transparent color.
+//
+static Palette_t makePalette()
+{
+	Palette_t palette {};
+	int index {1};
+	for(int r = 0; r < 6; ++r)
+		for(int g = 0; g < 6; ++g)
+			for(int b = 0; b < 6; ++b)
+				palette[index++] = Color4u{uint8_t(r * 51), uint8_t(g * 51), uint8_t(b * 51), 255};
+	for(int gray = 0; index < PALETTE_SIZE; ++gray){
+		uint8_t shade = static_cast<uint8_t>(8 + (gray * 6));
+		palette[index++] = Color4u{shade, shade, shade, 255};
+	}
+	return palette;
+}
+
+static Color4u shadePixel(Color4u color, int pxx, int pxy)
+{
+	uint8_t g = static_cast<uint8_t>(color._g ^ (pxx * 4));
+	uint8_t b = static_cast<uint8_t>(color._b ^ (pxy * 4));
+	return Color4u{color._r, g, b, color._a};
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SCENES
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void drawSpritesScene(ScreenID_t screenid)
+{
+	clearScreenShade(30, screenid);
+	for(int i = 0; i < 16; ++i){
+		Vector2i position {-6 + ((i % 4) * 36), -4 + ((i / 4) * 27)};
+		drawSprite(position, sheetKey, i % spriteCount, screenid, (i & 1) != 0, (i & 2) != 0);
+	}
+	for(int col = 0; col < spriteSize._x; ++col)
+		drawSpriteColumn(Vector2i{60 + (col * 2), 44}, sheetKey, col % spriteCount, col, screenid);
+}
+
+static void drawTextScene(ScreenID_t screenid)
+{
+	clearScreenColor(Color4u{10, 20, 60, 255}, screenid);
+	drawText(Vector2i{2, 80}, "GOLDEN", fontKey, colors::white, screenid);
+	drawText(Vector2i{-10, 40}, "clipped at both edges", fontKey, Color4u{250, 200, 30, 255}, screenid);
+	drawText(Vector2i{30, 2}, "abc 123", fontKey, Color4u{20, 250, 90, 255}, screenid);
+	drawText(Vector2i{30, 90}, "top", fontKey, Color4u{240, 60, 60, 255}, screenid);
+}
+
+static void drawRectanglesScene(ScreenID_t screenid)
+{
+	clearScreenTransparent(screenid);
+	drawFillRectangle(iRect{4, 4, 40, 30}, Color4u{200, 40, 40, 255}, screenid);
+	drawFillRectangle(iRect{100, 70, 60, 60}, Color4u{40, 200, 40, 255}, screenid);
+	drawBorderRectangle(iRect{20, 20, 50, 40}, Color4u{250, 250, 0, 255}, screenid);
+	drawBorderRectangle(iRect{-5, 60, 30, 50}, Color4u{0, 250, 250, 255}, screenid);
+	drawGradientRectangle(iRect{50, 4, 70, 20}, Color4u{255, 0, 0, 255}, Color4u{0, 0, 255, 255},
+	                      GradientDirection::HORIZONTAL, screenid);
+	drawGradientRectangle(iRect{80, 30, 20, 60}, Color4u{0, 0, 0, 255}, Color4u{255, 255, 255, 255},
+	                      GradientDirection::VERTICAL, screenid);
+	for(int density = 0; density <= 16; density += 4)
+		drawDitherRectangle(iRect{4 + (density * 3), 64, 11, 28}, Color4u{30, 30, 30, 255},
+		                    Color4u{230, 120, 0, 255}, density, screenid);
+}
+
+static void drawLinesScene(ScreenID_t screenid)
+{
+	clearScreenShade(1, screenid);
+	Vector2i center {64, 48};
+	for(int i = 0; i < 16; ++i){
+		int dx = (i < 8) ? (i * 10) - 40 : 70 * ((i & 1) ? 1 : -1);
+		int dy = (i < 8) ? 60 * ((i & 1) ? 1 : -1) : ((i - 8) * 12) - 42;
+		uint8_t c = static_cast<uint8_t>(80 + (i * 10));
+		Vector2i end {center._x + dx, center._y + dy};
+		drawLine(center, end, Color4u{c, uint8_t(255 - c), 128, 255}, screenid);
+	}
+	Vector2i segments[] {{2, 2}, {30, 10}, {2, 10}, {2, 40}, {120, 94}, {127, 0}};
+	drawLines(segments, 6, Color4u{255, 255, 255, 255}, screenid);
+	Vector2i strip[] {{90, 10}, {110, 20}, {100, 40}, {120, 60}, {95, 50}};
+	drawPolyline(strip, 5, Color4u{255, 0, 255, 255}, screenid);
+	Vector2i loop[] {{10, 60}, {40, 70}, {30, 90}, {5, 85}};
+	drawPolyline(loop, 4, Color4u{0, 255, 0, 255}, screenid, true);
+}
+
+static void drawPointsScene(ScreenID_t screenid)
+{
+	clearScreenTransparent(screenid);
+	std::vector<Vector2i> points {};
+	std::vector<Vector2f> pointsf {};
+	std::vector<Color4u> colors {};
+	uint32_t seed {777};
+	for(int i = 0; i < 400; ++i){
+		seed = (seed * 1664525u) + 1013904223u;
+		int x = static_cast<int>((seed >> 8) % (screenSize._x + 20)) - 10;
+		int y = static_cast<int>((seed >> 16) % (screenSize._y + 20)) - 10;
+		points.push_back(Vector2i{x, y});
+		pointsf.push_back(Vector2f{x + 0.4f, y - 0.3f});
+		colors.push_back(Color4u{uint8_t(seed), uint8_t(seed >> 4), uint8_t(seed >> 12), 255});
+	}
+	for(int i = 0; i < 50; ++i)
+		drawPoint(points[i], Color4u{255, 255, 255, 255}, screenid);
+	drawPoints(points.data() + 50, 100, Color4u{255, 0, 0, 255}, screenid);
+	drawPoints(pointsf.data() + 150, 100, Color4u{0, 255, 0, 255}, screenid);
+	drawPoints(points.data() + 250, colors.data() + 250, 75, screenid);
+	drawPoints(pointsf.data() + 325, colors.data() + 325, 75, screenid);
+}
+
+static void drawShapesScene(ScreenID_t screenid)
+{
+	clearScreenColor(Color4u{0, 40, 0, 255}, screenid);
+	drawFillCircle(Vector2i{20, 20}, 15, Color4u{200, 0, 0, 255}, screenid);
+	drawBorderCircle(Vector2i{20, 20}, 18, Color4u{255, 255, 0, 255}, screenid);
+	drawFillEllipse(Vector2i{70, 70}, Vector2i{40, 12}, Color4u{0, 0, 200, 255}, screenid);
+	drawBorderEllipse(Vector2i{70, 70}, Vector2i{12, 30}, Color4u{0, 255, 255, 255}, screenid);
+	Circle circles[] {{{110, 10}, 8}, {{120, 30}, 0}, {{-3, 50}, 10}, {{100, 95}, 6}};
+	drawFillCircles(circles, 4, Color4u{255, 128, 0, 255}, screenid);
+	drawBorderCircles(circles, 4, Color4u{255, 255, 255, 255}, screenid);
+	Ellipse ellipses[] {{{45, 45}, {6, 3}}, {{60, 20}, {3, 9}}, {{126, 60}, {20, 5}}};
+	drawFillEllipses(ellipses, 3, Color4u{128, 0, 255, 255}, screenid);
+	drawBorderEllipses(ellipses, 3, Color4u{200, 200, 200, 255}, screenid);
+	Vector2i triangle[] {{40, 85}, {60, 60}, {75, 92}};
+	drawFillPolygon(triangle, 3, Color4u{250, 100, 150, 255}, screenid);
+	drawBorderPolygon(triangle, 3, Color4u{255, 255, 255, 255}, screenid);
+	Vector2i polygons[] {
+		{90, 30}, {110, 35}, {115, 50}, {95, 55}, {85, 42},
+		{5, 70}, {25, 72}, {15, 92}
+	};
+	int counts[] {5, 3};
+	drawFillPolygons(polygons, counts, 2, Color4u{60, 180, 250, 255}, screenid);
+}
+
+static void drawTileMapScene(ScreenID_t screenid)
+{
+	clearScreenShade(60, screenid);
+	for(int row = 0; row < mapSize._y; ++row){
+		for(int col = 0; col < mapSize._x; ++col){
+			SpriteID_t tile = ((col + row) % 3 == 0) ? EMPTY_TILE : spriteCount + ((col * row) % 2);
+			setTile(Vector2i{col, row}, tile, mapKey);
+		}
+	}
+	drawTileMap(Vector2i{-13, -7}, mapKey, screenid);
+	setTile(Vector2i{3, 3}, spriteCount + 1, mapKey);
+	setTile(Vector2i{4, 3}, EMPTY_TILE, mapKey);
+	drawTileMap(Vector2i{60, 40}, mapKey, screenid);
+}
+
+static void drawBlitsScene(ScreenID_t screenid)
+{
+	clearScreenTransparent(surfaceid);
+	drawFillCircle(Vector2i{16, 16}, 14, Color4u{220, 180, 0, 255}, surfaceid);
+	drawSprite(Vector2i{10, 10}, sheetKey, 1, surfaceid, true, false);
+	clearScreenColor(Color4u{40, 0, 40, 255}, screenid);
+	for(int i = 0; i < 5; ++i)
+		blitScreenRegion(iRect{0, 0, 32, 32}, surfaceid, Vector2i{-10 + (i * 30), 8 + (i * 12)}, screenid);
+	blitScreenRegion(iRect{8, 8, 16, 16}, surfaceid, Vector2i{100, 4}, screenid);
+	blitScreenRegion(iRect{0, 0, 40, 20}, screenid, Vector2i{60, 70}, screenid);
+	blitScreenRegion(iRect{0, 0, 40, 20}, screenid, Vector2i{20, 10}, screenid);   // overlaps; skipped.
+}
+
+static void drawScrolledClippedScene(ScreenID_t screenid)
+{
+	drawSpritesScene(screenid);
+	setScreenScroll(Vector2i{37, 11}, screenid);
+	const ScrollExposure& exposure = scrollScreen(Vector2i{9, -5}, screenid);
+	for(int i = 0; i < exposure._rectCount; ++i){
+		setScreenClip(exposure._rects[i], screenid);
+		clearScreenColor(Color4u{0, 0, 100, 255}, screenid);
+		drawFillCircle(Vector2i{64, 48} + exposure._offsets[i], 30, Color4u{255, 200, 200, 255}, screenid);
+	}
+	setScreenClip(iRect{30, 20, 50, 40}, screenid);
+	drawLinesScene(screenid);
+	drawText(Vector2i{0, 30}, "clipped text", fontKey, colors::white, screenid);
+	resetScreenClip(screenid);
+}
+
+static void drawLazyClearedScene(ScreenID_t screenid)
+{
+	setScreenLazyClear(true, screenid);
+	clearScreenColor(Color4u{10, 10, 10, 255}, screenid);
+	drawFillRectangle(iRect{40, 40, 20, 20}, Color4u{255, 0, 0, 255}, screenid);
+	clearScreenColor(Color4u{10, 10, 10, 255}, screenid);
+	drawSprite(Vector2i{70, 70}, sheetKey, 2, screenid, false, true);
+	flushDrawCommands();
+	clearScreenColor(Color4u{0, 60, 90, 255}, screenid);
+	drawFillCircle(Vector2i{20, 70}, 12, Color4u{255, 255, 0, 255}, screenid);
+	drawText(Vector2i{2, 2}, "lazy", fontKey, colors::white, screenid);
+	setScreenLazyClear(false, screenid);
+}
+
+//
+// Every primitive in one scene; drawn to the indexed and shader screens.
+//
+static void drawAllScene(ScreenID_t screenid)
+{
+	drawRectanglesScene(screenid);
+	drawTileMap(Vector2i{-110, -84}, mapKey, screenid);
+	drawSprite(Vector2i{90, 40}, sheetKey, 0, screenid, false, false);
+	drawSprite(Vector2i{102, 40}, sheetKey, 1, screenid, true, false);
+	drawSprite(Vector2i{90, 52}, sheetKey, 2, screenid, false, true);
+	drawSprite(Vector2i{102, 52}, sheetKey, 3, screenid, true, true);
+	drawSpriteColumn(Vector2i{120, 40}, sheetKey, 0, 5, screenid);
+	drawText(Vector2i{2, 86}, "all 42", fontKey, Color4u{255, 255, 255, 255}, screenid);
+	Vector2i segments[] {{0, 0}, {127, 95}, {0, 95}, {127, 0}};
+	drawLines(segments, 4, Color4u{255, 0, 128, 255}, screenid);
+	drawFillCircle(Vector2i{64, 48}, 10, Color4u{0, 128, 255, 255}, screenid);
+	drawBorderEllipse(Vector2i{64, 48}, Vector2i{20, 14}, Color4u{255, 255, 255, 255}, screenid);
+	Vector2i triangle[] {{100, 70}, {124, 74}, {110, 92}};
+	drawFillPolygon(triangle, 3, Color4u{128, 255, 0, 255}, screenid);
+	Vector2i points[] {{1, 50}, {3, 50}, {5, 50}, {7, 50}};
+	Color4u pointColors[] {{255, 0, 0, 255}, {0, 255, 0, 255}, {0, 0, 255, 255}, {255, 255, 0, 255}};
+	drawPoints(points, pointColors, 4, screenid);
+	drawPoint(Vector2i{9, 50}, Color4u{255, 255, 255, 255}, screenid);
+}
+
+//
+// Sprites and a tile map drawn with the sheet quantized to the screen's palette, then sprites
+// drawn with it requantized to the palette rotated by an index; draws of each must keep the 
+// indices of their time. The sheet is requantized to the screen's palette again after.
+//
+static void drawRequantizedScene(ScreenID_t screenid)
+{
+	Palette_t palette = makePalette();
+	Palette_t rotated {palette};
+	for(int index = 1; index < PALETTE_SIZE; ++index)
+		rotated[index] = palette[1 + (index % (PALETTE_SIZE - 1))];
+	drawSpritesScene(screenid);
+	drawTileMap(Vector2i{-20, 50}, mapKey, screenid);
+	quantizeSpritesheet(sheetKey, rotated);
+	for(int i = 0; i < 4; ++i)
+		drawSprite(Vector2i{70 + (i * 14), 60}, sheetKey, i % spriteCount, screenid, false, (i & 1) != 0);
+	drawTileMap(Vector2i{60, 80}, mapKey, screenid);
+	quantizeSpritesheet(sheetKey, palette);
+}
+
+static const Scene scenes[] {
+	{"sprites",          SCREEN_RGB,          drawSpritesScene},
+	{"text",             SCREEN_RGB,          drawTextScene},
+	{"rectangles",       SCREEN_RGB,          drawRectanglesScene},
+	{"lines",            SCREEN_RGB,          drawLinesScene},
+	{"points",           SCREEN_RGB,          drawPointsScene},
+	{"shapes",           SCREEN_RGB,          drawShapesScene},
+	{"tilemap",          SCREEN_RGB,          drawTileMapScene},
+	{"blits",            SCREEN_RGB,          drawBlitsScene},
+	{"scroll_clip",      SCREEN_RGB,          drawScrolledClippedScene},
+	{"lazy_clear",       SCREEN_RGB,          drawLazyClearedScene},
+	{"indexed",          SCREEN_INDEXED,      drawAllScene},
+	{"requantized",      SCREEN_INDEXED,      drawRequantizedScene},
+	{"pixel_shader",     SCREEN_PIXEL_SHADER, drawAllScene},
+	{"span_shader",      SCREEN_SPAN_SHADER,  drawAllScene}
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RUNNER
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<DrawConfig> makeDrawConfigs()
+{
+	std::vector<DrawConfig> configs {};
+	for(BlitKernel kernel : {BlitKernel::SCALAR, BlitKernel::SSE2, BlitKernel::AVX2}){
+		if(!setBlitKernel(kernel))
+			continue;
+		configs.push_back(DrawConfig{kernel, DrawMode::IMMEDIATE, 1});
+		configs.push_back(DrawConfig{kernel, DrawMode::DEFERRED, 1});
+		configs.push_back(DrawConfig{kernel, DrawMode::DEFERRED, RASTER_THREADS});
+	}
+	return configs;
+}
+
+static void printConfig(const Scene& scene, const DrawConfig& config)
+{
+	printf("%-14s %-7s %-9s x%d", scene._name, getBlitKernelName(config._kernel),
+	       config._mode == DrawMode::IMMEDIATE ? "immediate" : "deferred", config._threads);
+}
+
+//
+// Returns true if every config draws the scene identical to its golden image.
+//
+static bool checkScene(const Scene& scene, ScreenID_t screenid, const std::string& goldenDir, 
+                       bool isRecording, const std::vector<DrawConfig>& configs)
+{
+	std::string goldenPath = goldenDir + "/" + scene._name + io::Bmp::FILE_EXTENSION;
+	io::Bmp golden {};
+	if(!isRecording && !golden.load(goldenPath)){
+		printf("%-14s missing golden %s\n", scene._name, goldenPath.c_str());
+		return false;
+	}
+
+	bool isPassed {true};
+	for(const DrawConfig& config : configs){
+		setBlitKernel(config._kernel);
+		setDrawMode(config._mode);
+		setRasterThreadCount(config._threads);
+		setScreenScroll(Vector2i{0, 0}, screenid);
+
+		scene._draw(screenid);
+		io::Bmp image {};
+		captureScreen(screenid, image);
+
+		if(isRecording){
+			isRecording = false;
+			if(!image.write(goldenPath)){
+				printf("%-14s failed to write %s\n", scene._name, goldenPath.c_str());
+				return false;
+			}
+			golden = std::move(image);
+			printConfig(scene, config);
+			printf("  recorded\n");
+			continue;
+		}
+
+		io::Bmp diffImage {};
+		io::BmpDiff diff = io::compareBmps(image, golden, &diffImage);
+		printConfig(scene, config);
+		if(!diff._isSizeMismatch && diff._diffPixels == 0){
+			printf("  ok\n");
+			continue;
+		}
+		isPassed = false;
+		if(diff._isSizeMismatch){
+			printf("  FAILED size mismatch\n");
+			continue;
+		}
+		printf("  FAILED pixels:%d maxDelta:%d bounds:[%d,%d,%d,%d]\n", diff._diffPixels, 
+		       diff._maxChannelDelta, diff._bounds._x, diff._bounds._y, diff._bounds._w, diff._bounds._h);
+		diffImage.write(std::string{scene._name} + "_diff" + io::Bmp::FILE_EXTENSION);
+	}
+	return isPassed;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2){
+		fprintf(stderr, "usage: pxr_test_golden <goldenDir> [record]\n");
+		return EXIT_FAILURE;
+	}
+	std::string goldenDir {argv[1]};
+	bool isRecording = (argc > 2) && (strcmp(argv[2], "record") == 0);
+
+	log::initialize();
+	BackendConfig backend {};
+	backend._type = BackendType::HEADLESS;
+	if(!initialize("pxr_test_golden", screenSize, false, backend)){
+		fprintf(stderr, "failed to initialize gfx\n");
+		return EXIT_FAILURE;
+	}
+
+	sheetKey = makeSpritesheet();
+	mapKey = createTileMap(sheetKey, tileSize, mapSize);
+
+	//
+	// No font assets ship with the engine; the missing font resolves to the built-in error font.
+	//
+	fontKey = loadFont("pxr_test_font");
+
+	surfaceid = createSurface(Vector2i{40, 32});
+
+	ScreenID_t screenids[SCREEN_TYPE_COUNT] {};
+	screenids[SCREEN_RGB] = createScreen(screenSize);
+	screenids[SCREEN_INDEXED] = createIndexedScreen(screenSize, makePalette());
+	screenids[SCREEN_PIXEL_SHADER] = createScreen(screenSize);
+	setPixelShader(&shadePixel, screenids[SCREEN_PIXEL_SHADER]);
+	setScreenPixelMode(PixelMode::SHADER, screenids[SCREEN_PIXEL_SHADER]);
+	screenids[SCREEN_SPAN_SHADER] = createScreen(screenSize);
+	setSpanShader(GradientShader{Color4u{255, 80, 80, 255}, Color4u{80, 80, 255, 255}, screenSize._x},
+	              screenids[SCREEN_SPAN_SHADER]);
+	setScreenPixelMode(PixelMode::SHADER, screenids[SCREEN_SPAN_SHADER]);
+
+	std::vector<DrawConfig> configs = makeDrawConfigs();
+	BlitKernel best = configs.back()._kernel;
+
+	int failedScenes {0};
+	for(const Scene& scene : scenes)
+		if(!checkScene(scene, screenids[scene._screen], goldenDir, isRecording, configs))
+			++failedScenes;
+
+	setBlitKernel(best);
+	setDrawMode(DrawMode::IMMEDIATE);
+	shutdown();
+	log::shutdown();
+
+	printf("%d of %d scenes failed\n", failedScenes, static_cast<int>(std::size(scenes)));
+	return (failedScenes == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}